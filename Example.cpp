@@ -100,27 +100,11 @@ int main(int argc, char* argv[])
         }
 
         // Clear the entire canvas with a blue background (RGB: 0, 0, 255)
-        for (unsigned int i = 0; i < (canvas.getWidth() * canvas.getHeight()); i++)
-        {
-            canvas.draw(i, 0, 0, 255); // Drawing the blue background pixel by pixel.
-        }
+        canvas.clear(0, 0, 255);
 
         // Draw the plane image at the calculated coordinates
-        for (unsigned int i = 0; i < image.height; i++) // Loop through the image height
-        {
-            for (unsigned int n = 0; n < image.width; n++) // Loop through the image width
-            {
-                // Ensure drawing stays within canvas bounds
-                if ((planeX + n) >= 0 && (planeX + n) < canvas.getWidth() && (planeY + i) >= 0 && (planeY + i) < canvas.getHeight())
-                {
-                    // Only draw the pixel if the alpha transparency of the pixel is above some value (in this case 210)
-                    if (image.alphaAt(n, i) > 210)
-                    {
-                        canvas.draw(planeX + n, planeY + i, image.at(n, i)); // Draw the plane's pixel onto the canvas
-                    }
-                }
-            }
-        }
+        // Only pixels with an alpha transparency above some value (in this case 210) are drawn, and the image is clipped to the canvas bounds
+        canvas.blit(image, planeX, planeY, 210);
 
         // Display the frame on the screen. This must be called once the frame is finished in order to display the frame.
         canvas.present();
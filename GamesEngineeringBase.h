@@ -25,55 +25,9072 @@ SOFTWARE.
 #pragma once
 
 // Include necessary Windows and DirectX headers
+// Only the Image and Surface classes are portable, so everything else is compiled on Windows only
+#if defined(_WIN32)
 #define NOMINMAX
 #include <Windows.h>
-#include <string>
 #include <D3D11.h>
 #include <D3Dcompiler.h>
 #include <xaudio2.h>
-#include <map>
 #include <wincodec.h>
 #include <wincodecsdk.h>
 #include <wrl/client.h>
 #include <Xinput.h>
+#else
+// Memory mapping for AssetPack
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <string>
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <new>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <fstream>
 #include <math.h>
+#include <string.h>
+#include <stdint.h>
 #include <algorithm>
 
-// Link necessary libraries
-#pragma comment(lib, "D3D11.lib")
-#pragma comment(lib, "D3DCompiler.lib")
-#pragma comment(lib, "WindowsCodecs.lib")
-#pragma comment(lib, "xinput.lib")
+// Include SIMD intrinsics on x86 and x64. Kernels using instructions above SSE2 are tagged so they can be compiled without global compiler flags and selected at runtime
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define GEB_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define GEB_TARGET_SSE2
+#define GEB_TARGET_SSSE3
+#define GEB_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define GEB_TARGET_SSE2 __attribute__((target("sse2")))
+#define GEB_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define GEB_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(_WIN32)
+// Link necessary libraries
+#pragma comment(lib, "D3D11.lib")
+#pragma comment(lib, "D3DCompiler.lib")
+#pragma comment(lib, "WindowsCodecs.lib")
+#pragma comment(lib, "xinput.lib")
+
+// Stop warnings about possible NULL values for buffer and backbuffer. This should work on any modern hardware.
+#pragma warning( disable : 6387)
+#endif
+
+// Define the namespace to encapsulate the library's classes
+namespace GamesEngineeringBase
+{
+
+	// Layouts of pixel memory that can be drawn into
+	enum PixelFormat
+	{
+		PixelRGB888 = 0,     // 3 bytes per pixel in red, green, blue order
+		PixelRGBX8888 = 1,   // 4 bytes per pixel in red, green, blue order. The fourth byte is unused
+		PixelBGRX8888 = 2    // 4 bytes per pixel in blue, green, red order. The fourth byte is unused
+	};
+
+	// How an image is sampled when it is drawn scaled or rotated
+	enum SampleMode
+	{
+		SampleNearest = 0,   // Use the closest texel
+		SampleBilinear = 1   // Blend the four closest texels
+	};
+
+	// How source pixels are combined with the destination
+	enum BlendMode
+	{
+		BlendAlphaTest = 0,  // Draw pixels with an alpha value above the threshold and skip the rest
+		BlendAlpha = 1       // Mix the source over the destination using its alpha value
+	};
+
+	// How particles are combined with the destination
+	enum ParticleBlend
+	{
+		ParticleAdd = 0,     // Add the particle color, scaled by its alpha value, to the destination
+		ParticleAlpha = 1    // Mix the particle color over the destination using its alpha value
+	};
+
+	// File formats FrameCapture can write
+	enum CaptureEncoding
+	{
+		CapturePNG = 0,      // Smaller files, slower to encode
+		CaptureQOI = 1       // Larger files, several times faster to encode
+	};
+
+	// Stream formats FrameRecorder can write
+	enum RecordFormat
+	{
+		RecordDelta = 0,     // Only tiles that changed since the previous frame, run length encoded. Lossless and read back with RecordingReader
+		RecordY4M = 1        // Uncompressed YUV 4:4:4 frames that video tools such as ffmpeg read directly
+	};
+
+	// The CPU class reports which SIMD instruction sets can be used on the current machine
+	// The checks are done once and cached so the drawing code can select kernels at runtime
+	class CPU
+	{
+	private:
+		bool sse2 = false;   // SSE2 is supported
+		bool ssse3 = false;  // SSSE3 is supported
+		bool avx2 = false;   // AVX2 is supported and enabled by the OS
+
+		// Queries the processor on construction
+		CPU()
+		{
+#if defined(GEB_X86)
+#if defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+			int maxLeaf = info[0];
+			__cpuid(info, 1);
+			sse2 = (info[3] & (1 << 26)) != 0;
+			ssse3 = (info[2] & (1 << 9)) != 0;
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			bool avx = (info[2] & (1 << 28)) != 0;
+			if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+			{
+				__cpuidex(info, 7, 0);
+				avx2 = (info[1] & (1 << 5)) != 0;
+			}
+#else
+			__builtin_cpu_init();
+			sse2 = __builtin_cpu_supports("sse2") != 0;
+			ssse3 = __builtin_cpu_supports("ssse3") != 0;
+			avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+#endif
+		}
+
+		// Returns the cached CPU information
+		static const CPU& get()
+		{
+			static CPU cpu;
+			return cpu;
+		}
+
+	public:
+		// Checks if SSE2 kernels can be used
+		static bool hasSSE2()
+		{
+			return get().sse2;
+		}
+
+		// Checks if SSSE3 kernels can be used
+		static bool hasSSSE3()
+		{
+			return get().ssse3;
+		}
+
+		// Checks if AVX2 kernels can be used
+		static bool hasAVX2()
+		{
+			return get().avx2;
+		}
+	};
+
+	// Row kernels used by the drawing code. Each has a scalar version and, on x86, SIMD versions selected at runtime
+	namespace Kernels
+	{
+		// Copies count RGBA pixels from src into the RGB pixels at dst, skipping pixels with alpha <= threshold
+		inline void alphaTestRowScalar(unsigned char* dst, const unsigned char* src, unsigned int count, unsigned char threshold)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				if (src[3] > threshold)
+				{
+					dst[0] = src[0];
+					dst[1] = src[1];
+					dst[2] = src[2];
+				}
+				dst += 3;
+				src += 4;
+			}
+		}
+
+#if defined(GEB_X86)
+		// SSSE3 version of alphaTestRowScalar. Handles 4 pixels per step, blending the packed RGB values into the destination with a byte mask
+		GEB_TARGET_SSSE3 inline void alphaTestRowSSSE3(unsigned char* dst, const unsigned char* src, unsigned int count, unsigned char threshold)
+		{
+			const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+			const __m128i spread = _mm_setr_epi8(3, 3, 3, 7, 7, 7, 11, 11, 11, 15, 15, 15, -1, -1, -1, -1);
+			if (threshold == 255)
+			{
+				return;
+			}
+			const __m128i limit = _mm_set1_epi8(static_cast<char>(threshold + 1));
+			unsigned int i = 0;
+			// Each step writes 16 bytes, so stop while the write stays within the row
+			for (; i + 6 <= count; i += 4)
+			{
+				__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i * 4]));
+				__m128i pass = _mm_cmpeq_epi8(_mm_max_epu8(s, limit), s);
+				__m128i mask = _mm_shuffle_epi8(pass, spread);
+				if (_mm_movemask_epi8(mask) == 0)
+				{
+					continue;
+				}
+				__m128i rgb = _mm_shuffle_epi8(s, pack);
+				__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dst[i * 3]));
+				d = _mm_or_si128(_mm_and_si128(mask, rgb), _mm_andnot_si128(mask, d));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i * 3]), d);
+			}
+			alphaTestRowScalar(&dst[i * 3], &src[i * 4], count - i, threshold);
+		}
+
+		// AVX2 version of alphaTestRowScalar. Handles 8 pixels per step
+		GEB_TARGET_AVX2 inline void alphaTestRowAVX2(unsigned char* dst, const unsigned char* src, unsigned int count, unsigned char threshold)
+		{
+			const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+				0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+			const __m256i spread = _mm256_setr_epi8(3, 3, 3, 7, 7, 7, 11, 11, 11, 15, 15, 15, -1, -1, -1, -1,
+				3, 3, 3, 7, 7, 7, 11, 11, 11, 15, 15, 15, -1, -1, -1, -1);
+			// Moves the 12 packed bytes of the upper lane next to those of the lower lane
+			const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+			if (threshold == 255)
+			{
+				return;
+			}
+			const __m256i limit = _mm256_set1_epi8(static_cast<char>(threshold + 1));
+			unsigned int i = 0;
+			// Each step writes 32 bytes, so stop while the write stays within the row
+			for (; i + 11 <= count; i += 8)
+			{
+				__m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i * 4]));
+				__m256i pass = _mm256_cmpeq_epi8(_mm256_max_epu8(s, limit), s);
+				__m256i mask = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(pass, spread), join);
+				if (_mm256_testz_si256(mask, mask))
+				{
+					continue;
+				}
+				__m256i rgb = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(s, pack), join);
+				__m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&dst[i * 3]));
+				d = _mm256_blendv_epi8(d, rgb, mask);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i * 3]), d);
+			}
+			alphaTestRowSSSE3(&dst[i * 3], &src[i * 4], count - i, threshold);
+		}
+#endif
+
+		// Function pointer type for alpha tested row copies
+		typedef void (*AlphaTestRowFunc)(unsigned char* dst, const unsigned char* src, unsigned int count, unsigned char threshold);
+
+		// Returns the fastest alpha tested row copy supported by this CPU
+		inline AlphaTestRowFunc alphaTestRow()
+		{
+#if defined(GEB_X86)
+			if (CPU::hasAVX2())
+			{
+				return alphaTestRowAVX2;
+			}
+			if (CPU::hasSSSE3())
+			{
+				return alphaTestRowSSSE3;
+			}
+#endif
+			return alphaTestRowScalar;
+		}
+
+		// Writes the repeating pixel bytes to dst[from] up to dst[to], where byte n of the row holds pixel[n % bytesPerPixel]
+		// The position within the pixel is stepped rather than found with a divide per byte, as the divisor is only known at runtime
+		inline void fillBytes(unsigned char* dst, unsigned int from, unsigned int to, const unsigned char* pixel, unsigned int bytesPerPixel)
+		{
+			unsigned int phase = from % bytesPerPixel;
+			for (unsigned int i = from; i < to; i++)
+			{
+				dst[i] = pixel[phase];
+				phase = phase + 1 == bytesPerPixel ? 0 : phase + 1;
+			}
+		}
+
+		// Fills pattern with size bytes of repeating pixel bytes, starting at the first byte of the pixel, by copying the part already written
+		inline void fillPattern(unsigned char* pattern, unsigned int size, const unsigned char* pixel, unsigned int bytesPerPixel)
+		{
+			memcpy(pattern, pixel, bytesPerPixel);
+			for (unsigned int filled = bytesPerPixel; filled < size; filled *= 2)
+			{
+				memcpy(&pattern[filled], pattern, std::min(filled, size - filled));
+			}
+		}
+
+		// Fills count pixels of 3 or 4 bytes at dst with copies of pixel
+		inline void fillRowScalar(unsigned char* dst, unsigned int count, const unsigned char* pixel, unsigned int bytesPerPixel)
+		{
+			if (bytesPerPixel == 4)
+			{
+				for (unsigned int i = 0; i < count; i++)
+				{
+					memcpy(&dst[i * 4], pixel, 4);
+				}
+				return;
+			}
+			for (unsigned int i = 0; i < count; i++)
+			{
+				dst[0] = pixel[0];
+				dst[1] = pixel[1];
+				dst[2] = pixel[2];
+				dst += 3;
+			}
+		}
+
+#if defined(GEB_X86)
+		// SSE2 version of fillRowScalar
+		// Both 3 and 4 byte pixels repeat every 48 bytes, so the unaligned head is written a byte at a time and the rest with aligned 16 byte stores from a 48 byte pattern
+		GEB_TARGET_SSE2 inline void fillRowSSE2(unsigned char* dst, unsigned int count, const unsigned char* pixel, unsigned int bytesPerPixel)
+		{
+			// Short rows such as glyph and shape edges are cheaper to write a pixel at a time than to set up the pattern
+			if (count < 16)
+			{
+				fillRowScalar(dst, count, pixel, bytesPerPixel);
+				return;
+			}
+			unsigned int size = count * bytesPerPixel;
+			unsigned int head = std::min(size, static_cast<unsigned int>((16 - (reinterpret_cast<uintptr_t>(dst) & 15)) & 15));
+			fillBytes(dst, 0, head, pixel, bytesPerPixel);
+			unsigned int i = head;
+			if (size - i >= 16)
+			{
+				// The pattern is read from the byte of the pixel that the first aligned store starts on
+				unsigned char pattern[52];
+				fillPattern(pattern, sizeof(pattern), pixel, bytesPerPixel);
+				const unsigned char* start = &pattern[i % bytesPerPixel];
+				const __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&start[0]));
+				const __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&start[16]));
+				const __m128i p2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&start[32]));
+				for (; i + 48 <= size; i += 48)
+				{
+					_mm_store_si128(reinterpret_cast<__m128i*>(&dst[i]), p0);
+					_mm_store_si128(reinterpret_cast<__m128i*>(&dst[i + 16]), p1);
+					_mm_store_si128(reinterpret_cast<__m128i*>(&dst[i + 32]), p2);
+				}
+				if (i + 16 <= size)
+				{
+					_mm_store_si128(reinterpret_cast<__m128i*>(&dst[i]), p0);
+					i += 16;
+					if (i + 16 <= size)
+					{
+						_mm_store_si128(reinterpret_cast<__m128i*>(&dst[i]), p1);
+						i += 16;
+					}
+				}
+			}
+			fillBytes(dst, i, size, pixel, bytesPerPixel);
+		}
+
+		// AVX2 version of fillRowScalar, using aligned 32 byte stores from a 96 byte pattern
+		GEB_TARGET_AVX2 inline void fillRowAVX2(unsigned char* dst, unsigned int count, const unsigned char* pixel, unsigned int bytesPerPixel)
+		{
+			// The longer byte by byte head only pays off on long rows such as clear(). Shorter ones are faster with 16 byte stores
+			if (count < 512)
+			{
+				fillRowSSE2(dst, count, pixel, bytesPerPixel);
+				return;
+			}
+			unsigned int size = count * bytesPerPixel;
+			unsigned int head = std::min(size, static_cast<unsigned int>((32 - (reinterpret_cast<uintptr_t>(dst) & 31)) & 31));
+			fillBytes(dst, 0, head, pixel, bytesPerPixel);
+			unsigned int i = head;
+			if (size - i >= 32)
+			{
+				// The 96 byte pattern is two periods of 48 bytes, built from three 16 byte loads as in fillRowSSE2
+				unsigned char pattern[52];
+				fillPattern(pattern, sizeof(pattern), pixel, bytesPerPixel);
+				const unsigned char* start = &pattern[i % bytesPerPixel];
+				const __m128i q0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&start[0]));
+				const __m128i q1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&start[16]));
+				const __m128i q2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&start[32]));
+				const __m256i p0 = _mm256_inserti128_si256(_mm256_castsi128_si256(q0), q1, 1);
+				const __m256i p1 = _mm256_inserti128_si256(_mm256_castsi128_si256(q2), q0, 1);
+				const __m256i p2 = _mm256_inserti128_si256(_mm256_castsi128_si256(q1), q2, 1);
+				for (; i + 96 <= size; i += 96)
+				{
+					_mm256_store_si256(reinterpret_cast<__m256i*>(&dst[i]), p0);
+					_mm256_store_si256(reinterpret_cast<__m256i*>(&dst[i + 32]), p1);
+					_mm256_store_si256(reinterpret_cast<__m256i*>(&dst[i + 64]), p2);
+				}
+				if (i + 32 <= size)
+				{
+					_mm256_store_si256(reinterpret_cast<__m256i*>(&dst[i]), p0);
+					i += 32;
+					if (i + 32 <= size)
+					{
+						_mm256_store_si256(reinterpret_cast<__m256i*>(&dst[i]), p1);
+						i += 32;
+					}
+				}
+			}
+			fillBytes(dst, i, size, pixel, bytesPerPixel);
+		}
+#endif
+
+		// Function pointer type for single colour row fills
+		typedef void (*FillRowFunc)(unsigned char* dst, unsigned int count, const unsigned char* pixel, unsigned int bytesPerPixel);
+
+		// Returns the fastest row fill supported by this CPU
+		inline FillRowFunc fillRow()
+		{
+#if defined(GEB_X86)
+			if (CPU::hasAVX2())
+			{
+				return fillRowAVX2;
+			}
+			if (CPU::hasSSE2())
+			{
+				return fillRowSSE2;
+			}
+#endif
+			return fillRowScalar;
+		}
+
+		// Copies count RGBA pixels from src into the 32 bit pixels at dst, skipping pixels with alpha <= threshold
+		// When swapRB is true the destination is BGRX. The unused fourth byte is set to 255
+		inline void alphaTestRow32Scalar(unsigned char* dst, const unsigned char* src, unsigned int count, unsigned char threshold, bool swapRB)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				if (src[3] > threshold)
+				{
+					dst[0] = swapRB ? src[2] : src[0];
+					dst[1] = src[1];
+					dst[2] = swapRB ? src[0] : src[2];
+					dst[3] = 255;
+				}
+				dst += 4;
+				src += 4;
+			}
+		}
+
+#if defined(GEB_X86)
+		// SSE2 version of alphaTestRow32Scalar. Each pixel is one 32 bit lane, so 4 pixels are tested and written per step
+		GEB_TARGET_SSE2 inline void alphaTestRow32SSE2(unsigned char* dst, const unsigned char* src, unsigned int count, unsigned char threshold, bool swapRB)
+		{
+			const __m128i limit = _mm_set1_epi32(threshold);
+			const __m128i opaque = _mm_set1_epi32(static_cast<int>(0xFF000000));
+			const __m128i redBlue = _mm_set1_epi32(0x00FF00FF);
+			const __m128i green = _mm_set1_epi32(0x0000FF00);
+			unsigned int i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i * 4]));
+				__m128i mask = _mm_cmpgt_epi32(_mm_srli_epi32(s, 24), limit);
+				if (_mm_movemask_epi8(mask) == 0)
+				{
+					continue;
+				}
+				if (swapRB)
+				{
+					__m128i rb = _mm_and_si128(s, redBlue);
+					s = _mm_or_si128(_mm_and_si128(s, green), _mm_or_si128(_mm_srli_epi32(rb, 16), _mm_slli_epi32(rb, 16)));
+				}
+				s = _mm_or_si128(s, opaque);
+				__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dst[i * 4]));
+				d = _mm_or_si128(_mm_and_si128(mask, s), _mm_andnot_si128(mask, d));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i * 4]), d);
+			}
+			alphaTestRow32Scalar(&dst[i * 4], &src[i * 4], count - i, threshold, swapRB);
+		}
+
+		// AVX2 version of alphaTestRow32Scalar. Handles 8 pixels per step with a masked store
+		GEB_TARGET_AVX2 inline void alphaTestRow32AVX2(unsigned char* dst, const unsigned char* src, unsigned int count, unsigned char threshold, bool swapRB)
+		{
+			const __m256i limit = _mm256_set1_epi32(threshold);
+			const __m256i opaque = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+			const __m256i swap = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+				2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+			unsigned int i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				__m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i * 4]));
+				__m256i mask = _mm256_cmpgt_epi32(_mm256_srli_epi32(s, 24), limit);
+				if (_mm256_testz_si256(mask, mask))
+				{
+					continue;
+				}
+				if (swapRB)
+				{
+					s = _mm256_shuffle_epi8(s, swap);
+				}
+				s = _mm256_or_si256(s, opaque);
+				_mm256_maskstore_epi32(reinterpret_cast<int*>(&dst[i * 4]), mask, s);
+			}
+			alphaTestRow32SSE2(&dst[i * 4], &src[i * 4], count - i, threshold, swapRB);
+		}
+#endif
+
+		// Function pointer type for alpha tested row copies into 32 bit pixels
+		typedef void (*AlphaTestRow32Func)(unsigned char* dst, const unsigned char* src, unsigned int count, unsigned char threshold, bool swapRB);
+
+		// Returns the fastest alpha tested row copy into 32 bit pixels supported by this CPU
+		inline AlphaTestRow32Func alphaTestRow32()
+		{
+#if defined(GEB_X86)
+			if (CPU::hasAVX2())
+			{
+				return alphaTestRow32AVX2;
+			}
+			if (CPU::hasSSE2())
+			{
+				return alphaTestRow32SSE2;
+			}
+#endif
+			return alphaTestRow32Scalar;
+		}
+
+		// Copies count RGB pixels from src into the 32 bit pixels at dst. When swapRB is true the destination is BGRX
+		inline void expandRow32Scalar(unsigned char* dst, const unsigned char* src, unsigned int count, bool swapRB)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				dst[0] = swapRB ? src[2] : src[0];
+				dst[1] = src[1];
+				dst[2] = swapRB ? src[0] : src[2];
+				dst[3] = 255;
+				dst += 4;
+				src += 3;
+			}
+		}
+
+		// Copies count 32 bit pixels from src into the RGB pixels at dst. When swapRB is true the source is BGRX
+		inline void packRow24Scalar(unsigned char* dst, const unsigned char* src, unsigned int count, bool swapRB)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				dst[0] = swapRB ? src[2] : src[0];
+				dst[1] = src[1];
+				dst[2] = swapRB ? src[0] : src[2];
+				dst += 3;
+				src += 4;
+			}
+		}
+
+		// Swaps the red and blue bytes of count pixels in place. channels is 3 or 4
+		inline void swapRedBlueRowScalar(unsigned char* row, unsigned int count, unsigned int channels)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				unsigned char r = row[0];
+				row[0] = row[2];
+				row[2] = r;
+				row += channels;
+			}
+		}
+
+		// Multiplies the colour of count RGBA pixels by their alpha in place, rounding to nearest
+		inline void premultiplyRowScalar(unsigned char* row, unsigned int count)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				unsigned int a = row[3];
+				for (unsigned int c = 0; c < 3; c++)
+				{
+					unsigned int t = (row[c] * a) + 128;
+					row[c] = static_cast<unsigned char>((t + (t >> 8)) >> 8);
+				}
+				row += 4;
+			}
+		}
+
+		// Divides the colour of count premultiplied RGBA pixels by their alpha in place, rounding to nearest. Pixels with zero alpha become black
+		inline void unpremultiplyRowScalar(unsigned char* row, unsigned int count)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				unsigned int a = row[3];
+				for (unsigned int c = 0; c < 3; c++)
+				{
+					row[c] = a == 0 ? 0 : static_cast<unsigned char>(std::min(255u, ((row[c] * 255u) + (a / 2)) / a));
+				}
+				row += 4;
+			}
+		}
+
+		// Writes the BT.601 luminance (77 R + 150 G + 29 B) / 256 of count RGB or RGBA pixels to dst, one byte per pixel
+		inline void luminanceRowScalar(unsigned char* dst, const unsigned char* src, unsigned int count, unsigned int channels)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				dst[i] = static_cast<unsigned char>(((77 * src[0]) + (150 * src[1]) + (29 * src[2]) + 128) >> 8);
+				src += channels;
+			}
+		}
+
+#if defined(GEB_X86)
+		// SSSE3 version of expandRow32Scalar. Handles 4 pixels per step with one shuffle
+		GEB_TARGET_SSSE3 inline void expandRow32SSSE3(unsigned char* dst, const unsigned char* src, unsigned int count, bool swapRB)
+		{
+			const __m128i order = swapRB ? _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1) : _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+			const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+			unsigned int i = 0;
+			// Each step reads 16 bytes, so stop while the read stays within the row
+			for (; i + 6 <= count; i += 4)
+			{
+				__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i * 3]));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i * 4]), _mm_or_si128(_mm_shuffle_epi8(s, order), alpha));
+			}
+			expandRow32Scalar(&dst[i * 4], &src[i * 3], count - i, swapRB);
+		}
+
+		// AVX2 version of expandRow32Scalar. Handles 8 pixels per step, loading 4 into each lane
+		GEB_TARGET_AVX2 inline void expandRow32AVX2(unsigned char* dst, const unsigned char* src, unsigned int count, bool swapRB)
+		{
+			const __m256i order = swapRB ? _mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+				: _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+			const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+			unsigned int i = 0;
+			for (; i + 10 <= count; i += 8)
+			{
+				__m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i * 3]));
+				__m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[(i + 4) * 3]));
+				__m256i s = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i * 4]), _mm256_or_si256(_mm256_shuffle_epi8(s, order), alpha));
+			}
+			expandRow32SSSE3(&dst[i * 4], &src[i * 3], count - i, swapRB);
+		}
+
+		// SSSE3 version of packRow24Scalar. Handles 4 pixels per step
+		GEB_TARGET_SSSE3 inline void packRow24SSSE3(unsigned char* dst, const unsigned char* src, unsigned int count, bool swapRB)
+		{
+			const __m128i order = swapRB ? _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1) : _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+			unsigned int i = 0;
+			// Each step writes 16 bytes, so stop while the write stays within the row
+			for (; i + 6 <= count; i += 4)
+			{
+				__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i * 4]));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i * 3]), _mm_shuffle_epi8(s, order));
+			}
+			packRow24Scalar(&dst[i * 3], &src[i * 4], count - i, swapRB);
+		}
+
+		// AVX2 version of packRow24Scalar. Handles 8 pixels per step, joining the packed bytes of both lanes
+		GEB_TARGET_AVX2 inline void packRow24AVX2(unsigned char* dst, const unsigned char* src, unsigned int count, bool swapRB)
+		{
+			const __m256i order = swapRB ? _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+				: _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1, 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+			const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+			unsigned int i = 0;
+			for (; i + 11 <= count; i += 8)
+			{
+				__m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i * 4]));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i * 3]), _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(s, order), join));
+			}
+			packRow24SSSE3(&dst[i * 3], &src[i * 4], count - i, swapRB);
+		}
+
+		// SSSE3 version of swapRedBlueRowScalar. RGB rows are done 16 pixels per step as three vectors, with extra shuffles for the pixels that straddle them
+		GEB_TARGET_SSSE3 inline void swapRedBlueRowSSSE3(unsigned char* row, unsigned int count, unsigned int channels)
+		{
+			unsigned int i = 0;
+			if (channels == 4)
+			{
+				const __m128i order = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+				for (; i + 4 <= count; i += 4)
+				{
+					__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&row[i * 4]));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(&row[i * 4]), _mm_shuffle_epi8(s, order));
+				}
+			} else
+			{
+				const __m128i order0 = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, -1);
+				const __m128i order1 = _mm_setr_epi8(0, -1, 4, 3, 2, 7, 6, 5, 10, 9, 8, 13, 12, 11, -1, 15);
+				const __m128i order2 = _mm_setr_epi8(-1, 3, 2, 1, 6, 5, 4, 9, 8, 7, 12, 11, 10, 15, 14, 13);
+				const __m128i from1To0 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1);
+				const __m128i from0To1 = _mm_setr_epi8(-1, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+				const __m128i from2To1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, -1);
+				const __m128i from1To2 = _mm_setr_epi8(14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+				for (; i + 16 <= count; i += 16)
+				{
+					__m128i* p = reinterpret_cast<__m128i*>(&row[i * 3]);
+					__m128i a = _mm_loadu_si128(p);
+					__m128i b = _mm_loadu_si128(p + 1);
+					__m128i c = _mm_loadu_si128(p + 2);
+					_mm_storeu_si128(p, _mm_or_si128(_mm_shuffle_epi8(a, order0), _mm_shuffle_epi8(b, from1To0)));
+					_mm_storeu_si128(p + 1, _mm_or_si128(_mm_shuffle_epi8(b, order1), _mm_or_si128(_mm_shuffle_epi8(a, from0To1), _mm_shuffle_epi8(c, from2To1))));
+					_mm_storeu_si128(p + 2, _mm_or_si128(_mm_shuffle_epi8(c, order2), _mm_shuffle_epi8(b, from1To2)));
+				}
+			}
+			swapRedBlueRowScalar(&row[i * channels], count - i, channels);
+		}
+
+		// AVX2 version of swapRedBlueRowScalar. RGB rows are left to the SSSE3 version, which already runs at memory speed
+		GEB_TARGET_AVX2 inline void swapRedBlueRowAVX2(unsigned char* row, unsigned int count, unsigned int channels)
+		{
+			unsigned int i = 0;
+			if (channels == 4)
+			{
+				const __m256i order = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+				for (; i + 8 <= count; i += 8)
+				{
+					__m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&row[i * 4]));
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(&row[i * 4]), _mm256_shuffle_epi8(s, order));
+				}
+			}
+			swapRedBlueRowSSSE3(&row[i * channels], count - i, channels);
+		}
+
+		// SSSE3 version of premultiplyRowScalar. Handles 4 pixels per step in 16 bit lanes
+		GEB_TARGET_SSSE3 inline void premultiplyRowSSSE3(unsigned char* row, unsigned int count)
+		{
+			const __m128i spread = _mm_setr_epi8(6, -1, 6, -1, 6, -1, -1, -1, 14, -1, 14, -1, 14, -1, -1, -1);
+			const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+			const __m128i bias = _mm_set1_epi16(128);
+			const __m128i zero = _mm_setzero_si128();
+			unsigned int i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&row[i * 4]));
+				__m128i lo = _mm_unpacklo_epi8(s, zero);
+				__m128i hi = _mm_unpackhi_epi8(s, zero);
+				// c * a + 128 peaks at 65153, so the divide by 255 below stays within 16 bits. Alpha is copied back from the source
+				__m128i tlo = _mm_add_epi16(_mm_mullo_epi16(lo, _mm_shuffle_epi8(lo, spread)), bias);
+				__m128i thi = _mm_add_epi16(_mm_mullo_epi16(hi, _mm_shuffle_epi8(hi, spread)), bias);
+				tlo = _mm_srli_epi16(_mm_add_epi16(tlo, _mm_srli_epi16(tlo, 8)), 8);
+				thi = _mm_srli_epi16(_mm_add_epi16(thi, _mm_srli_epi16(thi, 8)), 8);
+				__m128i d = _mm_or_si128(_mm_packus_epi16(tlo, thi), _mm_and_si128(s, alphaMask));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&row[i * 4]), d);
+			}
+			premultiplyRowScalar(&row[i * 4], count - i);
+		}
+
+		// AVX2 version of premultiplyRowScalar. Handles 8 pixels per step
+		GEB_TARGET_AVX2 inline void premultiplyRowAVX2(unsigned char* row, unsigned int count)
+		{
+			const __m256i spread = _mm256_setr_epi8(6, -1, 6, -1, 6, -1, -1, -1, 14, -1, 14, -1, 14, -1, -1, -1, 6, -1, 6, -1, 6, -1, -1, -1, 14, -1, 14, -1, 14, -1, -1, -1);
+			const __m256i alphaMask = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+			const __m256i bias = _mm256_set1_epi16(128);
+			const __m256i zero = _mm256_setzero_si256();
+			unsigned int i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				__m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&row[i * 4]));
+				__m256i lo = _mm256_unpacklo_epi8(s, zero);
+				__m256i hi = _mm256_unpackhi_epi8(s, zero);
+				__m256i tlo = _mm256_add_epi16(_mm256_mullo_epi16(lo, _mm256_shuffle_epi8(lo, spread)), bias);
+				__m256i thi = _mm256_add_epi16(_mm256_mullo_epi16(hi, _mm256_shuffle_epi8(hi, spread)), bias);
+				tlo = _mm256_srli_epi16(_mm256_add_epi16(tlo, _mm256_srli_epi16(tlo, 8)), 8);
+				thi = _mm256_srli_epi16(_mm256_add_epi16(thi, _mm256_srli_epi16(thi, 8)), 8);
+				__m256i d = _mm256_or_si256(_mm256_packus_epi16(tlo, thi), _mm256_and_si256(s, alphaMask));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(&row[i * 4]), d);
+			}
+			premultiplyRowSSSE3(&row[i * 4], count - i);
+		}
+
+		// SSE2 version of unpremultiplyRowScalar. Divides in single precision, which is exact for every result below 256
+		GEB_TARGET_SSE2 inline void unpremultiplyRowSSE2(unsigned char* row, unsigned int count)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+			unsigned int i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&row[i * 4]));
+				__m128i lo = _mm_unpacklo_epi8(s, zero);
+				__m128i hi = _mm_unpackhi_epi8(s, zero);
+				__m128i result[2];
+				for (unsigned int half = 0; half < 2; half++)
+				{
+					__m128i words = half == 0 ? lo : hi;
+					__m128i p0 = _mm_unpacklo_epi16(words, zero);
+					__m128i p1 = _mm_unpackhi_epi16(words, zero);
+					// Per pixel: (c * 255 + a / 2) / a, with alpha itself divided by 1 so it passes through
+					__m128i a0 = _mm_shuffle_epi32(_mm_srli_si128(p0, 12), 0);
+					__m128i a1 = _mm_shuffle_epi32(_mm_srli_si128(p1, 12), 0);
+					__m128i n0 = _mm_add_epi32(_mm_sub_epi32(_mm_slli_epi32(p0, 8), p0), _mm_srli_epi32(a0, 1));
+					__m128i n1 = _mm_add_epi32(_mm_sub_epi32(_mm_slli_epi32(p1, 8), p1), _mm_srli_epi32(a1, 1));
+					__m128 q0 = _mm_div_ps(_mm_cvtepi32_ps(n0), _mm_max_ps(_mm_cvtepi32_ps(a0), _mm_set1_ps(1.0f)));
+					__m128 q1 = _mm_div_ps(_mm_cvtepi32_ps(n1), _mm_max_ps(_mm_cvtepi32_ps(a1), _mm_set1_ps(1.0f)));
+					__m128i r0 = _mm_cvttps_epi32(_mm_min_ps(q0, _mm_set1_ps(255.0f)));
+					__m128i r1 = _mm_cvttps_epi32(_mm_min_ps(q1, _mm_set1_ps(255.0f)));
+					// Zero alpha gives black
+					r0 = _mm_andnot_si128(_mm_cmpeq_epi32(a0, zero), r0);
+					r1 = _mm_andnot_si128(_mm_cmpeq_epi32(a1, zero), r1);
+					result[half] = _mm_packs_epi32(r0, r1);
+				}
+				__m128i d = _mm_packus_epi16(result[0], result[1]);
+				d = _mm_or_si128(_mm_andnot_si128(alphaMask, d), _mm_and_si128(alphaMask, s));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&row[i * 4]), d);
+			}
+			unpremultiplyRowScalar(&row[i * 4], count - i);
+		}
+
+		// AVX2 version of unpremultiplyRowScalar. Handles 8 pixels per step, one per 32 bit lane group
+		GEB_TARGET_AVX2 inline void unpremultiplyRowAVX2(unsigned char* row, unsigned int count)
+		{
+			const __m256i alphaMask = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+			const __m256i byteMask = _mm256_set1_epi32(0xFF);
+			const __m256i zero = _mm256_setzero_si256();
+			unsigned int i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				__m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&row[i * 4]));
+				__m256i a = _mm256_srli_epi32(s, 24);
+				__m256 divisor = _mm256_max_ps(_mm256_cvtepi32_ps(a), _mm256_set1_ps(1.0f));
+				__m256i half = _mm256_srli_epi32(a, 1);
+				__m256i d = _mm256_and_si256(s, alphaMask);
+				for (int c = 0; c < 3; c++)
+				{
+					__m256i v = _mm256_and_si256(_mm256_srli_epi32(s, c * 8), byteMask);
+					__m256i n = _mm256_add_epi32(_mm256_sub_epi32(_mm256_slli_epi32(v, 8), v), half);
+					__m256i q = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_div_ps(_mm256_cvtepi32_ps(n), divisor), _mm256_set1_ps(255.0f)));
+					d = _mm256_or_si256(d, _mm256_slli_epi32(q, c * 8));
+				}
+				// Zero alpha gives black
+				d = _mm256_andnot_si256(_mm256_andnot_si256(alphaMask, _mm256_cmpeq_epi32(a, zero)), d);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(&row[i * 4]), d);
+			}
+			unpremultiplyRowSSE2(&row[i * 4], count - i);
+		}
+
+		// SSSE3 version of luminanceRowScalar. Handles 4 pixels per step, spreading RGB pixels to 4 bytes first
+		GEB_TARGET_SSSE3 inline void luminanceRowSSSE3(unsigned char* dst, const unsigned char* src, unsigned int count, unsigned int channels)
+		{
+			const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+			const __m128i weights = _mm_setr_epi16(77, 150, 29, 0, 77, 150, 29, 0);
+			const __m128i bias = _mm_set1_epi32(128);
+			const __m128i zero = _mm_setzero_si128();
+			unsigned int i = 0;
+			// RGB steps read 16 bytes for 12, so stop while the read stays within the row
+			unsigned int margin = channels == 4 ? 4 : 6;
+			for (; i + margin <= count; i += 4)
+			{
+				__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i * channels]));
+				if (channels == 3)
+				{
+					s = _mm_shuffle_epi8(s, spread);
+				}
+				__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(s, zero), weights);
+				__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(s, zero), weights);
+				__m128i y = _mm_srli_epi32(_mm_add_epi32(_mm_hadd_epi32(lo, hi), bias), 8);
+				y = _mm_packs_epi32(y, y);
+				y = _mm_packus_epi16(y, y);
+				int value = _mm_cvtsi128_si32(y);
+				memcpy(&dst[i], &value, 4);
+			}
+			luminanceRowScalar(&dst[i], &src[i * channels], count - i, channels);
+		}
+
+		// AVX2 version of luminanceRowScalar. Handles 8 pixels per step, 4 in each lane
+		GEB_TARGET_AVX2 inline void luminanceRowAVX2(unsigned char* dst, const unsigned char* src, unsigned int count, unsigned int channels)
+		{
+			const __m256i spread = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+			const __m256i weights = _mm256_setr_epi16(77, 150, 29, 0, 77, 150, 29, 0, 77, 150, 29, 0, 77, 150, 29, 0);
+			const __m256i bias = _mm256_set1_epi32(128);
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i join = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+			unsigned int i = 0;
+			unsigned int margin = channels == 4 ? 8 : 10;
+			for (; i + margin <= count; i += 8)
+			{
+				__m256i s;
+				if (channels == 4)
+				{
+					s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i * 4]));
+				} else
+				{
+					__m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i * 3]));
+					__m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[(i + 4) * 3]));
+					s = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), spread);
+				}
+				__m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(s, zero), weights);
+				__m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(s, zero), weights);
+				__m256i y = _mm256_srli_epi32(_mm256_add_epi32(_mm256_hadd_epi32(lo, hi), bias), 8);
+				y = _mm256_packs_epi32(y, y);
+				y = _mm256_packus_epi16(y, y);
+				y = _mm256_permutevar8x32_epi32(y, join);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(&dst[i]), _mm256_castsi256_si128(y));
+			}
+			luminanceRowSSSE3(&dst[i], &src[i * channels], count - i, channels);
+		}
+#endif
+
+		// Function pointer types for the pixel format conversions
+		typedef void (*ConvertRowFunc)(unsigned char* dst, const unsigned char* src, unsigned int count, bool swapRB);
+		typedef void (*SwapRedBlueRowFunc)(unsigned char* row, unsigned int count, unsigned int channels);
+		typedef void (*AlphaRowFunc)(unsigned char* row, unsigned int count);
+		typedef void (*LuminanceRowFunc)(unsigned char* dst, const unsigned char* src, unsigned int count, unsigned int channels);
+
+		// Returns the fastest RGB to 32 bit row conversion supported by this CPU
+		inline ConvertRowFunc expandRow32()
+		{
+#if defined(GEB_X86)
+			if (CPU::hasAVX2())
+			{
+				return expandRow32AVX2;
+			}
+			if (CPU::hasSSSE3())
+			{
+				return expandRow32SSSE3;
+			}
+#endif
+			return expandRow32Scalar;
+		}
+
+		// Returns the fastest 32 bit to RGB row conversion supported by this CPU
+		inline ConvertRowFunc packRow24()
+		{
+#if defined(GEB_X86)
+			if (CPU::hasAVX2())
+			{
+				return packRow24AVX2;
+			}
+			if (CPU::hasSSSE3())
+			{
+				return packRow24SSSE3;
+			}
+#endif
+			return packRow24Scalar;
+		}
+
+		// Returns the fastest red and blue swap supported by this CPU
+		inline SwapRedBlueRowFunc swapRedBlueRow()
+		{
+#if defined(GEB_X86)
+			if (CPU::hasAVX2())
+			{
+				return swapRedBlueRowAVX2;
+			}
+			if (CPU::hasSSSE3())
+			{
+				return swapRedBlueRowSSSE3;
+			}
+#endif
+			return swapRedBlueRowScalar;
+		}
+
+		// Returns the fastest alpha premultiply supported by this CPU
+		inline AlphaRowFunc premultiplyRow()
+		{
+#if defined(GEB_X86)
+			if (CPU::hasAVX2())
+			{
+				return premultiplyRowAVX2;
+			}
+			if (CPU::hasSSSE3())
+			{
+				return premultiplyRowSSSE3;
+			}
+#endif
+			return premultiplyRowScalar;
+		}
+
+		// Returns the fastest alpha unpremultiply supported by this CPU
+		inline AlphaRowFunc unpremultiplyRow()
+		{
+#if defined(GEB_X86)
+			if (CPU::hasAVX2())
+			{
+				return unpremultiplyRowAVX2;
+			}
+			if (CPU::hasSSE2())
+			{
+				return unpremultiplyRowSSE2;
+			}
+#endif
+			return unpremultiplyRowScalar;
+		}
+
+		// Returns the fastest luminance conversion supported by this CPU
+		inline LuminanceRowFunc luminanceRow()
+		{
+#if defined(GEB_X86)
+			if (CPU::hasAVX2())
+			{
+				return luminanceRowAVX2;
+			}
+			if (CPU::hasSSSE3())
+			{
+				return luminanceRowSSSE3;
+			}
+#endif
+			return luminanceRowScalar;
+		}
+
+		// Reads the texel at index from an RGB or RGBA image as a 32 bit RGBA value. RGB texels are given an alpha of 255
+		inline uint32_t fetchTexel(const unsigned char* src, unsigned int index, unsigned int channels)
+		{
+			uint32_t texel;
+			if (channels == 4)
+			{
+				memcpy(&texel, &src[index * 4], 4);
+				return texel;
+			}
+			const unsigned char* p = &src[index * 3];
+			return p[0] | (p[1] << 8) | (p[2] << 16) | 0xFF000000u;
+		}
+
+		// Samples count texels of an RGB or RGBA image along a line, writing them to dst as RGBA
+		// (u, v) is the position of the first sample and (du, dv) the step between samples, all in 16.16 fixed point. Every sample must lie inside the image
+		inline void sampleNearestRowScalar(unsigned char* dst, const unsigned char* src, unsigned int srcWidth, unsigned int srcHeight, unsigned int channels, int u, int v, int du, int dv, unsigned int count)
+		{
+			(void)srcHeight;
+			for (unsigned int i = 0; i < count; i++)
+			{
+				uint32_t texel = fetchTexel(src, ((v >> 16) * srcWidth) + (u >> 16), channels);
+				memcpy(&dst[i * 4], &texel, 4);
+				u += du;
+				v += dv;
+			}
+		}
+
+		// Bilinear version of sampleNearestRowScalar. Texels outside the image are clamped to the edge
+		// Weights use 8 bits of the fraction, with results rounded at each step
+		inline void sampleBilinearRowScalar(unsigned char* dst, const unsigned char* src, unsigned int srcWidth, unsigned int srcHeight, unsigned int channels, int u, int v, int du, int dv, unsigned int count)
+		{
+			int maxX = static_cast<int>(srcWidth) - 1;
+			int maxY = static_cast<int>(srcHeight) - 1;
+			for (unsigned int i = 0; i < count; i++)
+			{
+				// Texel centres are at half coordinates, so step back half a texel to find the top left texel
+				int su = u - 32768;
+				int sv = v - 32768;
+				int fx = (su >> 8) & 255;
+				int fy = (sv >> 8) & 255;
+				int x0 = std::min(std::max(su >> 16, 0), maxX);
+				int x1 = std::min(std::max((su >> 16) + 1, 0), maxX);
+				int y0 = std::min(std::max(sv >> 16, 0), maxY);
+				int y1 = std::min(std::max((sv >> 16) + 1, 0), maxY);
+				uint32_t t00 = fetchTexel(src, (y0 * srcWidth) + x0, channels);
+				uint32_t t01 = fetchTexel(src, (y0 * srcWidth) + x1, channels);
+				uint32_t t10 = fetchTexel(src, (y1 * srcWidth) + x0, channels);
+				uint32_t t11 = fetchTexel(src, (y1 * srcWidth) + x1, channels);
+				for (int c = 0; c < 4; c++)
+				{
+					int shift = c * 8;
+					int c0 = ((((t00 >> shift) & 255) * (256 - fy)) + (((t10 >> shift) & 255) * fy) + 128) >> 8;
+					int c1 = ((((t01 >> shift) & 255) * (256 - fy)) + (((t11 >> shift) & 255) * fy) + 128) >> 8;
+					dst[(i * 4) + c] = static_cast<unsigned char>(((c0 * (256 - fx)) + (c1 * fx) + 128) >> 8);
+				}
+				u += du;
+				v += dv;
+			}
+		}
+
+#if defined(GEB_X86)
+		// SSE2 version of sampleBilinearRowScalar. The four channels of a sample are filtered together, using multiply-add for each pair of texels
+		GEB_TARGET_SSE2 inline void sampleBilinearRowSSE2(unsigned char* dst, const unsigned char* src, unsigned int srcWidth, unsigned int srcHeight, unsigned int channels, int u, int v, int du, int dv, unsigned int count)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i half = _mm_set1_epi32(128);
+			int maxX = static_cast<int>(srcWidth) - 1;
+			int maxY = static_cast<int>(srcHeight) - 1;
+			for (unsigned int i = 0; i < count; i++)
+			{
+				int su = u - 32768;
+				int sv = v - 32768;
+				int fx = (su >> 8) & 255;
+				int fy = (sv >> 8) & 255;
+				int x0 = std::min(std::max(su >> 16, 0), maxX);
+				int x1 = std::min(std::max((su >> 16) + 1, 0), maxX);
+				int y0 = std::min(std::max(sv >> 16, 0), maxY);
+				int y1 = std::min(std::max((sv >> 16) + 1, 0), maxY);
+				__m128i top = _mm_unpacklo_epi32(_mm_cvtsi32_si128(static_cast<int>(fetchTexel(src, (y0 * srcWidth) + x0, channels))),
+					_mm_cvtsi32_si128(static_cast<int>(fetchTexel(src, (y0 * srcWidth) + x1, channels))));
+				__m128i bottom = _mm_unpacklo_epi32(_mm_cvtsi32_si128(static_cast<int>(fetchTexel(src, (y1 * srcWidth) + x0, channels))),
+					_mm_cvtsi32_si128(static_cast<int>(fetchTexel(src, (y1 * srcWidth) + x1, channels))));
+				top = _mm_unpacklo_epi8(top, zero);
+				bottom = _mm_unpacklo_epi8(bottom, zero);
+
+				// Filter vertically. Interleaving top and bottom pairs each channel with its weight
+				__m128i wy = _mm_set1_epi32((fy << 16) | (256 - fy));
+				__m128i left = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(top, bottom), wy), half), 8);
+				__m128i right = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(top, bottom), wy), half), 8);
+
+				// Filter horizontally
+				__m128i wx = _mm_set1_epi32((fx << 16) | (256 - fx));
+				__m128i p = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_or_si128(left, _mm_slli_epi32(right, 16)), wx), half), 8);
+				p = _mm_packs_epi32(p, p);
+				p = _mm_packus_epi16(p, p);
+				int texel = _mm_cvtsi128_si32(p);
+				memcpy(&dst[i * 4], &texel, 4);
+				u += du;
+				v += dv;
+			}
+		}
+
+		// AVX2 version of sampleNearestRowScalar for RGBA images. Gathers 8 texels per step
+		GEB_TARGET_AVX2 inline void sampleNearestRowAVX2(unsigned char* dst, const unsigned char* src, unsigned int srcWidth, unsigned int srcHeight, unsigned int channels, int u, int v, int du, int dv, unsigned int count)
+		{
+			if (channels != 4)
+			{
+				// Gathering 4 bytes per RGB texel could read past the end of the image
+				sampleNearestRowScalar(dst, src, srcWidth, srcHeight, channels, u, v, du, dv, count);
+				return;
+			}
+			const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+			const __m256i stride = _mm256_set1_epi32(static_cast<int>(srcWidth));
+			const __m256i stepU = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(du) * 8u));
+			const __m256i stepV = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(dv) * 8u));
+			__m256i uu = _mm256_add_epi32(_mm256_set1_epi32(u), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(du)));
+			__m256i vv = _mm256_add_epi32(_mm256_set1_epi32(v), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(dv)));
+			unsigned int i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				__m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(vv, 16), stride), _mm256_srli_epi32(uu, 16));
+				__m256i texels = _mm256_i32gather_epi32(reinterpret_cast<const int*>(src), index, 4);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i * 4]), texels);
+				uu = _mm256_add_epi32(uu, stepU);
+				vv = _mm256_add_epi32(vv, stepV);
+			}
+			if (i < count)
+			{
+				sampleNearestRowScalar(&dst[i * 4], src, srcWidth, srcHeight, channels, u + (static_cast<int>(i) * du), v + (static_cast<int>(i) * dv), du, dv, count - i);
+			}
+		}
+
+		// Blends 16 bit channels a and b with weights (256 - w) and w, rounding the result
+		GEB_TARGET_AVX2 inline __m256i lerpChannelsAVX2(__m256i a, __m256i b, __m256i w)
+		{
+			const __m256i full = _mm256_set1_epi16(256);
+			const __m256i half = _mm256_set1_epi16(128);
+			__m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(a, _mm256_sub_epi16(full, w)), _mm256_mullo_epi16(b, w));
+			return _mm256_srli_epi16(_mm256_add_epi16(sum, half), 8);
+		}
+
+		// AVX2 version of sampleBilinearRowScalar for RGBA images. Gathers the four texels of 8 samples per step and filters them with 16 bit arithmetic
+		GEB_TARGET_AVX2 inline void sampleBilinearRowAVX2(unsigned char* dst, const unsigned char* src, unsigned int srcWidth, unsigned int srcHeight, unsigned int channels, int u, int v, int du, int dv, unsigned int count)
+		{
+			if (channels != 4)
+			{
+				sampleBilinearRowSSE2(dst, src, srcWidth, srcHeight, channels, u, v, du, dv, count);
+				return;
+			}
+			const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i one = _mm256_set1_epi32(1);
+			const __m256i fraction = _mm256_set1_epi32(255);
+			const __m256i maxX = _mm256_set1_epi32(static_cast<int>(srcWidth) - 1);
+			const __m256i maxY = _mm256_set1_epi32(static_cast<int>(srcHeight) - 1);
+			const __m256i stride = _mm256_set1_epi32(static_cast<int>(srcWidth));
+			const __m256i stepU = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(du) * 8u));
+			const __m256i stepV = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(dv) * 8u));
+			__m256i uu = _mm256_add_epi32(_mm256_set1_epi32(u - 32768), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(du)));
+			__m256i vv = _mm256_add_epi32(_mm256_set1_epi32(v - 32768), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(dv)));
+			unsigned int i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				__m256i ix = _mm256_srai_epi32(uu, 16);
+				__m256i iy = _mm256_srai_epi32(vv, 16);
+				__m256i x0 = _mm256_min_epi32(_mm256_max_epi32(ix, zero), maxX);
+				__m256i x1 = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(ix, one), zero), maxX);
+				__m256i row0 = _mm256_mullo_epi32(_mm256_min_epi32(_mm256_max_epi32(iy, zero), maxY), stride);
+				__m256i row1 = _mm256_mullo_epi32(_mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(iy, one), zero), maxY), stride);
+				const int* texels = reinterpret_cast<const int*>(src);
+				__m256i t00 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row0, x0), 4);
+				__m256i t01 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row0, x1), 4);
+				__m256i t10 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row1, x0), 4);
+				__m256i t11 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row1, x1), 4);
+
+				// Copy each sample's weights to its four 16 bit channels. Unpacking works within 128 bit halves, matching the texel unpacks below
+				__m256i fx = _mm256_and_si256(_mm256_srli_epi32(uu, 8), fraction);
+				__m256i fy = _mm256_and_si256(_mm256_srli_epi32(vv, 8), fraction);
+				fx = _mm256_or_si256(fx, _mm256_slli_epi32(fx, 16));
+				fy = _mm256_or_si256(fy, _mm256_slli_epi32(fy, 16));
+				__m256i fxLo = _mm256_unpacklo_epi32(fx, fx);
+				__m256i fxHi = _mm256_unpackhi_epi32(fx, fx);
+				__m256i fyLo = _mm256_unpacklo_epi32(fy, fy);
+				__m256i fyHi = _mm256_unpackhi_epi32(fy, fy);
+
+				__m256i lo = lerpChannelsAVX2(lerpChannelsAVX2(_mm256_unpacklo_epi8(t00, zero), _mm256_unpacklo_epi8(t10, zero), fyLo),
+					lerpChannelsAVX2(_mm256_unpacklo_epi8(t01, zero), _mm256_unpacklo_epi8(t11, zero), fyLo), fxLo);
+				__m256i hi = lerpChannelsAVX2(lerpChannelsAVX2(_mm256_unpackhi_epi8(t00, zero), _mm256_unpackhi_epi8(t10, zero), fyHi),
+					lerpChannelsAVX2(_mm256_unpackhi_epi8(t01, zero), _mm256_unpackhi_epi8(t11, zero), fyHi), fxHi);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i * 4]), _mm256_packus_epi16(lo, hi));
+				uu = _mm256_add_epi32(uu, stepU);
+				vv = _mm256_add_epi32(vv, stepV);
+			}
+			if (i < count)
+			{
+				sampleBilinearRowSSE2(&dst[i * 4], src, srcWidth, srcHeight, channels, u + (static_cast<int>(i) * du), v + (static_cast<int>(i) * dv), du, dv, count - i);
+			}
+		}
+#endif
+
+		// Function pointer type for sampling a line of texels
+		typedef void (*SampleRowFunc)(unsigned char* dst, const unsigned char* src, unsigned int srcWidth, unsigned int srcHeight, unsigned int channels, int u, int v, int du, int dv, unsigned int count);
+
+		// Returns the fastest sampler for the given mode supported by this CPU
+		inline SampleRowFunc sampleRow(SampleMode mode)
+		{
+			if (mode == SampleBilinear)
+			{
+#if defined(GEB_X86)
+				if (CPU::hasAVX2())
+				{
+					return sampleBilinearRowAVX2;
+				}
+				if (CPU::hasSSE2())
+				{
+					return sampleBilinearRowSSE2;
+				}
+#endif
+				return sampleBilinearRowScalar;
+			}
+#if defined(GEB_X86)
+			if (CPU::hasAVX2())
+			{
+				return sampleNearestRowAVX2;
+			}
+#endif
+			return sampleNearestRowScalar;
+		}
+
+		// Blends count RGBA pixels from src over the RGB pixels at dst using the source alpha
+		inline void blendRowScalar(unsigned char* dst, const unsigned char* src, unsigned int count)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				unsigned int a = src[3];
+				for (int c = 0; c < 3; c++)
+				{
+					// Divide by 255 with rounding
+					unsigned int x = (src[c] * a) + (dst[c] * (255 - a)) + 128;
+					dst[c] = static_cast<unsigned char>((x + (x >> 8)) >> 8);
+				}
+				dst += 3;
+				src += 4;
+			}
+		}
+
+		// Blends count RGBA pixels from src over the 32 bit pixels at dst. When swapRB is true the destination is BGRX
+		inline void blendRow32Scalar(unsigned char* dst, const unsigned char* src, unsigned int count, bool swapRB)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				unsigned int a = src[3];
+				for (int c = 0; c < 3; c++)
+				{
+					unsigned int s = src[swapRB ? 2 - c : c];
+					unsigned int x = (s * a) + (dst[c] * (255 - a)) + 128;
+					dst[c] = static_cast<unsigned char>((x + (x >> 8)) >> 8);
+				}
+				dst[3] = 255;
+				dst += 4;
+				src += 4;
+			}
+		}
+
+#if defined(GEB_X86)
+		// SSE2 version of blendRow32Scalar. Handles 4 pixels per step with 16 bit arithmetic
+		GEB_TARGET_SSE2 inline void blendRow32SSE2(unsigned char* dst, const unsigned char* src, unsigned int count, bool swapRB)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i full = _mm_set1_epi16(255);
+			const __m128i half = _mm_set1_epi16(128);
+			const __m128i opaque = _mm_set1_epi32(static_cast<int>(0xFF000000));
+			const __m128i redBlue = _mm_set1_epi32(0x00FF00FF);
+			const __m128i greenAlpha = _mm_set1_epi32(static_cast<int>(0xFF00FF00));
+			unsigned int i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i * 4]));
+				if (swapRB)
+				{
+					__m128i rb = _mm_and_si128(s, redBlue);
+					s = _mm_or_si128(_mm_and_si128(s, greenAlpha), _mm_or_si128(_mm_srli_epi32(rb, 16), _mm_slli_epi32(rb, 16)));
+				}
+				__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dst[i * 4]));
+
+				// Copy each pixel's alpha to all four of its 16 bit channels
+				__m128i a = _mm_srli_epi32(s, 24);
+				a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+				__m128i aLo = _mm_unpacklo_epi32(a, a);
+				__m128i aHi = _mm_unpackhi_epi32(a, a);
+
+				__m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), aLo), _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(full, aLo))), half);
+				__m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), aHi), _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(full, aHi))), half);
+				lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+				hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+				__m128i out = _mm_or_si128(_mm_packus_epi16(lo, hi), opaque);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i * 4]), out);
+			}
+			blendRow32Scalar(&dst[i * 4], &src[i * 4], count - i, swapRB);
+		}
+#endif
+
+		// Function pointer type for blending rows into 32 bit pixels
+		typedef void (*BlendRow32Func)(unsigned char* dst, const unsigned char* src, unsigned int count, bool swapRB);
+
+		// Returns the fastest blend into 32 bit pixels supported by this CPU
+		inline BlendRow32Func blendRow32()
+		{
+#if defined(GEB_X86)
+			if (CPU::hasSSE2())
+			{
+				return blendRow32SSE2;
+			}
+#endif
+			return blendRow32Scalar;
+		}
+
+		// Advances count particles by dt seconds. Velocities gain (ax, ay) first and positions then move by the new velocity
+		// ax and ay are the accelerations already multiplied by dt
+		inline void particleStepScalar(float* x, float* y, float* vx, float* vy, float* life, unsigned int count, float dt, float ax, float ay)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				vx[i] = vx[i] + ax;
+				vy[i] = vy[i] + ay;
+				x[i] = x[i] + (vx[i] * dt);
+				y[i] = y[i] + (vy[i] * dt);
+				life[i] = life[i] - dt;
+			}
+		}
+
+#if defined(GEB_X86)
+		// SSE2 version of particleStepScalar, 4 particles at a time
+		GEB_TARGET_SSE2 inline void particleStepSSE2(float* x, float* y, float* vx, float* vy, float* life, unsigned int count, float dt, float ax, float ay)
+		{
+			__m128 t = _mm_set1_ps(dt);
+			__m128 accelX = _mm_set1_ps(ax);
+			__m128 accelY = _mm_set1_ps(ay);
+			unsigned int i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128 velX = _mm_add_ps(_mm_loadu_ps(&vx[i]), accelX);
+				__m128 velY = _mm_add_ps(_mm_loadu_ps(&vy[i]), accelY);
+				_mm_storeu_ps(&vx[i], velX);
+				_mm_storeu_ps(&vy[i], velY);
+				_mm_storeu_ps(&x[i], _mm_add_ps(_mm_loadu_ps(&x[i]), _mm_mul_ps(velX, t)));
+				_mm_storeu_ps(&y[i], _mm_add_ps(_mm_loadu_ps(&y[i]), _mm_mul_ps(velY, t)));
+				_mm_storeu_ps(&life[i], _mm_sub_ps(_mm_loadu_ps(&life[i]), t));
+			}
+			particleStepScalar(&x[i], &y[i], &vx[i], &vy[i], &life[i], count - i, dt, ax, ay);
+		}
+
+		// AVX2 version of particleStepScalar, 8 particles at a time
+		GEB_TARGET_AVX2 inline void particleStepAVX2(float* x, float* y, float* vx, float* vy, float* life, unsigned int count, float dt, float ax, float ay)
+		{
+			__m256 t = _mm256_set1_ps(dt);
+			__m256 accelX = _mm256_set1_ps(ax);
+			__m256 accelY = _mm256_set1_ps(ay);
+			unsigned int i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				__m256 velX = _mm256_add_ps(_mm256_loadu_ps(&vx[i]), accelX);
+				__m256 velY = _mm256_add_ps(_mm256_loadu_ps(&vy[i]), accelY);
+				_mm256_storeu_ps(&vx[i], velX);
+				_mm256_storeu_ps(&vy[i], velY);
+				_mm256_storeu_ps(&x[i], _mm256_add_ps(_mm256_loadu_ps(&x[i]), _mm256_mul_ps(velX, t)));
+				_mm256_storeu_ps(&y[i], _mm256_add_ps(_mm256_loadu_ps(&y[i]), _mm256_mul_ps(velY, t)));
+				_mm256_storeu_ps(&life[i], _mm256_sub_ps(_mm256_loadu_ps(&life[i]), t));
+			}
+			particleStepSSE2(&x[i], &y[i], &vx[i], &vy[i], &life[i], count - i, dt, ax, ay);
+		}
+#endif
+
+		// Function pointer type for particle updates
+		typedef void (*ParticleStepFunc)(float* x, float* y, float* vx, float* vy, float* life, unsigned int count, float dt, float ax, float ay);
+
+		// Returns the fastest particle update supported by this CPU
+		inline ParticleStepFunc particleStep()
+		{
+#if defined(GEB_X86)
+			if (CPU::hasAVX2())
+			{
+				return particleStepAVX2;
+			}
+			if (CPU::hasSSE2())
+			{
+				return particleStepSSE2;
+			}
+#endif
+			return particleStepScalar;
+		}
+
+		// Combines count RGBA sprite pixels from src with the 32 bit pixels at dst. The sprite is multiplied by tint, which holds red in the lowest byte and alpha in the highest
+		// With ParticleAdd the tinted color scaled by its alpha is added to dst, otherwise it is mixed over dst. When swapRB is true the destination is BGRX. The unused fourth byte is set to 255
+		inline void particleSpriteRow32Scalar(unsigned char* dst, const unsigned char* src, unsigned int count, uint32_t tint, ParticleBlend blend, bool swapRB)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				unsigned int c[4];
+				for (int k = 0; k < 4; k++)
+				{
+					// Multiply by the tint and divide by 255 with rounding
+					unsigned int v = (src[k] * ((tint >> (k * 8)) & 0xFF)) + 128;
+					c[k] = (v + (v >> 8)) >> 8;
+				}
+				if (swapRB)
+				{
+					std::swap(c[0], c[2]);
+				}
+				unsigned int a = c[3];
+				for (int k = 0; k < 3; k++)
+				{
+					if (blend == ParticleAdd)
+					{
+						unsigned int v = (c[k] * a) + 128;
+						dst[k] = static_cast<unsigned char>(std::min(255u, dst[k] + ((v + (v >> 8)) >> 8)));
+					} else
+					{
+						unsigned int v = (c[k] * a) + (dst[k] * (255 - a)) + 128;
+						dst[k] = static_cast<unsigned char>((v + (v >> 8)) >> 8);
+					}
+				}
+				dst[3] = 255;
+				dst += 4;
+				src += 4;
+			}
+		}
+
+#if defined(GEB_X86)
+		// Multiplies 16 bit channels in 0-255 and divides by 255 with rounding
+		GEB_TARGET_SSE2 inline __m128i mul255SSE2(__m128i a, __m128i b)
+		{
+			__m128i v = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+			return _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+		}
+
+		// Tints two RGBA pixels held as 16 bit channels and combines them with two 32 bit destination pixels
+		GEB_TARGET_SSE2 inline __m128i particleSpritePairSSE2(__m128i s, __m128i d, __m128i tint, ParticleBlend blend, bool swapRB)
+		{
+			s = mul255SSE2(s, tint);
+			if (swapRB)
+			{
+				s = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+			}
+			__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+			if (blend == ParticleAdd)
+			{
+				return _mm_adds_epu16(d, mul255SSE2(s, a));
+			}
+			__m128i v = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), a))), _mm_set1_epi16(128));
+			return _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+		}
+
+		// SSE2 version of particleSpriteRow32Scalar, 4 pixels at a time
+		GEB_TARGET_SSE2 inline void particleSpriteRow32SSE2(unsigned char* dst, const unsigned char* src, unsigned int count, uint32_t tint, ParticleBlend blend, bool swapRB)
+		{
+			__m128i zero = _mm_setzero_si128();
+			__m128i opaque = _mm_set1_epi32(static_cast<int>(0xFF000000));
+			__m128i t = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(tint)), zero);
+			unsigned int i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i * 4]));
+				__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dst[i * 4]));
+				__m128i lo = particleSpritePairSSE2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), t, blend, swapRB);
+				__m128i hi = particleSpritePairSSE2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), t, blend, swapRB);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i * 4]), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+			}
+			particleSpriteRow32Scalar(&dst[i * 4], &src[i * 4], count - i, tint, blend, swapRB);
+		}
+#endif
+
+		// Function pointer type for drawing rows of particle sprites into 32 bit pixels
+		typedef void (*ParticleSpriteRow32Func)(unsigned char* dst, const unsigned char* src, unsigned int count, uint32_t tint, ParticleBlend blend, bool swapRB);
+
+		// Returns the fastest particle sprite row supported by this CPU
+		inline ParticleSpriteRow32Func particleSpriteRow32()
+		{
+#if defined(GEB_X86)
+			if (CPU::hasSSE2())
+			{
+				return particleSpriteRow32SSE2;
+			}
+#endif
+			return particleSpriteRow32Scalar;
+		}
+
+		// Writes count palette colors selected by the 8 bit indices at src to the 32 bit pixels at dst
+		// palette holds 256 colors already in the destination layout. When skipZero is true pixels with index 0 are left unchanged
+		inline void expandIndexedRow32Scalar(unsigned char* dst, const unsigned char* src, unsigned int count, const uint32_t* palette, bool skipZero)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				if (!skipZero || src[i] != 0)
+				{
+					memcpy(&dst[i * 4], &palette[src[i]], 4);
+				}
+			}
+		}
+
+#if defined(GEB_X86)
+		// AVX2 version of expandIndexedRow32Scalar. Widens 8 indices to 32 bits and gathers their colors from the palette
+		GEB_TARGET_AVX2 inline void expandIndexedRow32AVX2(unsigned char* dst, const unsigned char* src, unsigned int count, const uint32_t* palette, bool skipZero)
+		{
+			__m256i zero = _mm256_setzero_si256();
+			unsigned int i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&src[i])));
+				__m256i colors = _mm256_i32gather_epi32(reinterpret_cast<const int*>(palette), index, 4);
+				if (skipZero)
+				{
+					// Only store the lanes whose index is not 0
+					__m256i draw = _mm256_xor_si256(_mm256_cmpeq_epi32(index, zero), _mm256_set1_epi32(-1));
+					_mm256_maskstore_epi32(reinterpret_cast<int*>(&dst[i * 4]), draw, colors);
+				} else
+				{
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i * 4]), colors);
+				}
+			}
+			expandIndexedRow32Scalar(&dst[i * 4], &src[i], count - i, palette, skipZero);
+		}
+#endif
+
+		// Function pointer type for palette expansion into 32 bit pixels
+		typedef void (*ExpandIndexedRow32Func)(unsigned char* dst, const unsigned char* src, unsigned int count, const uint32_t* palette, bool skipZero);
+
+		// Returns the fastest palette expansion supported by this CPU
+		inline ExpandIndexedRow32Func expandIndexedRow32()
+		{
+#if defined(GEB_X86)
+			if (CPU::hasAVX2())
+			{
+				return expandIndexedRow32AVX2;
+			}
+#endif
+			return expandIndexedRow32Scalar;
+		}
+
+		// Writes count palette colors selected by the 8 bit indices at src to the RGB888 pixels at dst
+		// palette holds 256 colors as 32 bit values with the RGB bytes first. When skipZero is true pixels with index 0 are left unchanged
+		inline void expandIndexedRow24Scalar(unsigned char* dst, const unsigned char* src, unsigned int count, const uint32_t* palette, bool skipZero)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				if (!skipZero || src[i] != 0)
+				{
+					memcpy(&dst[i * 3], &palette[src[i]], 3);
+				}
+			}
+		}
+
+#if defined(GEB_X86)
+		// SSSE3 version of expandIndexedRow24Scalar. Loads the colors of 4 indices, packs them to 12 bytes and blends them into the destination
+		GEB_TARGET_SSSE3 inline void expandIndexedRow24SSSE3(unsigned char* dst, const unsigned char* src, unsigned int count, const uint32_t* palette, bool skipZero)
+		{
+			const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i all = _mm_set1_epi32(-1);
+			unsigned int i = 0;
+			// Each step writes 16 bytes, so stop while the write stays within the row
+			for (; i + 6 <= count; i += 4)
+			{
+				__m128i colors = _mm_setr_epi32(static_cast<int>(palette[src[i]]), static_cast<int>(palette[src[i + 1]]),
+					static_cast<int>(palette[src[i + 2]]), static_cast<int>(palette[src[i + 3]]));
+				__m128i rgb = _mm_shuffle_epi8(colors, pack);
+				if (skipZero)
+				{
+					int packed;
+					memcpy(&packed, &src[i], 4);
+					__m128i index = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+					// The last 4 bytes of the mask are zero, so the destination pixels after the group are kept
+					__m128i mask = _mm_shuffle_epi8(_mm_xor_si128(_mm_cmpeq_epi32(index, zero), all), pack);
+					__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dst[i * 3]));
+					rgb = _mm_or_si128(_mm_and_si128(mask, rgb), _mm_andnot_si128(mask, d));
+				}
+				// Without skipping, the 4 extra bytes belong to the next pixels, which are written after this step
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i * 3]), rgb);
+			}
+			expandIndexedRow24Scalar(&dst[i * 3], &src[i], count - i, palette, skipZero);
+		}
+
+		// AVX2 version of expandIndexedRow24Scalar. Gathers the colors of 8 indices and packs them to 24 bytes
+		GEB_TARGET_AVX2 inline void expandIndexedRow24AVX2(unsigned char* dst, const unsigned char* src, unsigned int count, const uint32_t* palette, bool skipZero)
+		{
+			const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+				0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+			// Moves the 12 packed bytes of the upper lane next to those of the lower lane
+			const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i all = _mm256_set1_epi32(-1);
+			unsigned int i = 0;
+			// Each step writes 32 bytes, so stop while the write stays within the row
+			for (; i + 11 <= count; i += 8)
+			{
+				__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&src[i])));
+				__m256i colors = _mm256_i32gather_epi32(reinterpret_cast<const int*>(palette), index, 4);
+				__m256i rgb = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(colors, pack), join);
+				if (skipZero)
+				{
+					__m256i draw = _mm256_xor_si256(_mm256_cmpeq_epi32(index, zero), all);
+					__m256i mask = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(draw, pack), join);
+					__m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&dst[i * 3]));
+					rgb = _mm256_blendv_epi8(d, rgb, mask);
+				}
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i * 3]), rgb);
+			}
+			expandIndexedRow24SSSE3(&dst[i * 3], &src[i], count - i, palette, skipZero);
+		}
+#endif
+
+		// Function pointer type for palette expansion into RGB888 pixels
+		typedef void (*ExpandIndexedRow24Func)(unsigned char* dst, const unsigned char* src, unsigned int count, const uint32_t* palette, bool skipZero);
+
+		// Returns the fastest RGB888 palette expansion supported by this CPU
+		inline ExpandIndexedRow24Func expandIndexedRow24()
+		{
+#if defined(GEB_X86)
+			if (CPU::hasAVX2())
+			{
+				return expandIndexedRow24AVX2;
+			}
+			if (CPU::hasSSSE3())
+			{
+				return expandIndexedRow24SSSE3;
+			}
+#endif
+			return expandIndexedRow24Scalar;
+		}
+
+		// Undoes a PNG row filter in place. prev is the previous row after unfiltering, or zeros for the first row
+		// bpp is the number of bytes per complete pixel, at least 1. Rows with an unknown filter type are left unchanged
+		inline void unfilterRowScalar(unsigned char* row, const unsigned char* prev, unsigned int rowBytes, unsigned int bpp, unsigned int type)
+		{
+			switch (type)
+			{
+			case 1:
+				for (unsigned int i = bpp; i < rowBytes; i++)
+				{
+					row[i] = static_cast<unsigned char>(row[i] + row[i - bpp]);
+				}
+				break;
+			case 2:
+				for (unsigned int i = 0; i < rowBytes; i++)
+				{
+					row[i] = static_cast<unsigned char>(row[i] + prev[i]);
+				}
+				break;
+			case 3:
+				for (unsigned int i = 0; i < rowBytes; i++)
+				{
+					unsigned int a = i >= bpp ? row[i - bpp] : 0;
+					row[i] = static_cast<unsigned char>(row[i] + ((a + prev[i]) >> 1));
+				}
+				break;
+			case 4:
+				for (unsigned int i = 0; i < rowBytes; i++)
+				{
+					int a = i >= bpp ? row[i - bpp] : 0;
+					int b = prev[i];
+					int c = i >= bpp ? prev[i - bpp] : 0;
+					int pa = abs(b - c);
+					int pb = abs(a - c);
+					int pc = abs(a + b - (2 * c));
+					int predictor = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+					row[i] = static_cast<unsigned char>(row[i] + predictor);
+				}
+				break;
+			}
+		}
+
+#if defined(GEB_X86)
+		// Loads a 3 or 4 byte pixel into the low lane of a register
+		GEB_TARGET_SSE2 inline __m128i loadPixelSSE2(const unsigned char* p, unsigned int bpp)
+		{
+			int value = 0;
+			memcpy(&value, p, bpp);
+			return _mm_cvtsi32_si128(value);
+		}
+
+		// Stores the low 3 or 4 bytes of a register
+		GEB_TARGET_SSE2 inline void storePixelSSE2(unsigned char* p, __m128i v, unsigned int bpp)
+		{
+			int value = _mm_cvtsi128_si32(v);
+			memcpy(p, &value, bpp);
+		}
+
+		// SSE2 version of unfilterRowScalar. Up is done 16 bytes at a time. Sub, Average and Paeth work on a whole 3 or 4 byte pixel at a time, other pixel sizes use the scalar code
+		GEB_TARGET_SSE2 inline void unfilterRowSSE2(unsigned char* row, const unsigned char* prev, unsigned int rowBytes, unsigned int bpp, unsigned int type)
+		{
+			if (type == 2)
+			{
+				unsigned int i = 0;
+				for (; i + 16 <= rowBytes; i += 16)
+				{
+					__m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&row[i]));
+					__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&prev[i]));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(&row[i]), _mm_add_epi8(r, p));
+				}
+				unfilterRowScalar(&row[i], &prev[i], rowBytes - i, bpp, type);
+				return;
+			}
+			if ((bpp != 3 && bpp != 4) || type < 1 || type > 4 || rowBytes % bpp != 0)
+			{
+				unfilterRowScalar(row, prev, rowBytes, bpp, type);
+				return;
+			}
+			__m128i zero = _mm_setzero_si128();
+			__m128i a = zero;
+			if (type == 1)
+			{
+				for (unsigned int i = 0; i < rowBytes; i += bpp)
+				{
+					a = _mm_add_epi8(a, loadPixelSSE2(&row[i], bpp));
+					storePixelSSE2(&row[i], a, bpp);
+				}
+			} else if (type == 3)
+			{
+				// pavgb rounds up, so take off the low bit that made it round
+				__m128i one = _mm_set1_epi8(1);
+				for (unsigned int i = 0; i < rowBytes; i += bpp)
+				{
+					__m128i b = loadPixelSSE2(&prev[i], bpp);
+					__m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+					a = _mm_add_epi8(loadPixelSSE2(&row[i], bpp), average);
+					storePixelSSE2(&row[i], a, bpp);
+				}
+			} else
+			{
+				// Paeth in 16 bit lanes. The predictor is whichever of a, b and c has the smallest distance, preferring a then b
+				__m128i c = zero;
+				for (unsigned int i = 0; i < rowBytes; i += bpp)
+				{
+					__m128i b = _mm_unpacklo_epi8(loadPixelSSE2(&prev[i], bpp), zero);
+					__m128i pa = _mm_sub_epi16(b, c);
+					__m128i pb = _mm_sub_epi16(a, c);
+					__m128i pc = _mm_add_epi16(pa, pb);
+					pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+					pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+					pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+					__m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+					__m128i useA = _mm_cmpeq_epi16(smallest, pa);
+					__m128i useB = _mm_cmpeq_epi16(smallest, pb);
+					__m128i predictor = _mm_or_si128(_mm_and_si128(useB, b), _mm_andnot_si128(useB, c));
+					predictor = _mm_or_si128(_mm_and_si128(useA, a), _mm_andnot_si128(useA, predictor));
+					__m128i d = _mm_add_epi8(loadPixelSSE2(&row[i], bpp), _mm_packus_epi16(predictor, predictor));
+					storePixelSSE2(&row[i], d, bpp);
+					a = _mm_unpacklo_epi8(d, zero);
+					c = b;
+				}
+			}
+		}
+#endif
+
+		// Function pointer type for PNG row unfiltering
+		typedef void (*UnfilterRowFunc)(unsigned char* row, const unsigned char* prev, unsigned int rowBytes, unsigned int bpp, unsigned int type);
+
+		// Returns the fastest PNG row unfilter supported by this CPU
+		inline UnfilterRowFunc unfilterRow()
+		{
+#if defined(GEB_X86)
+			if (CPU::hasSSE2())
+			{
+				return unfilterRowSSE2;
+			}
+#endif
+			return unfilterRowScalar;
+		}
+
+		// Averages 2 x 2 blocks of two source rows into one row half as wide, for building mip levels
+		// srcWidth may be odd, when the last column is left out, or 1, when it is used twice
+		inline void downsampleRowScalar(unsigned char* dst, const unsigned char* row0, const unsigned char* row1, unsigned int dstWidth, unsigned int srcWidth, unsigned int channels)
+		{
+			for (unsigned int x = 0; x < dstWidth; x++)
+			{
+				unsigned int x0 = (x * 2) * channels;
+				unsigned int x1 = std::min((x * 2) + 1, srcWidth - 1) * channels;
+				for (unsigned int c = 0; c < channels; c++)
+				{
+					dst[(x * channels) + c] = static_cast<unsigned char>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+				}
+			}
+		}
+
+#if defined(GEB_X86)
+		// SSE2 version of downsampleRowScalar for 4 channel images, producing two pixels per step from 16 bit sums
+		GEB_TARGET_SSE2 inline void downsampleRowSSE2(unsigned char* dst, const unsigned char* row0, const unsigned char* row1, unsigned int dstWidth, unsigned int srcWidth, unsigned int channels)
+		{
+			if (channels != 4 || srcWidth < 2)
+			{
+				downsampleRowScalar(dst, row0, row1, dstWidth, srcWidth, channels);
+				return;
+			}
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i two = _mm_set1_epi16(2);
+			unsigned int x = 0;
+			for (; x + 2 <= dstWidth; x += 2)
+			{
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&row0[x * 8]));
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&row1[x * 8]));
+				// Vertical sums of source pixels 0 and 1, then 2 and 3
+				__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+				__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+				// Add horizontal neighbours, giving both output pixels
+				__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+				sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(&dst[x * 4]), _mm_packus_epi16(sum, sum));
+			}
+			if (x < dstWidth)
+			{
+				downsampleRowScalar(&dst[x * 4], &row0[x * 8], &row1[x * 8], dstWidth - x, srcWidth - (x * 2), 4);
+			}
+		}
+#endif
+
+		// Function pointer type for mip level downsampling
+		typedef void (*DownsampleRowFunc)(unsigned char* dst, const unsigned char* row0, const unsigned char* row1, unsigned int dstWidth, unsigned int srcWidth, unsigned int channels);
+
+		// Returns the fastest mip level downsampler supported by this CPU
+		inline DownsampleRowFunc downsampleRow()
+		{
+#if defined(GEB_X86)
+			if (CPU::hasSSE2())
+			{
+				return downsampleRowSSE2;
+			}
+#endif
+			return downsampleRowScalar;
+		}
+	}
+
+	// The Codecs namespace holds the image file encoders used by FrameCapture and the PNG decoder used by Image
+	// The encoders work on tightly packed RGB888 pixels and append the encoded file to a byte vector
+	namespace Codecs
+	{
+		// Returns the CRC-32 of size bytes, continuing from crc. PNG chunks are checked with this
+		inline uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0)
+		{
+			static const std::vector<uint32_t> table = []
+			{
+				std::vector<uint32_t> t(256);
+				for (uint32_t n = 0; n < 256; n++)
+				{
+					uint32_t c = n;
+					for (int k = 0; k < 8; k++)
+					{
+						c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					}
+					t[n] = c;
+				}
+				return t;
+			}();
+			crc = ~crc;
+			for (size_t i = 0; i < size; i++)
+			{
+				crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+			}
+			return ~crc;
+		}
+
+		// Returns the Adler-32 checksum of size bytes, continuing from adler. zlib streams end with this
+		inline uint32_t adler32(const unsigned char* data, size_t size, uint32_t adler = 1)
+		{
+			uint32_t a = adler & 0xFFFF;
+			uint32_t b = adler >> 16;
+			while (size > 0)
+			{
+				// 5552 bytes is the most that can be summed before b can overflow
+				size_t n = std::min<size_t>(size, 5552);
+				for (size_t i = 0; i < n; i++)
+				{
+					a += data[i];
+					b += a;
+				}
+				a %= 65521;
+				b %= 65521;
+				data += n;
+				size -= n;
+			}
+			return (b << 16) | a;
+		}
+
+		// Writes values least significant bit first, as deflate streams are packed
+		class BitWriter
+		{
+		private:
+			std::vector<unsigned char>& out;   // Destination
+			uint64_t bits = 0;                 // Bits not yet written
+			unsigned int count = 0;            // Number of bits held in bits
+
+		public:
+			BitWriter(std::vector<unsigned char>& _out) : out(_out) {}
+
+			// Appends the low n bits of value, n <= 32
+			void write(uint32_t value, unsigned int n)
+			{
+				bits |= static_cast<uint64_t>(value) << count;
+				count += n;
+				while (count >= 8)
+				{
+					out.push_back(static_cast<unsigned char>(bits));
+					bits >>= 8;
+					count -= 8;
+				}
+			}
+
+			// Appends a Huffman code of n bits, which deflate stores most significant bit first
+			void writeCode(uint32_t code, unsigned int n)
+			{
+				uint32_t reversed = 0;
+				for (unsigned int i = 0; i < n; i++)
+				{
+					reversed = (reversed << 1) | ((code >> i) & 1);
+				}
+				write(reversed, n);
+			}
+
+			// Pads to a whole byte
+			void flush()
+			{
+				if (count > 0)
+				{
+					out.push_back(static_cast<unsigned char>(bits));
+				}
+				bits = 0;
+				count = 0;
+			}
+		};
+
+		// Appends a zlib stream holding size bytes compressed as a single deflate block with the fixed Huffman codes
+		// Matches are found with a hash of the next 3 bytes, which keeps the encoder simple and fast at some cost in size
+		inline void deflate(const unsigned char* data, size_t size, std::vector<unsigned char>& out)
+		{
+			static const unsigned short lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+			static const unsigned char lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+			static const unsigned short distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+			static const unsigned char distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+			const unsigned int hashBits = 15;
+
+			out.push_back(0x78);
+			out.push_back(0x01);
+			BitWriter bits(out);
+			bits.write(1, 1);   // Final block
+			bits.write(1, 2);   // Fixed Huffman codes
+
+			// Fixed literal and length codes
+			auto symbol = [&](unsigned int value)
+			{
+				if (value < 144)
+				{
+					bits.writeCode(0x30 + value, 8);
+				} else if (value < 256)
+				{
+					bits.writeCode(0x190 + (value - 144), 9);
+				} else if (value < 280)
+				{
+					bits.writeCode(value - 256, 7);
+				} else
+				{
+					bits.writeCode(0xC0 + (value - 280), 8);
+				}
+			};
+
+			std::vector<int64_t> head(static_cast<size_t>(1) << hashBits, -1);
+			size_t i = 0;
+			while (i < size)
+			{
+				size_t bestLength = 0;
+				size_t bestDistance = 0;
+				if (i + 3 <= size)
+				{
+					uint32_t hash = ((static_cast<uint32_t>(data[i]) << 16) | (static_cast<uint32_t>(data[i + 1]) << 8) | data[i + 2]) * 2654435761u >> (32 - hashBits);
+					int64_t candidate = head[hash];
+					head[hash] = static_cast<int64_t>(i);
+					if (candidate >= 0 && i - static_cast<size_t>(candidate) <= 32768)
+					{
+						size_t limit = std::min<size_t>(258, size - i);
+						size_t length = 0;
+						while (length < limit && data[candidate + length] == data[i + length])
+						{
+							length++;
+						}
+						if (length >= 3)
+						{
+							bestLength = length;
+							bestDistance = i - static_cast<size_t>(candidate);
+						}
+					}
+				}
+				if (bestLength == 0)
+				{
+					symbol(data[i]);
+					i++;
+					continue;
+				}
+				unsigned int code = 0;
+				while (code < 28 && lengthBase[code + 1] <= bestLength)
+				{
+					code++;
+				}
+				symbol(257 + code);
+				bits.write(static_cast<uint32_t>(bestLength - lengthBase[code]), lengthExtra[code]);
+				unsigned int distanceCode = 0;
+				while (distanceCode < 29 && distanceBase[distanceCode + 1] <= bestDistance)
+				{
+					distanceCode++;
+				}
+				bits.writeCode(distanceCode, 5);
+				bits.write(static_cast<uint32_t>(bestDistance - distanceBase[distanceCode]), distanceExtra[distanceCode]);
+				i += bestLength;
+			}
+			symbol(256);
+			bits.flush();
+			uint32_t adler = adler32(data, size);
+			out.push_back(static_cast<unsigned char>(adler >> 24));
+			out.push_back(static_cast<unsigned char>(adler >> 16));
+			out.push_back(static_cast<unsigned char>(adler >> 8));
+			out.push_back(static_cast<unsigned char>(adler));
+		}
+
+		// Appends a 32 bit value in big endian order
+		inline void writeBigEndian(std::vector<unsigned char>& out, uint32_t value)
+		{
+			out.push_back(static_cast<unsigned char>(value >> 24));
+			out.push_back(static_cast<unsigned char>(value >> 16));
+			out.push_back(static_cast<unsigned char>(value >> 8));
+			out.push_back(static_cast<unsigned char>(value));
+		}
+
+		// Appends a 32 bit value in little endian order
+		inline void writeLittleEndian(std::vector<unsigned char>& out, uint32_t value)
+		{
+			out.push_back(static_cast<unsigned char>(value));
+			out.push_back(static_cast<unsigned char>(value >> 8));
+			out.push_back(static_cast<unsigned char>(value >> 16));
+			out.push_back(static_cast<unsigned char>(value >> 24));
+		}
+
+		// Reads a 32 bit little endian value
+		inline uint32_t readLittleEndian(const unsigned char* p)
+		{
+			return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+		}
+
+		// Reads a whole file into bytes. Returns false if it cannot be opened or read
+		// Directories open on some platforms and report a size of -1 or a huge one, but fail to read, so a byte is read before the size is trusted
+		inline bool readFile(const std::string& filename, std::vector<unsigned char>& bytes)
+		{
+			bytes.clear();
+			std::ifstream file(filename, std::ios::binary | std::ios::ate);
+			std::streamoff size = file ? static_cast<std::streamoff>(file.tellg()) : -1;
+			file.seekg(0);
+			if (size < 0 || !file || (size > 0 && file.peek() == std::char_traits<char>::eof()))
+			{
+				return false;
+			}
+			bytes.resize(static_cast<size_t>(size));
+			file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+			return static_cast<bool>(file);
+		}
+
+		// Appends a PNG file holding a width x height RGB888 image
+		// Each row uses whichever of the None, Sub, Up and Paeth filters gives the smallest sum of absolute differences
+		inline void encodePNG(const unsigned char* rgb, unsigned int width, unsigned int height, std::vector<unsigned char>& out)
+		{
+			auto chunk = [&](const char* type, const unsigned char* data, size_t size)
+			{
+				writeBigEndian(out, static_cast<uint32_t>(size));
+				size_t start = out.size();
+				out.insert(out.end(), type, type + 4);
+				out.insert(out.end(), data, data + size);
+				writeBigEndian(out, crc32(&out[start], size + 4));
+			};
+			static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+			out.insert(out.end(), signature, signature + 8);
+			std::vector<unsigned char> header;
+			writeBigEndian(header, width);
+			writeBigEndian(header, height);
+			header.push_back(8);   // Bits per channel
+			header.push_back(2);   // RGB
+			header.push_back(0);   // Deflate
+			header.push_back(0);   // Adaptive filtering
+			header.push_back(0);   // Not interlaced
+			chunk("IHDR", header.data(), header.size());
+
+			size_t rowBytes = static_cast<size_t>(width) * 3;
+			std::vector<unsigned char> filtered((rowBytes + 1) * height);
+			std::vector<unsigned char> candidate(rowBytes);
+			std::vector<unsigned char> zero(rowBytes, 0);
+			for (unsigned int y = 0; y < height; y++)
+			{
+				const unsigned char* row = &rgb[y * rowBytes];
+				const unsigned char* above = y > 0 ? &rgb[(y - 1) * rowBytes] : zero.data();
+				unsigned char* dst = &filtered[y * (rowBytes + 1)];
+				uint64_t bestScore = UINT64_MAX;
+				for (unsigned char type = 0; type < 5; type++)
+				{
+					if (type == 3)
+					{
+						// The Average filter rarely wins on rendered frames
+						continue;
+					}
+					uint64_t score = 0;
+					for (size_t i = 0; i < rowBytes; i++)
+					{
+						int a = i >= 3 ? row[i - 3] : 0;
+						int b = above[i];
+						int c = i >= 3 ? above[i - 3] : 0;
+						int predictor = 0;
+						if (type == 1)
+						{
+							predictor = a;
+						} else if (type == 2)
+						{
+							predictor = b;
+						} else if (type == 4)
+						{
+							int p = a + b - c;
+							int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+							predictor = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+						}
+						candidate[i] = static_cast<unsigned char>(row[i] - predictor);
+						score += static_cast<uint64_t>(abs(static_cast<signed char>(candidate[i])));
+					}
+					if (score < bestScore)
+					{
+						bestScore = score;
+						dst[0] = type;
+						memcpy(&dst[1], candidate.data(), rowBytes);
+					}
+				}
+			}
+			std::vector<unsigned char> compressed;
+			deflate(filtered.data(), filtered.size(), compressed);
+			chunk("IDAT", compressed.data(), compressed.size());
+			chunk("IEND", nullptr, 0);
+		}
+
+		// Appends a QOI file holding a width x height RGB888 image. QOI is much faster to encode than PNG, at some cost in size
+		inline void encodeQOI(const unsigned char* rgb, unsigned int width, unsigned int height, std::vector<unsigned char>& out)
+		{
+			out.insert(out.end(), { 'q', 'o', 'i', 'f' });
+			writeBigEndian(out, width);
+			writeBigEndian(out, height);
+			out.push_back(3);   // RGB
+			out.push_back(0);   // sRGB
+			unsigned char seen[64][3] = {};
+			bool seenValid[64] = {};
+			unsigned char previous[3] = { 0, 0, 0 };
+			unsigned int run = 0;
+			size_t count = static_cast<size_t>(width) * height;
+			for (size_t i = 0; i < count; i++)
+			{
+				const unsigned char* p = &rgb[i * 3];
+				if (p[0] == previous[0] && p[1] == previous[1] && p[2] == previous[2])
+				{
+					run++;
+					if (run == 62 || i + 1 == count)
+					{
+						out.push_back(static_cast<unsigned char>(0xC0 | (run - 1)));
+						run = 0;
+					}
+					continue;
+				}
+				if (run > 0)
+				{
+					out.push_back(static_cast<unsigned char>(0xC0 | (run - 1)));
+					run = 0;
+				}
+				// Alpha is always 255 for RGB images
+				unsigned int hash = ((p[0] * 3) + (p[1] * 5) + (p[2] * 7) + (255 * 11)) % 64;
+				if (seenValid[hash] && seen[hash][0] == p[0] && seen[hash][1] == p[1] && seen[hash][2] == p[2])
+				{
+					out.push_back(static_cast<unsigned char>(hash));
+				} else
+				{
+					seen[hash][0] = p[0];
+					seen[hash][1] = p[1];
+					seen[hash][2] = p[2];
+					seenValid[hash] = true;
+					int dr = static_cast<signed char>(p[0] - previous[0]);
+					int dg = static_cast<signed char>(p[1] - previous[1]);
+					int db = static_cast<signed char>(p[2] - previous[2]);
+					if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+					{
+						out.push_back(static_cast<unsigned char>(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+					} else if (dg >= -32 && dg <= 31 && dr - dg >= -8 && dr - dg <= 7 && db - dg >= -8 && db - dg <= 7)
+					{
+						out.push_back(static_cast<unsigned char>(0x80 | (dg + 32)));
+						out.push_back(static_cast<unsigned char>(((dr - dg + 8) << 4) | (db - dg + 8)));
+					} else
+					{
+						out.push_back(0xFE);
+						out.insert(out.end(), p, p + 3);
+					}
+				}
+				previous[0] = p[0];
+				previous[1] = p[1];
+				previous[2] = p[2];
+			}
+			out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+		}
+
+		// A canonical Huffman code for inflate. Codes of up to fastBits bits are decoded with one table lookup, longer ones by comparing against the limit for each length
+		class Huffman
+		{
+		public:
+			static const unsigned int fastBits = 10;
+			uint16_t fast[1 << fastBits];        // Length in the top bits and symbol in the low 9 bits, indexed by the next fastBits input bits. 0 means the code is longer
+			uint16_t firstCode[16];              // First code of each length
+			uint16_t firstSymbol[16];            // Index into symbols of the first code of each length
+			uint32_t limit[17];                  // One past the last code of each length, shifted up to 16 bits
+			unsigned char lengths[288];          // Length of each sorted code
+			uint16_t symbols[288];               // Symbol of each sorted code
+
+			// Builds the code from the length of each of count symbols. Returns false for over-subscribed codes
+			bool build(const unsigned char* codeLengths, unsigned int count)
+			{
+				unsigned int sizes[17] = {};
+				memset(fast, 0, sizeof(fast));
+				for (unsigned int i = 0; i < count; i++)
+				{
+					sizes[codeLengths[i]]++;
+				}
+				sizes[0] = 0;
+				unsigned int nextCode[16];
+				unsigned int code = 0;
+				unsigned int k = 0;
+				for (unsigned int i = 1; i < 16; i++)
+				{
+					nextCode[i] = code;
+					firstCode[i] = static_cast<uint16_t>(code);
+					firstSymbol[i] = static_cast<uint16_t>(k);
+					code += sizes[i];
+					if (sizes[i] != 0 && code - 1 >= (1u << i))
+					{
+						return false;
+					}
+					limit[i] = code << (16 - i);
+					code <<= 1;
+					k += sizes[i];
+				}
+				limit[16] = 0x10000;
+				for (unsigned int i = 0; i < count; i++)
+				{
+					unsigned int length = codeLengths[i];
+					if (length == 0)
+					{
+						continue;
+					}
+					unsigned int index = nextCode[length] - firstCode[length] + firstSymbol[length];
+					lengths[index] = static_cast<unsigned char>(length);
+					symbols[index] = static_cast<uint16_t>(i);
+					if (length <= fastBits)
+					{
+						// Input bits arrive least significant first, so the table is indexed by the reversed code
+						unsigned int reversed = 0;
+						for (unsigned int b = 0; b < length; b++)
+						{
+							reversed |= ((nextCode[length] >> b) & 1) << (length - 1 - b);
+						}
+						for (unsigned int j = reversed; j < (1u << fastBits); j += 1u << length)
+						{
+							fast[j] = static_cast<uint16_t>((length << 9) | i);
+						}
+					}
+					nextCode[length]++;
+				}
+				return true;
+			}
+		};
+
+		// Decompresses a zlib stream. The caller sizes out to the expected output, which is all a PNG needs; a stream producing more fails
+		// The Adler-32 checksum is not checked, as the PNG chunk structure already guards against truncation
+		class Inflater
+		{
+		private:
+			const unsigned char* data;   // Compressed input
+			size_t size;                 // Input size in bytes
+			size_t position = 0;         // Next input byte to load into bits
+			uint64_t bits = 0;           // Loaded input bits, next bit lowest
+			unsigned int count = 0;      // Number of bits loaded
+			unsigned int overrun = 0;    // Zero bytes loaded past the end of the input
+
+			// Tops the bit buffer up to at least 57 bits, padding with zeros past the end of the input
+			void refill()
+			{
+				while (count <= 56)
+				{
+					if (position < size)
+					{
+						bits |= static_cast<uint64_t>(data[position++]) << count;
+					} else
+					{
+						overrun++;
+					}
+					count += 8;
+				}
+			}
+
+			// Takes n bits, n <= 32
+			uint32_t take(unsigned int n)
+			{
+				if (count < n)
+				{
+					refill();
+				}
+				uint32_t value = static_cast<uint32_t>(bits & ((static_cast<uint64_t>(1) << n) - 1));
+				bits >>= n;
+				count -= n;
+				return value;
+			}
+
+			// Decodes one symbol, or returns -1 for an invalid code
+			int decode(const Huffman& h)
+			{
+				if (count < 16)
+				{
+					refill();
+				}
+				unsigned int entry = h.fast[bits & ((1u << Huffman::fastBits) - 1)];
+				if (entry != 0)
+				{
+					unsigned int length = entry >> 9;
+					bits >>= length;
+					count -= length;
+					return static_cast<int>(entry & 511);
+				}
+				// Compare the next 16 bits, most significant first, against the limit of each longer length
+				unsigned int k = 0;
+				for (unsigned int b = 0; b < 16; b++)
+				{
+					k |= static_cast<unsigned int>((bits >> b) & 1) << (15 - b);
+				}
+				unsigned int length = Huffman::fastBits + 1;
+				while (length < 16 && k >= h.limit[length])
+				{
+					length++;
+				}
+				if (length >= 16)
+				{
+					return -1;
+				}
+				unsigned int index = (k >> (16 - length)) - h.firstCode[length] + h.firstSymbol[length];
+				if (index >= 288 || h.lengths[index] != length)
+				{
+					return -1;
+				}
+				bits >>= length;
+				count -= length;
+				return h.symbols[index];
+			}
+
+			// Reads the code lengths of a dynamic block and builds its tables
+			bool readDynamicTables(Huffman& literals, Huffman& distances)
+			{
+				static const unsigned char order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+				unsigned int literalCount = take(5) + 257;
+				unsigned int distanceCount = take(5) + 1;
+				unsigned int codeLengthCount = take(4) + 4;
+				unsigned char codeLengthLengths[19] = {};
+				for (unsigned int i = 0; i < codeLengthCount; i++)
+				{
+					codeLengthLengths[order[i]] = static_cast<unsigned char>(take(3));
+				}
+				Huffman codeLengths;
+				if (!codeLengths.build(codeLengthLengths, 19))
+				{
+					return false;
+				}
+				unsigned char lengths[288 + 32] = {};
+				unsigned int n = 0;
+				while (n < literalCount + distanceCount)
+				{
+					int symbol = decode(codeLengths);
+					if (symbol < 0)
+					{
+						return false;
+					}
+					if (symbol < 16)
+					{
+						lengths[n++] = static_cast<unsigned char>(symbol);
+						continue;
+					}
+					unsigned char value = 0;
+					unsigned int repeat;
+					if (symbol == 16)
+					{
+						if (n == 0)
+						{
+							return false;
+						}
+						value = lengths[n - 1];
+						repeat = take(2) + 3;
+					} else if (symbol == 17)
+					{
+						repeat = take(3) + 3;
+					} else
+					{
+						repeat = take(7) + 11;
+					}
+					if (n + repeat > literalCount + distanceCount)
+					{
+						return false;
+					}
+					memset(&lengths[n], value, repeat);
+					n += repeat;
+				}
+				return literals.build(lengths, literalCount) && distances.build(&lengths[literalCount], distanceCount);
+			}
+
+		public:
+			Inflater(const unsigned char* _data, size_t _size) : data(_data), size(_size) {}
+
+			// Decompresses the stream into out, which must already be the expected size. Returns false if the stream is damaged or does not fill out exactly
+			bool inflate(unsigned char* out, size_t outSize)
+			{
+				static const unsigned short lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+				static const unsigned char lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+				static const unsigned short distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+				static const unsigned char distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+				// zlib header: deflate with a window of at most 32K, a valid check value and no preset dictionary
+				if (size < 2 || (data[0] & 0x0F) != 8 || (data[0] >> 4) > 7 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20) != 0)
+				{
+					return false;
+				}
+				position = 2;
+				size_t written = 0;
+				bool last = false;
+				Huffman literals;
+				Huffman distances;
+				while (!last)
+				{
+					last = take(1) != 0;
+					unsigned int type = take(2);
+					if (type == 0)
+					{
+						// Stored block: skip to a byte boundary, then copy
+						take(count % 8);
+						uint32_t length = take(16);
+						uint32_t check = take(16);
+						if ((length ^ 0xFFFF) != check || written + length > outSize)
+						{
+							return false;
+						}
+						// Drain bytes still held in the bit buffer before copying straight from the input
+						while (length > 0 && count >= 8)
+						{
+							out[written++] = static_cast<unsigned char>(take(8));
+							length--;
+						}
+						if (position + length > size)
+						{
+							return false;
+						}
+						memcpy(&out[written], &data[position], length);
+						position += length;
+						written += length;
+						continue;
+					}
+					if (type == 1)
+					{
+						// The fixed codes are built once
+						static const std::vector<Huffman> fixed = []
+						{
+							std::vector<Huffman> tables(2);
+							unsigned char lengths[288];
+							memset(lengths, 8, 144);
+							memset(&lengths[144], 9, 112);
+							memset(&lengths[256], 7, 24);
+							memset(&lengths[280], 8, 8);
+							tables[0].build(lengths, 288);
+							memset(lengths, 5, 32);
+							tables[1].build(lengths, 32);
+							return tables;
+						}();
+						literals = fixed[0];
+						distances = fixed[1];
+					} else if (type == 2)
+					{
+						if (!readDynamicTables(literals, distances))
+						{
+							return false;
+						}
+					} else
+					{
+						return false;
+					}
+					while (true)
+					{
+						int symbol = decode(literals);
+						if (symbol < 0)
+						{
+							return false;
+						}
+						if (symbol < 256)
+						{
+							if (written >= outSize)
+							{
+								return false;
+							}
+							out[written++] = static_cast<unsigned char>(symbol);
+							continue;
+						}
+						if (symbol == 256)
+						{
+							break;
+						}
+						symbol -= 257;
+						if (symbol >= 29)
+						{
+							return false;
+						}
+						size_t length = lengthBase[symbol] + take(lengthExtra[symbol]);
+						int distanceSymbol = decode(distances);
+						if (distanceSymbol < 0 || distanceSymbol >= 30)
+						{
+							return false;
+						}
+						size_t distance = distanceBase[distanceSymbol] + take(distanceExtra[distanceSymbol]);
+						if (distance > written || written + length > outSize)
+						{
+							return false;
+						}
+						unsigned char* dst = &out[written];
+						const unsigned char* src = dst - distance;
+						if (distance >= length)
+						{
+							memcpy(dst, src, length);
+						} else if (distance == 1)
+						{
+							memset(dst, src[0], length);
+						} else
+						{
+							// Overlapping copy repeats the last distance bytes
+							for (size_t i = 0; i < length; i++)
+							{
+								dst[i] = src[i];
+							}
+						}
+						written += length;
+					}
+					if (overrun > 8)
+					{
+						return false;
+					}
+				}
+				return written == outSize && overrun <= 8;
+			}
+		};
+
+		// Reads a 32 bit big endian value
+		inline uint32_t readBigEndian(const unsigned char* p)
+		{
+			return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+		}
+
+		// Decodes a PNG file held in memory into a new[] allocated array of RGB or RGBA pixels, in that byte order
+		// Every color type, bit depth and interlacing is supported. Images with an alpha channel or a tRNS chunk give 4 channels, others 3. 16 bit samples keep their high byte
+		// The pixels are allocated with allocate if it is given. Returns false and leaves pixels null if the file is not a valid PNG
+		inline bool decodePNG(const unsigned char* file, size_t size, unsigned char*& pixels, unsigned int& width, unsigned int& height, unsigned int& channels, const std::function<unsigned char*(size_t)>& allocate = nullptr)
+		{
+			static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+			pixels = nullptr;
+			if (size < 8 || memcmp(file, signature, 8) != 0)
+			{
+				return false;
+			}
+
+			// Gather the header, palette, transparency and compressed data
+			unsigned int depth = 0, colorType = 0, interlace = 0;
+			unsigned char palette[256][4];
+			unsigned int paletteSize = 0;
+			bool hasKey = false;
+			uint16_t key[3] = { 0, 0, 0 };
+			std::vector<unsigned char> compressed;
+			width = 0;
+			height = 0;
+			size_t position = 8;
+			bool ended = false;
+			while (!ended && position + 12 <= size)
+			{
+				uint32_t length = readBigEndian(&file[position]);
+				const unsigned char* type = &file[position + 4];
+				const unsigned char* body = &file[position + 8];
+				if (length > size - position - 12)
+				{
+					return false;
+				}
+				if (memcmp(type, "IHDR", 4) == 0 && length >= 13)
+				{
+					width = readBigEndian(body);
+					height = readBigEndian(&body[4]);
+					depth = body[8];
+					colorType = body[9];
+					interlace = body[12];
+				} else if (memcmp(type, "PLTE", 4) == 0)
+				{
+					paletteSize = std::min(256u, length / 3);
+					for (unsigned int i = 0; i < paletteSize; i++)
+					{
+						palette[i][0] = body[(i * 3)];
+						palette[i][1] = body[(i * 3) + 1];
+						palette[i][2] = body[(i * 3) + 2];
+						palette[i][3] = 255;
+					}
+				} else if (memcmp(type, "tRNS", 4) == 0)
+				{
+					if (colorType == 3)
+					{
+						for (unsigned int i = 0; i < std::min(length, paletteSize); i++)
+						{
+							palette[i][3] = body[i];
+						}
+					} else if (colorType == 0 && length >= 2)
+					{
+						key[0] = key[1] = key[2] = static_cast<uint16_t>((body[0] << 8) | body[1]);
+					} else if (colorType == 2 && length >= 6)
+					{
+						for (unsigned int c = 0; c < 3; c++)
+						{
+							key[c] = static_cast<uint16_t>((body[c * 2] << 8) | body[(c * 2) + 1]);
+						}
+					}
+					hasKey = true;
+				} else if (memcmp(type, "IDAT", 4) == 0)
+				{
+					compressed.insert(compressed.end(), body, body + length);
+				} else if (memcmp(type, "IEND", 4) == 0)
+				{
+					ended = true;
+				}
+				position += static_cast<size_t>(length) + 12;
+			}
+
+			// Samples per pixel of each color type
+			static const unsigned int samplesPerType[7] = { 1, 0, 3, 1, 2, 0, 4 };
+			if (width == 0 || height == 0 || width > 0x7FFFFFFF / 8 || height > 0x7FFFFFFF / 8 || colorType > 6 || samplesPerType[colorType] == 0 || interlace > 1 || compressed.empty())
+			{
+				return false;
+			}
+			if ((depth != 1 && depth != 2 && depth != 4 && depth != 8 && depth != 16) || (colorType == 3 && (depth > 8 || paletteSize == 0)) || ((colorType == 2 || colorType == 4 || colorType == 6) && depth < 8))
+			{
+				return false;
+			}
+			unsigned int samples = samplesPerType[colorType];
+			channels = (colorType == 4 || colorType == 6 || hasKey) ? 4 : 3;
+			unsigned int bitsPerPixel = samples * depth;
+			unsigned int bpp = std::max(1u, bitsPerPixel / 8);
+
+			// Adam7 passes: starting column and row, then column and row steps. A non interlaced image is a single pass covering everything
+			static const unsigned int adam7[7][4] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+			static const unsigned int single[1][4] = { { 0, 0, 1, 1 } };
+			const unsigned int(*passes)[4] = interlace ? adam7 : single;
+			unsigned int passCount = interlace ? 7 : 1;
+			size_t expected = 0;
+			for (unsigned int p = 0; p < passCount; p++)
+			{
+				uint64_t passWidth = (width - passes[p][0] + passes[p][2] - 1) / passes[p][2];
+				uint64_t passHeight = (height - passes[p][1] + passes[p][3] - 1) / passes[p][3];
+				if (width > passes[p][0] && height > passes[p][1])
+				{
+					expected += static_cast<size_t>((((passWidth * bitsPerPixel) + 7) / 8) + 1) * static_cast<size_t>(passHeight);
+				}
+			}
+			// Deflate cannot expand data more than 1032 times, so anything larger is a damaged header
+			if (expected / 1032 > compressed.size())
+			{
+				return false;
+			}
+			std::vector<unsigned char> filtered(expected);
+			Inflater inflater(compressed.data(), compressed.size());
+			if (!inflater.inflate(filtered.data(), filtered.size()))
+			{
+				return false;
+			}
+
+			// Check every row's filter type before allocating, so a damaged row cannot leave a half decoded image
+			size_t offset = 0;
+			for (unsigned int p = 0; p < passCount; p++)
+			{
+				if (width <= passes[p][0] || height <= passes[p][1])
+				{
+					continue;
+				}
+				unsigned int passWidth = (width - passes[p][0] + passes[p][2] - 1) / passes[p][2];
+				unsigned int passHeight = (height - passes[p][1] + passes[p][3] - 1) / passes[p][3];
+				size_t rowBytes = static_cast<size_t>(((static_cast<uint64_t>(passWidth) * bitsPerPixel) + 7) / 8);
+				for (unsigned int y = 0; y < passHeight; y++)
+				{
+					if (filtered[offset] > 4)
+					{
+						return false;
+					}
+					offset += rowBytes + 1;
+				}
+			}
+
+			size_t pixelBytes = static_cast<size_t>(width) * height * channels;
+			pixels = allocate ? allocate(pixelBytes) : new unsigned char[pixelBytes];
+			Kernels::UnfilterRowFunc unfilter = Kernels::unfilterRow();
+			std::vector<unsigned char> zero(((static_cast<size_t>(width) * bitsPerPixel) + 7) / 8, 0);
+			std::vector<unsigned char> samplesRow(static_cast<size_t>(width) * samples);
+			unsigned int maxSample = (1u << std::min(depth, 8u)) - 1;
+			unsigned char* row = filtered.data();
+			for (unsigned int p = 0; p < passCount; p++)
+			{
+				if (width <= passes[p][0] || height <= passes[p][1])
+				{
+					continue;
+				}
+				unsigned int passWidth = (width - passes[p][0] + passes[p][2] - 1) / passes[p][2];
+				unsigned int passHeight = (height - passes[p][1] + passes[p][3] - 1) / passes[p][3];
+				unsigned int rowBytes = static_cast<unsigned int>(((static_cast<uint64_t>(passWidth) * bitsPerPixel) + 7) / 8);
+				const unsigned char* prev = zero.data();
+				for (unsigned int y = 0; y < passHeight; y++)
+				{
+					unsigned int filter = row[0];
+					unsigned char* current = &row[1];
+					unfilter(current, prev, rowBytes, bpp, filter);
+					prev = current;
+					row += rowBytes + 1;
+					unsigned int outY = passes[p][1] + (y * passes[p][3]);
+					unsigned char* outRow = &pixels[static_cast<size_t>(outY) * width * channels];
+
+					// The common cases copy straight into the image
+					if (!interlace && depth == 8 && (colorType == 6 || (colorType == 2 && !hasKey)))
+					{
+						memcpy(outRow, current, rowBytes);
+						continue;
+					}
+
+					// Otherwise reduce the row to one byte per sample, then convert to RGB or RGBA
+					unsigned int count = passWidth * samples;
+					if (depth == 8)
+					{
+						memcpy(samplesRow.data(), current, count);
+					} else if (depth == 16)
+					{
+						for (unsigned int i = 0; i < count; i++)
+						{
+							samplesRow[i] = current[i * 2];
+						}
+					} else
+					{
+						for (unsigned int i = 0; i < count; i++)
+						{
+							unsigned int bit = i * depth;
+							unsigned int value = (current[bit / 8] >> (8 - depth - (bit % 8))) & maxSample;
+							samplesRow[i] = static_cast<unsigned char>(colorType == 3 ? value : (value * 255) / maxSample);
+						}
+					}
+					for (unsigned int x = 0; x < passWidth; x++)
+					{
+						unsigned char* out = &outRow[(passes[p][0] + (x * passes[p][2])) * channels];
+						const unsigned char* in = &samplesRow[x * samples];
+						unsigned char alpha = 255;
+						switch (colorType)
+						{
+						case 0:
+							out[0] = out[1] = out[2] = in[0];
+							break;
+						case 2:
+							out[0] = in[0];
+							out[1] = in[1];
+							out[2] = in[2];
+							break;
+						case 3:
+						{
+							unsigned int index = std::min(static_cast<unsigned int>(in[0]), paletteSize - 1);
+							out[0] = palette[index][0];
+							out[1] = palette[index][1];
+							out[2] = palette[index][2];
+							alpha = palette[index][3];
+							break;
+						}
+						case 4:
+							out[0] = out[1] = out[2] = in[0];
+							alpha = in[1];
+							break;
+						case 6:
+							out[0] = in[0];
+							out[1] = in[1];
+							out[2] = in[2];
+							alpha = in[3];
+							break;
+						}
+						if (hasKey && (colorType == 0 || colorType == 2))
+						{
+							// Compare the full precision samples against the transparent color
+							bool match = true;
+							for (unsigned int c = 0; c < samples; c++)
+							{
+								unsigned int value;
+								unsigned int index = (x * samples) + c;
+								if (depth == 16)
+								{
+									value = (current[index * 2] << 8) | current[(index * 2) + 1];
+								} else if (depth == 8)
+								{
+									value = current[index];
+								} else
+								{
+									value = (current[(index * depth) / 8] >> (8 - depth - ((index * depth) % 8))) & maxSample;
+								}
+								match = match && value == key[c];
+							}
+							alpha = match ? 0 : 255;
+						}
+						if (channels == 4)
+						{
+							out[3] = alpha;
+						}
+					}
+				}
+			}
+			return true;
+		}
+	}
+
+	// The ImagePool class is an arena that Image pixel data can be allocated from, for example one pool per level
+	// Allocations are 64 byte aligned and carved from large blocks, so loading a level makes a handful of system allocations and freeing an image only updates the counters.
+	// Once every image from the pool has been freed, reset() makes all of its memory reusable in one step without returning it to the system.
+	class ImagePool
+	{
+	private:
+		static const size_t alignment = 64;           // Alignment of every allocation. Each is preceded by one alignment sized header holding its size
+
+		// A block of memory allocations are carved from
+		struct Block
+		{
+			unsigned char* memory;
+			size_t size;
+			size_t used;
+		};
+
+		std::vector<Block> blocks;                    // Blocks in the order they were allocated
+		size_t current = 0;                           // Block allocations are taken from. Earlier blocks are full
+		size_t blockSize;                             // Size of each new block, unless an allocation needs more
+		mutable std::mutex mutex;                     // Protects the state above and below, so images can be loaded into a pool from several threads
+		unsigned int allocations = 0;                 // Number of allocations not yet freed
+		unsigned int totalAllocations = 0;            // Number of allocations since the pool was created
+		size_t inUse = 0;                             // Bytes of allocations not yet freed, including headers and padding
+
+		// Returns every block to the system
+		void freeBlocks()
+		{
+			for (Block& block : blocks)
+			{
+				::operator delete(block.memory, std::align_val_t(alignment));
+			}
+			blocks.clear();
+			current = 0;
+		}
+
+	public:
+		// Creates an empty pool. Memory is reserved in blocks of blockSize bytes as it is needed
+		ImagePool(size_t _blockSize = 16 << 20)
+		{
+			blockSize = std::max(_blockSize, alignment * 2);
+		}
+
+		// Returns every block to the system. Images allocated from the pool must have been freed first
+		~ImagePool()
+		{
+			freeBlocks();
+		}
+
+		ImagePool(const ImagePool&) = delete;
+		ImagePool& operator=(const ImagePool&) = delete;
+
+		// Returns size bytes aligned to 64 bytes
+		unsigned char* allocate(size_t size)
+		{
+			size_t needed = alignment + ((size + alignment - 1) & ~(alignment - 1));
+			std::lock_guard<std::mutex> lock(mutex);
+			while (current < blocks.size() && blocks[current].size - blocks[current].used < needed)
+			{
+				current++;
+			}
+			if (current == blocks.size())
+			{
+				Block block;
+				block.size = std::max(blockSize, needed);
+				block.memory = static_cast<unsigned char*>(::operator new(block.size, std::align_val_t(alignment)));
+				block.used = 0;
+				blocks.push_back(block);
+			}
+			Block& block = blocks[current];
+			unsigned char* header = &block.memory[block.used];
+			block.used += needed;
+			memcpy(header, &needed, sizeof(needed));
+			allocations++;
+			totalAllocations++;
+			inUse += needed;
+			return header + alignment;
+		}
+
+		// Frees an allocation. The memory is only reused after reset()
+		void deallocate(unsigned char* p)
+		{
+			if (p == nullptr)
+			{
+				return;
+			}
+			size_t needed;
+			memcpy(&needed, p - alignment, sizeof(needed));
+			std::lock_guard<std::mutex> lock(mutex);
+			allocations--;
+			inUse -= needed;
+		}
+
+		// Makes all of the pool's memory reusable, keeping the blocks for the next group of images
+		// Returns false and does nothing if images allocated from the pool are still alive
+		bool reset()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (allocations != 0)
+			{
+				return false;
+			}
+			for (Block& block : blocks)
+			{
+				block.used = 0;
+			}
+			current = 0;
+			return true;
+		}
+
+		// Returns every block to the system. Returns false and does nothing if images allocated from the pool are still alive
+		bool release()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (allocations != 0)
+			{
+				return false;
+			}
+			freeBlocks();
+			return true;
+		}
+
+		// Returns the number of allocations not yet freed
+		unsigned int allocationCount() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return allocations;
+		}
+
+		// Returns the number of allocations made since the pool was created
+		unsigned int totalAllocationCount() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return totalAllocations;
+		}
+
+		// Returns the bytes used by allocations not yet freed, including their headers and padding
+		size_t bytesInUse() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return inUse;
+		}
+
+		// Returns the bytes reserved from the system
+		size_t bytesReserved() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			size_t total = 0;
+			for (const Block& block : blocks)
+			{
+				total += block.size;
+			}
+			return total;
+		}
+
+		// Returns the number of blocks reserved from the system
+		unsigned int blockCount() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return static_cast<unsigned int>(blocks.size());
+		}
+	};
+
+	// The Image class handles loading and manipulating images
+	// This class is a bit of an exception in that the members are public. The reason for this is users may want to create procedural images.
+	class Image
+	{
+	public:
+		unsigned int width;       // Image width
+		unsigned int height;      // Image height
+		unsigned int channels;    // Number of color channels
+		unsigned char* data;      // Pointer to image data
+		ImagePool* pool;          // Pool data is allocated from, or nullptr for new[]. Set it before loading or allocating
+		mutable std::vector<Image> mips;  // Mip levels, each half the size of the one before down to 1 x 1. Empty until built
+		bool lazyMips;            // Build the mip chain the first time the image is drawn shrunk
+		bool external;            // Set when data is owned elsewhere, such as a view into an AssetPack. free() then only forgets it
+
+		// Default constructor
+		Image()
+		{
+			width = 0;
+			height = 0;
+			channels = 0;
+			data = nullptr;
+			pool = nullptr;
+			lazyMips = false;
+			external = false;
+		}
+
+		// Move constructor
+		Image(Image&& other)
+		{
+			width = other.width;
+			height = other.height;
+			channels = other.channels;
+			data = other.data;
+			pool = other.pool;
+			mips = std::move(other.mips);
+			lazyMips = other.lazyMips;
+			external = other.external;
+			other.width = 0;
+			other.height = 0;
+			other.channels = 0;
+			other.data = nullptr;
+			other.external = false;
+		}
+
+		// Move assignment
+		Image& operator=(Image&& other)
+		{
+			if (this != &other)
+			{
+				free();
+				width = other.width;
+				height = other.height;
+				channels = other.channels;
+				data = other.data;
+				pool = other.pool;
+				mips = std::move(other.mips);
+				lazyMips = other.lazyMips;
+				external = other.external;
+				other.external = false;
+				other.width = 0;
+				other.height = 0;
+				other.channels = 0;
+				other.data = nullptr;
+			}
+			return *this;
+		}
+
+		// Remove copy constructors
+		Image(const Image&) = delete;
+		Image& operator=(const Image&) = delete;
+
+		// Loads an image from a file. PNG files are decoded by Codecs::decodePNG on every platform, other formats use WIC on Windows
+		bool load(std::string filename)
+		{
+			free();
+			std::vector<unsigned char> bytes;
+			if (!Codecs::readFile(filename, bytes))
+			{
+				return false;
+			}
+			if (bytes.size() >= 8 && bytes[0] == 0x89 && bytes[1] == 'P' && bytes[2] == 'N' && bytes[3] == 'G')
+			{
+				return loadFromMemory(bytes.data(), bytes.size());
+			}
+			return loadWIC(filename);
+		}
+
+		// Decodes a PNG file held in memory, replacing any existing data
+		bool loadFromMemory(const unsigned char* file, size_t size)
+		{
+			free();
+			std::function<unsigned char*(size_t)> allocate = nullptr;
+			if (pool != nullptr)
+			{
+				allocate = [this](size_t bytes) { return pool->allocate(bytes); };
+			}
+			if (!Codecs::decodePNG(file, size, data, width, height, channels, allocate))
+			{
+				width = 0;
+				height = 0;
+				channels = 0;
+				return false;
+			}
+			return true;
+		}
+
+		// Loads an image from a file using WIC
+		bool loadWIC(std::string filename)
+		{
+#if defined(_WIN32)
+			Microsoft::WRL::ComPtr<IWICImagingFactory> factory;
+			HRESULT hr = ::CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+			if (FAILED(hr))
+			{
+				return false;
+			}
+
+			Microsoft::WRL::ComPtr<IWICBitmapDecoder> decoder;
+			IWICStream* stream = NULL;
+			factory->CreateStream(&stream);
+
+			std::wstring wFilename = std::wstring(filename.begin(), filename.end());
+			stream->InitializeFromFilename(wFilename.c_str(), GENERIC_READ);
+			factory->CreateDecoderFromStream(stream, 0, WICDecodeMetadataCacheOnDemand, &decoder);
+
+			Microsoft::WRL::ComPtr<IWICBitmapFrameDecode> frame;
+			decoder->GetFrame(0, &frame);
+
+			stream->Release();
+
+			frame->GetSize(&width, &height);
+			WICPixelFormatGUID pixelFormat = { 0 };
+			frame->GetPixelFormat(&pixelFormat);
+
+			channels = 0;
+			int isRGB = 0;
+			// Determine the number of channels based on the pixel format
+			if (pixelFormat == GUID_WICPixelFormat24bppBGR)
+			{
+				channels = 3;
+			}
+			if (pixelFormat == GUID_WICPixelFormat32bppBGRA)
+			{
+				channels = 4;
+			}
+			if (pixelFormat == GUID_WICPixelFormat24bppRGB)
+			{
+				channels = 3;
+				isRGB = 1;
+			}
+			if (pixelFormat == GUID_WICPixelFormat32bppRGBA)
+			{
+				channels = 4;
+				isRGB = 1;
+			}
+			if (channels == 0)
+			{
+				return false;
+			}
+
+			allocate(width, height, channels);
+			unsigned int stride = (width * channels + 3) & ~3; // Align stride to 4 bytes
+
+			if (stride == (width * channels))
+			{
+				// Copy pixels directly if stride matches
+				frame->CopyPixels(0, stride, width * height * channels, data);
+			} else
+			{
+				// Handle images with padded stride
+				unsigned char* strideData = new unsigned char[stride * height];
+				frame->CopyPixels(0, stride, width * height * channels, strideData);
+				for (unsigned int i = 0; i < height; i++)
+				{
+					memcpy(&data[i * width * channels], &strideData[i * stride], width * channels * sizeof(unsigned char));
+				}
+				delete[] strideData;
+			}
+
+			if (isRGB == 0)
+			{
+				// Swap red and blue channels for BGR formats
+				Kernels::swapRedBlueRow()(data, width * height, channels);
+			}
+			return true;
+#else
+			// WIC is only available on Windows
+			(void)filename;
+			return false;
+#endif
+		}
+
+		// Returns a pointer to the pixel data at (x, y)
+		// Note, the bounds are handled via clamping
+		unsigned char* at(const unsigned int x, const unsigned int y) const
+		{
+			return &data[((std::min(y, height - 1) * width) + std::min(x, width  - 1)) * channels];
+		}
+
+		// Returns the alpha value of the pixel at (x, y)
+		// Note, the bounds are handled via clamping
+		unsigned char alphaAt(const unsigned int x, const unsigned int y) const
+		{
+			if (channels == 4)
+			{
+				return data[((std::min(y, height - 1) * width) + std::min(x, width - 1)) * channels + 3];
+			}
+			return 255;
+		}
+
+		// Returns a the colour specified by index at (x, y)
+		// Note, the image bounds are handled via clamping, but the index is not checked
+		unsigned char at(const unsigned int x, const unsigned int y, const unsigned int index) const
+		{
+			return data[(((std::min(y, height - 1) * width) + std::min(x, width - 1)) * channels) + index];
+		}
+
+		// Returns a pointer to the pixel data at (x, y)
+		// Note, no checks performed on x and y coordinates
+		unsigned char* atUnchecked(const unsigned int x, const unsigned int y) const
+		{
+			return &data[((y * width) + x) * channels];
+		}
+
+		// Returns the alpha value of the pixel at (x, y)
+		// Note, no checks performed on x and y coordinates
+		unsigned char alphaAtUnchecked(const unsigned int x, const unsigned int y) const
+		{
+			if (channels == 4)
+			{
+				return data[(((y * width) + x) * channels) + 3];
+			}
+			return 255;
+		}
+
+		// Checks if the image has an alpha channel
+		bool hasAlpha() const
+		{
+			return channels == 4;
+		}
+
+		// Replaces the image data with an uninitialised w x h image with _channels channels, taken from pool if one is set
+		void allocate(unsigned int w, unsigned int h, unsigned int _channels)
+		{
+			free();
+			width = w;
+			height = h;
+			channels = _channels;
+			size_t size = static_cast<size_t>(w) * h * _channels;
+			data = pool != nullptr ? pool->allocate(size) : new unsigned char[size];
+		}
+
+		// Builds the mip chain by averaging 2 x 2 blocks of each level into the next, from the same pool as the image
+		// The chain is a cache of the pixels, so it is const. Call freeMips() after changing the pixels
+		void buildMips() const
+		{
+			mips.clear();
+			if (data == nullptr || (channels != 3 && channels != 4))
+			{
+				return;
+			}
+			unsigned int levels = 0;
+			for (unsigned int size = std::max(width, height); size > 1; size /= 2)
+			{
+				levels++;
+			}
+			mips.reserve(levels);
+			Kernels::DownsampleRowFunc downsample = Kernels::downsampleRow();
+			for (unsigned int i = 0; i < levels; i++)
+			{
+				const Image& source = mips.empty() ? *this : mips.back();
+				Image level;
+				level.pool = pool;
+				level.allocate(std::max(1u, source.width / 2), std::max(1u, source.height / 2), channels);
+				for (unsigned int y = 0; y < level.height; y++)
+				{
+					downsample(level.atUnchecked(0, y), source.atUnchecked(0, std::min(y * 2, source.height - 1)), source.atUnchecked(0, std::min((y * 2) + 1, source.height - 1)), level.width, source.width, channels);
+				}
+				mips.push_back(std::move(level));
+			}
+		}
+
+		// Frees the mip chain
+		void freeMips()
+		{
+			mips.clear();
+		}
+
+		// Returns the mip level closest in size to the image drawn at scale, or the image itself when scale is 0.71 or more or there are no mips
+		const Image& mipForScale(float scale) const
+		{
+			if (!(scale > 0.0f) || mips.empty())
+			{
+				return *this;
+			}
+			int level = static_cast<int>(floorf(log2f(1.0f / scale) + 0.5f));
+			if (level <= 0)
+			{
+				return *this;
+			}
+			return mips[std::min(static_cast<size_t>(level), mips.size()) - 1];
+		}
+
+		// Returns the number of bytes used by the mip chain, about a third of the image
+		size_t mipBytes() const
+		{
+			size_t total = 0;
+			for (const Image& level : mips)
+			{
+				total += static_cast<size_t>(level.width) * level.height * level.channels;
+			}
+			return total;
+		}
+
+		// Swaps the red and blue channels, converting between RGB and BGR. Frees the mip chain
+		void swapRedBlue()
+		{
+			if (data == nullptr || (channels != 3 && channels != 4))
+			{
+				return;
+			}
+			freeMips();
+			Kernels::swapRedBlueRow()(data, width * height, channels);
+		}
+
+		// Converts between RGB and RGBA, adding opaque alpha or dropping it. The new data comes from the same pool
+		// Returns false if the image is not RGB or RGBA
+		bool setChannels(unsigned int newChannels)
+		{
+			if (data == nullptr || (channels != 3 && channels != 4) || (newChannels != 3 && newChannels != 4))
+			{
+				return false;
+			}
+			if (newChannels == channels)
+			{
+				return true;
+			}
+			Image converted;
+			converted.pool = pool;
+			converted.lazyMips = lazyMips;
+			converted.allocate(width, height, newChannels);
+			if (newChannels == 4)
+			{
+				Kernels::expandRow32()(converted.data, data, width * height, false);
+			} else
+			{
+				Kernels::packRow24()(converted.data, data, width * height, false);
+			}
+			*this = std::move(converted);
+			return true;
+		}
+
+		// Multiplies the colour of each pixel by its alpha, as needed for correct filtering and additive blending of RGBA images
+		// Returns false if the image has no alpha. Frees the mip chain
+		bool premultiplyAlpha()
+		{
+			if (data == nullptr || channels != 4)
+			{
+				return false;
+			}
+			freeMips();
+			Kernels::premultiplyRow()(data, width * height);
+			return true;
+		}
+
+		// Undoes premultiplyAlpha(). Pixels with zero alpha become black
+		// Returns false if the image has no alpha. Frees the mip chain
+		bool unpremultiplyAlpha()
+		{
+			if (data == nullptr || channels != 4)
+			{
+				return false;
+			}
+			freeMips();
+			Kernels::unpremultiplyRow()(data, width * height);
+			return true;
+		}
+
+		// Writes the luminance of the image to out as a single channel image, allocated from out's pool
+		// Single channel images are for collision and lighting data, they cannot be drawn. Returns false if the image is not RGB or RGBA
+		bool luminance(Image& out) const
+		{
+			if (data == nullptr || (channels != 3 && channels != 4) || &out == this)
+			{
+				return false;
+			}
+			out.allocate(width, height, 1);
+			Kernels::luminanceRow()(out.data, data, width * height, channels);
+			return true;
+		}
+
+		// Frees the allocated image data
+		void free()
+		{
+			mips.clear();
+			if (data != NULL)
+			{
+				if (external)
+				{
+					external = false;
+				} else if (pool != nullptr)
+				{
+					pool->deallocate(data);
+				} else
+				{
+					delete[] data;
+				}
+				data = NULL;
+			}
+		}
+
+		// Destructor to free resources
+		~Image()
+		{
+			free();
+		}
+	};
+
+	// The ImageLoader class loads images on background threads so the game can keep drawing a loading screen
+	// Each load returns a handle. Files are read with at most maxReads at once, then decoded in parallel on the worker threads.
+	// Progress callbacks are run by poll() on the calling thread, so they can safely touch game state.
+	class ImageLoader
+	{
+	public:
+		// Called for each finished load with its handle, whether it succeeded, and the number of loads finished and requested so far
+		typedef std::function<void(unsigned int handle, bool loaded, unsigned int completed, unsigned int total)> ProgressCallback;
+
+	private:
+		// The state of one requested image
+		struct Entry
+		{
+			std::string filename;
+			Image image;
+			bool mips = false;        // Set to build the mip chain after loading
+			bool finished = false;    // Set once the load has succeeded or failed
+			bool loaded = false;      // Set if the image was loaded
+		};
+
+		std::deque<Entry> entries;                    // One entry per handle. A deque so entries stay put as more are added
+		std::vector<unsigned int> queue;              // Handles in the order they were requested
+		size_t next = 0;                              // Position in queue of the next handle to load
+		std::vector<unsigned int> finishedOrder;      // Handles in the order they finished, for poll()
+		size_t reported = 0;                          // Number of finishedOrder entries passed to the callback
+		std::vector<std::thread> threads;             // Worker threads
+		mutable std::mutex mutex;                     // Protects the state above and below
+		std::condition_variable work;                 // Signals workers that a load has been queued
+		std::condition_variable done;                 // Signals that a load has finished
+		std::condition_variable readSlot;             // Signals that a file read has finished
+		unsigned int maxReads;                        // Maximum number of files read at once
+		unsigned int reading = 0;                     // Number of files being read
+		unsigned int completed = 0;                   // Number of loads finished
+		bool quit = false;                            // Set by the destructor
+		ProgressCallback callback;
+
+		// Loads one image. PNG files are read under the read limit and decoded outside it; other formats go through WIC, which reads the file itself
+		bool loadEntry(Entry& entry)
+		{
+			std::vector<unsigned char> bytes;
+			bool isPNG = false;
+			bool ok = false;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				readSlot.wait(lock, [&] { return reading < maxReads; });
+				reading++;
+			}
+			// A failed allocation fails the load, so the read slot below is always released
+			try
+			{
+				if (Codecs::readFile(entry.filename, bytes))
+				{
+					isPNG = bytes.size() >= 8 && bytes[0] == 0x89 && bytes[1] == 'P' && bytes[2] == 'N' && bytes[3] == 'G';
+					if (!isPNG)
+					{
+						ok = entry.image.loadWIC(entry.filename);
+					}
+				}
+			} catch (...)
+			{
+				isPNG = false;
+				ok = false;
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				reading--;
+			}
+			readSlot.notify_one();
+			if (isPNG)
+			{
+				ok = entry.image.loadFromMemory(bytes.data(), bytes.size());
+			}
+			if (ok && entry.mips)
+			{
+				entry.image.buildMips();
+			}
+			return ok;
+		}
+
+		// Main loop of each worker thread. Loads still queued when quit is set are abandoned
+		void workerLoop()
+		{
+#if defined(_WIN32)
+			// WIC needs COM on every thread that uses it
+			HRESULT comResult = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+#endif
+			while (true)
+			{
+				Entry* entry;
+				unsigned int handle;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					work.wait(lock, [&] { return quit || next < queue.size(); });
+					if (quit)
+					{
+						break;
+					}
+					handle = queue[next++];
+					entry = &entries[handle];
+				}
+				// An exception leaving the thread would end the process, so anything thrown while decoding fails the load instead
+				bool ok = false;
+				try
+				{
+					ok = loadEntry(*entry);
+				} catch (...)
+				{
+					entry->image.free();
+				}
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					entry->finished = true;
+					entry->loaded = ok;
+					finishedOrder.push_back(handle);
+					completed++;
+				}
+				done.notify_all();
+			}
+#if defined(_WIN32)
+			if (SUCCEEDED(comResult))
+			{
+				CoUninitialize();
+			}
+#endif
+		}
+
+	public:
+		bool generateMips = false;                    // Build the mip chain of images queued while this is set on the worker thread, after loading
+
+		// Starts threadCount worker threads and allows maxReads files to be read at once
+		// A threadCount of 0 uses one thread per hardware thread
+		ImageLoader(unsigned int threadCount = 0, unsigned int _maxReads = 2)
+		{
+			if (threadCount == 0)
+			{
+				threadCount = std::max(1u, std::thread::hardware_concurrency());
+			}
+			maxReads = std::max(1u, _maxReads);
+			for (unsigned int i = 0; i < threadCount; i++)
+			{
+				threads.emplace_back(&ImageLoader::workerLoop, this);
+			}
+		}
+
+		// Waits for loads in progress, abandons queued ones and stops the worker threads
+		~ImageLoader()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				quit = true;
+			}
+			work.notify_all();
+			for (std::thread& thread : threads)
+			{
+				thread.join();
+			}
+		}
+
+		ImageLoader(const ImageLoader&) = delete;
+		ImageLoader& operator=(const ImageLoader&) = delete;
+
+		// Sets the function poll() calls for every finished load
+		void setProgressCallback(ProgressCallback _callback)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			callback = _callback;
+		}
+
+		// Queues an image to be loaded and returns its handle. The pixels are allocated from pool if one is given
+		unsigned int loadAsync(const std::string& filename, ImagePool* pool = nullptr)
+		{
+			unsigned int handle;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				handle = static_cast<unsigned int>(entries.size());
+				entries.emplace_back();
+				entries.back().filename = filename;
+				entries.back().image.pool = pool;
+				entries.back().mips = generateMips;
+				queue.push_back(handle);
+			}
+			work.notify_one();
+			return handle;
+		}
+
+		// Queues a list of images to be loaded and returns their handles in the same order. The pixels are allocated from pool if one is given
+		std::vector<unsigned int> loadBatch(const std::vector<std::string>& filenames, ImagePool* pool = nullptr)
+		{
+			std::vector<unsigned int> handles;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (const std::string& filename : filenames)
+				{
+					handles.push_back(static_cast<unsigned int>(entries.size()));
+					entries.emplace_back();
+					entries.back().filename = filename;
+					entries.back().image.pool = pool;
+					entries.back().mips = generateMips;
+					queue.push_back(handles.back());
+				}
+			}
+			work.notify_all();
+			return handles;
+		}
+
+		// Runs the progress callback for every load finished since the last call. Call this once a frame from the game thread
+		void poll()
+		{
+			std::vector<unsigned int> handles;
+			std::vector<bool> results;
+			unsigned int first;
+			unsigned int total;
+			ProgressCallback current;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				first = static_cast<unsigned int>(reported);
+				for (; reported < finishedOrder.size(); reported++)
+				{
+					handles.push_back(finishedOrder[reported]);
+					results.push_back(entries[finishedOrder[reported]].loaded);
+				}
+				total = static_cast<unsigned int>(entries.size());
+				current = callback;
+			}
+			if (current)
+			{
+				for (unsigned int i = 0; i < handles.size(); i++)
+				{
+					current(handles[i], results[i], first + i + 1, total);
+				}
+			}
+		}
+
+		// Returns true if the load has finished, whether or not it succeeded
+		bool ready(unsigned int handle) const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return handle < entries.size() && entries[handle].finished;
+		}
+
+		// Waits for a load to finish and returns true if the image was loaded
+		bool wait(unsigned int handle)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (handle >= entries.size())
+			{
+				return false;
+			}
+			done.wait(lock, [&] { return entries[handle].finished; });
+			return entries[handle].loaded;
+		}
+
+		// Waits for every queued load to finish, then runs poll()
+		void waitAll()
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				done.wait(lock, [&] { return completed == entries.size(); });
+			}
+			poll();
+		}
+
+		// Waits for a load and returns its image. The image stays owned by the loader, and is empty if the load failed
+		Image& get(unsigned int handle)
+		{
+			wait(handle);
+			std::lock_guard<std::mutex> lock(mutex);
+			return entries[handle].image;
+		}
+
+		// Waits for a load and moves its image into image. Returns false if the load failed
+		bool take(unsigned int handle, Image& image)
+		{
+			if (!wait(handle))
+			{
+				return false;
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			image = std::move(entries[handle].image);
+			return true;
+		}
+
+		// Returns the number of loads finished
+		unsigned int completedCount() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return completed;
+		}
+
+		// Returns the number of loads requested
+		unsigned int totalCount() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return static_cast<unsigned int>(entries.size());
+		}
+
+		// Returns the fraction of requested loads that have finished, 1 when nothing has been requested
+		float progress() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return entries.empty() ? 1.0f : static_cast<float>(completed) / static_cast<float>(entries.size());
+		}
+	};
+
+	// The ImageManager class caches images by filename, so each file is decoded once however often it is asked for
+	// Images are handed out by handle. Under a memory budget the least recently used images are freed, and reloaded when they are next asked for.
+	// References returned by get() stay valid until the next newFrame() call, because images used since then are never evicted.
+	class ImageManager
+	{
+	private:
+		// A cached image
+		struct Entry
+		{
+			std::string filename;
+			Image image;
+			unsigned int lastUsed = 0;   // Frame the image was last asked for
+			bool resident = false;       // Set while the image is loaded
+		};
+
+		std::deque<Entry> entries;                    // One entry per handle. A deque so images stay put as more are added
+		std::map<std::string, unsigned int> lookup;   // Handle of each filename
+		unsigned int frame = 1;                       // Current frame, advanced by newFrame()
+		size_t budget = 0;                            // Resident byte limit, or 0 for no limit
+		size_t resident = 0;                          // Bytes of pixels currently loaded
+		unsigned int hits = 0;                        // Requests for images already loaded
+		unsigned int misses = 0;                      // Requests that had to decode the file
+		unsigned int evictions = 0;                   // Images freed to stay within the budget
+		Image empty;                                  // Returned for handles that fail to reload
+
+		// Returns the number of bytes of an image's pixels
+		static size_t imageBytes(const Image& image)
+		{
+			return static_cast<size_t>(image.width) * image.height * image.channels;
+		}
+
+		// Decodes an entry's file. Returns false if it could not be loaded
+		bool decode(Entry& entry)
+		{
+			misses++;
+			if (!entry.image.load(entry.filename))
+			{
+				return false;
+			}
+			entry.resident = true;
+			resident += imageBytes(entry.image);
+			return true;
+		}
+
+		// Frees the least recently used images not used this frame until the resident bytes fit the budget
+		void evict()
+		{
+			if (budget == 0 || resident <= budget)
+			{
+				return;
+			}
+			std::vector<unsigned int> candidates;
+			for (unsigned int i = 0; i < entries.size(); i++)
+			{
+				if (entries[i].resident && entries[i].lastUsed != frame)
+				{
+					candidates.push_back(i);
+				}
+			}
+			std::sort(candidates.begin(), candidates.end(), [&](unsigned int a, unsigned int b) { return entries[a].lastUsed < entries[b].lastUsed; });
+			for (unsigned int i = 0; i < candidates.size() && resident > budget; i++)
+			{
+				Entry& entry = entries[candidates[i]];
+				resident -= imageBytes(entry.image);
+				entry.image.free();
+				entry.resident = false;
+				evictions++;
+			}
+		}
+
+	public:
+		// Returns the handle of an image, loading it if it is not cached. Returns -1 if the file could not be loaded
+		int load(const std::string& filename)
+		{
+			std::map<std::string, unsigned int>::const_iterator it = lookup.find(filename);
+			if (it != lookup.end())
+			{
+				get(it->second);
+				return static_cast<int>(it->second);
+			}
+			Entry entry;
+			entry.filename = filename;
+			entry.lastUsed = frame;
+			if (!decode(entry))
+			{
+				return -1;
+			}
+			unsigned int handle = static_cast<unsigned int>(entries.size());
+			entries.push_back(std::move(entry));
+			lookup[filename] = handle;
+			evict();
+			return static_cast<int>(handle);
+		}
+
+		// Returns the image of a handle, reloading it if it was evicted, and marks it as used this frame
+		// The returned image is empty if it was evicted and could not be reloaded
+		const Image& get(unsigned int handle)
+		{
+			Entry& entry = entries[handle];
+			entry.lastUsed = frame;
+			if (entry.resident)
+			{
+				hits++;
+				return entry.image;
+			}
+			if (!decode(entry))
+			{
+				return empty;
+			}
+			evict();
+			return entry.image;
+		}
+
+		// Starts a new frame. Images not used since the last call may now be evicted, so earlier references from get() must not be kept
+		void newFrame()
+		{
+			frame++;
+			evict();
+		}
+
+		// Sets the resident byte limit. 0 means no limit. Images used this frame are kept even if that exceeds it
+		void setBudget(size_t bytes)
+		{
+			budget = bytes;
+			evict();
+		}
+
+		// Returns the resident byte limit
+		size_t getBudget() const
+		{
+			return budget;
+		}
+
+		// Returns the bytes of pixels currently loaded
+		size_t residentBytes() const
+		{
+			return resident;
+		}
+
+		// Returns the number of handles
+		unsigned int count() const
+		{
+			return static_cast<unsigned int>(entries.size());
+		}
+
+		// Returns the number of requests for images already loaded
+		unsigned int hitCount() const
+		{
+			return hits;
+		}
+
+		// Returns the number of requests that had to decode a file, including first loads and reloads after eviction
+		unsigned int missCount() const
+		{
+			return misses;
+		}
+
+		// Returns the number of images freed to stay within the budget
+		unsigned int evictionCount() const
+		{
+			return evictions;
+		}
+
+		// Resets the hit, miss and eviction counters
+		void resetCounters()
+		{
+			hits = 0;
+			misses = 0;
+			evictions = 0;
+		}
+
+		// Frees every image and forgets every handle
+		void clear()
+		{
+			entries.clear();
+			lookup.clear();
+			resident = 0;
+		}
+	};
+
+	// The CompiledSprite class stores an alpha tested image as runs of opaque pixels
+	// The alpha test is done once when the sprite is built, so drawing is a memcpy per run with no per pixel checks. This suits large sprites with lots of transparency.
+	class CompiledSprite
+	{
+	private:
+		// A horizontal run of opaque pixels within a row
+		struct Span
+		{
+			unsigned int x;        // Start of the run within the row
+			unsigned int length;   // Number of pixels in the run
+			unsigned int offset;   // Offset of the run's first byte in pixels
+		};
+
+		std::vector<Span> spans;            // Runs of all rows, in row order
+		std::vector<unsigned int> rows;     // Index of the first run of each row, plus one entry marking the end
+		std::vector<unsigned char> pixels;  // Packed RGB data of all runs
+
+	public:
+		unsigned int width = 0;   // Width of the source image
+		unsigned int height = 0;  // Height of the source image
+
+		// Builds the runs from an image. Pixels with an alpha value less than or equal to alphaThreshold are left out.
+		// Images without an alpha channel become a single run per row
+		bool build(const Image& image, unsigned char alphaThreshold = 0)
+		{
+			spans.clear();
+			rows.clear();
+			pixels.clear();
+			width = 0;
+			height = 0;
+			if (image.data == nullptr || (image.channels != 3 && image.channels != 4))
+			{
+				return false;
+			}
+			width = image.width;
+			height = image.height;
+			rows.reserve(height + 1);
+			for (unsigned int y = 0; y < height; y++)
+			{
+				rows.push_back(static_cast<unsigned int>(spans.size()));
+				unsigned int x = 0;
+				while (x < width)
+				{
+					// Skip transparent pixels, then measure the opaque run that follows
+					while (x < width && image.alphaAtUnchecked(x, y) <= alphaThreshold)
+					{
+						x++;
+					}
+					unsigned int start = x;
+					while (x < width && image.alphaAtUnchecked(x, y) > alphaThreshold)
+					{
+						x++;
+					}
+					if (x > start)
+					{
+						Span span;
+						span.x = start;
+						span.length = x - start;
+						span.offset = static_cast<unsigned int>(pixels.size());
+						for (unsigned int i = start; i < x; i++)
+						{
+							unsigned char* p = image.atUnchecked(i, y);
+							pixels.push_back(p[0]);
+							pixels.push_back(p[1]);
+							pixels.push_back(p[2]);
+						}
+						spans.push_back(span);
+					}
+				}
+			}
+			rows.push_back(static_cast<unsigned int>(spans.size()));
+			return true;
+		}
+
+		// Copies the sprite into pixel memory with the given pitch and format, with its top left corner at (x, y)
+		// The sprite is clipped against a destWidth x destHeight destination
+		void draw(unsigned char* dest, unsigned int destWidth, unsigned int destHeight, unsigned int destPitch, int x, int y, PixelFormat destFormat = PixelRGB888) const
+		{
+			int y0 = std::max(0, -y);
+			int y1 = std::min(static_cast<int>(height), static_cast<int>(destHeight) - y);
+			Kernels::ConvertRowFunc expand = Kernels::expandRow32();
+			for (int row = y0; row < y1; row++)
+			{
+				unsigned char* destRow = &dest[(row + y) * destPitch];
+				for (unsigned int i = rows[row]; i < rows[row + 1]; i++)
+				{
+					const Span& span = spans[i];
+					int start = x + static_cast<int>(span.x);
+					int end = start + static_cast<int>(span.length);
+					int skip = std::max(0, -start);
+					end = std::min(end, static_cast<int>(destWidth));
+					if (start + skip >= end)
+					{
+						continue;
+					}
+					if (destFormat == PixelRGB888)
+					{
+						memcpy(&destRow[(start + skip) * 3], &pixels[span.offset + (skip * 3)], (end - start - skip) * 3);
+					} else
+					{
+						expand(&destRow[(start + skip) * 4], &pixels[span.offset + (skip * 3)], end - start - skip, destFormat == PixelBGRX8888);
+					}
+				}
+			}
+		}
+
+		// Returns the number of runs
+		unsigned int spanCount() const
+		{
+			return static_cast<unsigned int>(spans.size());
+		}
+
+		// Returns the number of opaque pixels stored
+		unsigned int pixelCount() const
+		{
+			return static_cast<unsigned int>(pixels.size() / 3);
+		}
+	};
+
+	// The CollisionMask class stores which pixels of an image are solid as one bit per pixel, packed into 64 bit words per row
+	// Two masks are tested against each other a word at a time, 64 pixel pairs per AND, within the overlap of their solid bounding boxes. This makes pixel perfect collision cheap enough for thousands of tests per frame.
+	class CollisionMask
+	{
+	private:
+		std::vector<uint64_t> bits;   // Rows of words. Bit i of word w is set when pixel (w * 64) + i is solid. Bits past the width are zero
+		unsigned int words = 0;       // Number of words per row
+		int left = 0;                 // Bounding box of the solid pixels, with right and bottom exclusive. Empty when nothing is solid
+		int top = 0;
+		int right = 0;
+		int bottom = 0;
+
+		// Returns the number of set bits
+		static unsigned int popCount(uint64_t v)
+		{
+#if defined(_MSC_VER) && !defined(__clang__)
+			v = v - ((v >> 1) & 0x5555555555555555ULL);
+			v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+			v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+			return static_cast<unsigned int>((v * 0x0101010101010101ULL) >> 56);
+#else
+			return static_cast<unsigned int>(__builtin_popcountll(v));
+#endif
+		}
+
+		// Returns word w of a row of other, or 0 outside the row
+		uint64_t wordOf(const uint64_t* row, int w) const
+		{
+			return (w >= 0 && w < static_cast<int>(words)) ? row[w] : 0;
+		}
+
+		// ANDs this mask with other placed at (dx, dy) and returns the number of overlapping solid pixels
+		// With stopAtFirst the scan ends at the first overlap in row order, which is stored in firstX and firstY, and 1 is returned
+		unsigned int scan(const CollisionMask& other, int dx, int dy, bool stopAtFirst, int* firstX, int* firstY) const
+		{
+			int x0 = std::max(left, other.left + dx);
+			int x1 = std::min(right, other.right + dx);
+			int y0 = std::max(top, other.top + dy);
+			int y1 = std::min(bottom, other.bottom + dy);
+			if (x0 >= x1 || y0 >= y1)
+			{
+				return 0;
+			}
+			// Pixel x of this mask is pixel x - dx of other. Split -dx into whole words and a shift within a word
+			int wordOffset = (-dx) >= 0 ? (-dx) / 64 : -((dx + 63) / 64);
+			unsigned int shift = static_cast<unsigned int>(-dx - (wordOffset * 64));
+			int w0 = x0 / 64;
+			int w1 = (x1 - 1) / 64;
+			unsigned int total = 0;
+			for (int y = y0; y < y1; y++)
+			{
+				const uint64_t* rowA = &bits[static_cast<size_t>(y) * words];
+				const uint64_t* rowB = &other.bits[static_cast<size_t>(y - dy) * other.words];
+				for (int w = w0; w <= w1; w++)
+				{
+					uint64_t b = other.wordOf(rowB, w + wordOffset) >> shift;
+					if (shift != 0)
+					{
+						b |= other.wordOf(rowB, w + wordOffset + 1) << (64 - shift);
+					}
+					uint64_t hit = rowA[w] & b;
+					if (!stopAtFirst)
+					{
+						// Counting every word without testing it first avoids a hard to predict branch
+						total += popCount(hit);
+					} else if (hit != 0)
+					{
+						if (firstX != nullptr)
+						{
+							*firstX = (w * 64) + static_cast<int>(popCount((hit & (0 - hit)) - 1));
+							*firstY = y;
+						}
+						return 1;
+					}
+				}
+			}
+			return total;
+		}
+
+	public:
+		unsigned int width = 0;   // Width of the source image
+		unsigned int height = 0;  // Height of the source image
+
+		// Builds the mask from an image. Pixels with an alpha value greater than alphaThreshold are solid, matching what blit draws.
+		// Images without an alpha channel are solid everywhere
+		bool build(const Image& image, unsigned char alphaThreshold = 0)
+		{
+			bits.clear();
+			width = 0;
+			height = 0;
+			words = 0;
+			left = top = right = bottom = 0;
+			if (image.data == nullptr || (image.channels != 3 && image.channels != 4))
+			{
+				return false;
+			}
+			width = image.width;
+			height = image.height;
+			words = (width + 63) / 64;
+			bits.assign(static_cast<size_t>(words) * height, 0);
+			left = static_cast<int>(width);
+			top = static_cast<int>(height);
+			for (unsigned int y = 0; y < height; y++)
+			{
+				uint64_t* row = &bits[static_cast<size_t>(y) * words];
+				for (unsigned int x = 0; x < width; x++)
+				{
+					if (image.alphaAtUnchecked(x, y) > alphaThreshold)
+					{
+						row[x / 64] |= static_cast<uint64_t>(1) << (x % 64);
+						left = std::min(left, static_cast<int>(x));
+						right = std::max(right, static_cast<int>(x) + 1);
+						top = std::min(top, static_cast<int>(y));
+						bottom = static_cast<int>(y) + 1;
+					}
+				}
+			}
+			if (right == 0)
+			{
+				left = top = 0;
+			}
+			return true;
+		}
+
+		// Returns whether the pixel at (x, y) is solid. Pixels outside the mask are not
+		bool solidAt(int x, int y) const
+		{
+			if (x < 0 || y < 0 || x >= static_cast<int>(width) || y >= static_cast<int>(height))
+			{
+				return false;
+			}
+			return ((bits[(static_cast<size_t>(y) * words) + (x / 64)] >> (x % 64)) & 1) != 0;
+		}
+
+		// Returns whether any solid pixel of this mask overlaps a solid pixel of other, with other's top left corner at (dx, dy) relative to this mask's
+		bool overlaps(const CollisionMask& other, int dx, int dy) const
+		{
+			return scan(other, dx, dy, true, nullptr, nullptr) != 0;
+		}
+
+		// Finds the first overlapping solid pixel in row order, like overlaps(), and stores its position in this mask's coordinates in x and y
+		// Returns false, leaving x and y unchanged, when the masks do not touch
+		bool firstContact(const CollisionMask& other, int dx, int dy, int& x, int& y) const
+		{
+			return scan(other, dx, dy, true, &x, &y) != 0;
+		}
+
+		// Returns the number of solid pixels of this mask that overlap solid pixels of other placed at (dx, dy)
+		unsigned int overlapCount(const CollisionMask& other, int dx, int dy) const
+		{
+			return scan(other, dx, dy, false, nullptr, nullptr);
+		}
+
+		// Returns the number of solid pixels
+		unsigned int solidCount() const
+		{
+			unsigned int total = 0;
+			for (uint64_t word : bits)
+			{
+				total += popCount(word);
+			}
+			return total;
+		}
+	};
+
+	// The IndexedImage class stores an image as one 8 bit palette index per pixel plus a palette of up to 256 colors
+	// It uses a third to a quarter of the memory of an Image and is expanded through the palette while it is drawn, so changing palette entries recolors every later draw without rebuilding the image.
+	// Like Image the members are public so images and palettes can be created procedurally.
+	class IndexedImage
+	{
+	private:
+		// A range of histogram entries split by the median cut
+		struct Box
+		{
+			unsigned int begin;
+			unsigned int end;
+			unsigned int channel;        // Channel with the widest range of values
+			unsigned int range;          // Width of that range
+		};
+
+		// A color found in the source image while building the palette
+		struct Entry
+		{
+			uint32_t key;                // Color with red in the lowest byte, reduced to 5 bits per channel when quantizing
+			unsigned int count;          // Number of pixels with the color
+			uint64_t sum[3];             // Sum of the full precision channels of those pixels
+		};
+
+		// Finds the channel of the entries in the box with the widest range of values
+		static void measure(const std::vector<Entry>& entries, Box& box)
+		{
+			unsigned int lo[3] = { 255, 255, 255 };
+			unsigned int hi[3] = { 0, 0, 0 };
+			for (unsigned int i = box.begin; i < box.end; i++)
+			{
+				for (unsigned int c = 0; c < 3; c++)
+				{
+					unsigned int v = static_cast<unsigned int>(entries[i].sum[c] / entries[i].count);
+					lo[c] = std::min(lo[c], v);
+					hi[c] = std::max(hi[c], v);
+				}
+			}
+			box.channel = 0;
+			for (unsigned int c = 1; c < 3; c++)
+			{
+				if (hi[c] - lo[c] > hi[box.channel] - lo[box.channel])
+				{
+					box.channel = c;
+				}
+			}
+			box.range = hi[box.channel] - lo[box.channel];
+		}
+
+		// Splits entries into at most maxColors boxes with the median cut algorithm and fills the palette with the average color of each box
+		// On return lookup[key] holds the palette index of every entry, offset by first
+		void medianCut(std::vector<Entry>& entries, unsigned int maxColors, unsigned int first, std::vector<unsigned char>& lookup)
+		{
+			std::vector<Box> boxes;
+			boxes.push_back({ 0, static_cast<unsigned int>(entries.size()), 0, 0 });
+			measure(entries, boxes[0]);
+			while (boxes.size() < maxColors)
+			{
+				// Split the box with the widest channel range at the median pixel along that channel
+				int best = -1;
+				for (unsigned int b = 0; b < boxes.size(); b++)
+				{
+					if (boxes[b].end - boxes[b].begin > 1 && (best < 0 || boxes[b].range > boxes[best].range))
+					{
+						best = static_cast<int>(b);
+					}
+				}
+				if (best < 0)
+				{
+					break;
+				}
+				Box box = boxes[best];
+				unsigned int channel = box.channel;
+				std::sort(entries.begin() + box.begin, entries.begin() + box.end, [&](const Entry& a, const Entry& b) { return (a.sum[channel] / a.count) < (b.sum[channel] / b.count); });
+				uint64_t total = 0;
+				for (unsigned int i = box.begin; i < box.end; i++)
+				{
+					total += entries[i].count;
+				}
+				uint64_t running = 0;
+				unsigned int split = box.begin + 1;
+				for (unsigned int i = box.begin; i < box.end - 1; i++)
+				{
+					running += entries[i].count;
+					split = i + 1;
+					if (running * 2 >= total)
+					{
+						break;
+					}
+				}
+				boxes[best].end = split;
+				measure(entries, boxes[best]);
+				boxes.push_back({ split, box.end, 0, 0 });
+				measure(entries, boxes.back());
+			}
+			for (unsigned int b = 0; b < boxes.size(); b++)
+			{
+				uint64_t sum[3] = { 0, 0, 0 };
+				uint64_t count = 0;
+				for (unsigned int i = boxes[b].begin; i < boxes[b].end; i++)
+				{
+					for (unsigned int c = 0; c < 3; c++)
+					{
+						sum[c] += entries[i].sum[c];
+					}
+					count += entries[i].count;
+					lookup[entries[i].key] = static_cast<unsigned char>(first + b);
+				}
+				for (unsigned int c = 0; c < 3; c++)
+				{
+					palette[first + b][c] = static_cast<unsigned char>((sum[c] + (count / 2)) / count);
+				}
+			}
+			colors = first + static_cast<unsigned int>(boxes.size());
+		}
+
+	public:
+		unsigned int width = 0;                  // Image width
+		unsigned int height = 0;                 // Image height
+		std::vector<unsigned char> indices;      // Palette index of every pixel, row by row
+		unsigned char palette[256][3] = {};      // RGB color of each index
+		unsigned int colors = 0;                 // Number of palette entries used by the image. Blits only read entries below this, so raise it when adding colors procedurally
+		bool transparentZero = false;            // When true pixels with index 0 are not drawn
+
+		// Builds the indices and palette from an image. Images with few enough colors keep them exactly, others are reduced to 256 colors by median cut
+		// With _transparentZero, index 0 is kept for pixels with an alpha value less than or equal to alphaThreshold and the colors use indices 1-255
+		bool build(const Image& image, bool _transparentZero = false, unsigned char alphaThreshold = 0)
+		{
+			width = 0;
+			height = 0;
+			colors = 0;
+			indices.clear();
+			memset(palette, 0, sizeof(palette));
+			transparentZero = _transparentZero;
+			if (image.data == nullptr || (image.channels != 3 && image.channels != 4))
+			{
+				return false;
+			}
+			width = image.width;
+			height = image.height;
+			unsigned int first = transparentZero ? 1 : 0;
+			unsigned int maxColors = 256 - first;
+			unsigned int pixelCount = width * height;
+
+			// Gather the distinct colors of the visible pixels
+			std::vector<uint32_t> keys;
+			keys.reserve(pixelCount);
+			for (unsigned int i = 0; i < pixelCount; i++)
+			{
+				const unsigned char* p = &image.data[i * image.channels];
+				if (!transparentZero || image.channels == 3 || p[3] > alphaThreshold)
+				{
+					keys.push_back(static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16));
+				}
+			}
+			std::sort(keys.begin(), keys.end());
+			keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+			indices.resize(pixelCount);
+			if (keys.size() <= maxColors)
+			{
+				// Few enough colors to keep them all
+				for (unsigned int i = 0; i < keys.size(); i++)
+				{
+					palette[first + i][0] = static_cast<unsigned char>(keys[i] & 0xFF);
+					palette[first + i][1] = static_cast<unsigned char>((keys[i] >> 8) & 0xFF);
+					palette[first + i][2] = static_cast<unsigned char>((keys[i] >> 16) & 0xFF);
+				}
+				colors = first + static_cast<unsigned int>(keys.size());
+				for (unsigned int i = 0; i < pixelCount; i++)
+				{
+					const unsigned char* p = &image.data[i * image.channels];
+					if (transparentZero && image.channels == 4 && p[3] <= alphaThreshold)
+					{
+						indices[i] = 0;
+						continue;
+					}
+					uint32_t key = static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16);
+					indices[i] = static_cast<unsigned char>(first + (std::lower_bound(keys.begin(), keys.end(), key) - keys.begin()));
+				}
+				return true;
+			}
+
+			// Too many colors, so build a histogram of colors reduced to 5 bits per channel and split it by median cut
+			std::vector<Entry> histogram(32768);
+			for (unsigned int i = 0; i < pixelCount; i++)
+			{
+				const unsigned char* p = &image.data[i * image.channels];
+				if (transparentZero && image.channels == 4 && p[3] <= alphaThreshold)
+				{
+					continue;
+				}
+				Entry& e = histogram[(p[0] >> 3) | ((p[1] >> 3) << 5) | ((p[2] >> 3) << 10)];
+				e.count++;
+				e.sum[0] += p[0];
+				e.sum[1] += p[1];
+				e.sum[2] += p[2];
+			}
+			std::vector<Entry> entries;
+			for (unsigned int key = 0; key < histogram.size(); key++)
+			{
+				if (histogram[key].count != 0)
+				{
+					histogram[key].key = key;
+					entries.push_back(histogram[key]);
+				}
+			}
+			std::vector<unsigned char> lookup(32768, 0);
+			medianCut(entries, maxColors, first, lookup);
+			for (unsigned int i = 0; i < pixelCount; i++)
+			{
+				const unsigned char* p = &image.data[i * image.channels];
+				if (transparentZero && image.channels == 4 && p[3] <= alphaThreshold)
+				{
+					indices[i] = 0;
+				} else
+				{
+					indices[i] = lookup[(p[0] >> 3) | ((p[1] >> 3) << 5) | ((p[2] >> 3) << 10)];
+				}
+			}
+			return true;
+		}
+
+		// Loads an image file and builds the indices and palette from it
+		bool load(const std::string& filename, bool _transparentZero = false, unsigned char alphaThreshold = 0)
+		{
+			Image image;
+			if (!image.load(filename))
+			{
+				return false;
+			}
+			return build(image, _transparentZero, alphaThreshold);
+		}
+
+		// Sets the color of a palette entry, counting it as used
+		void setColor(unsigned char index, unsigned char r, unsigned char g, unsigned char b)
+		{
+			palette[index][0] = r;
+			palette[index][1] = g;
+			palette[index][2] = b;
+			colors = std::max(colors, static_cast<unsigned int>(index) + 1);
+		}
+
+		// Rotates the count palette entries starting at first by steps places, for color cycling effects
+		void cyclePalette(unsigned char first, unsigned int count, int steps = 1)
+		{
+			count = std::min(count, 256u - first);
+			if (count < 2)
+			{
+				return;
+			}
+			unsigned int shift = static_cast<unsigned int>(((steps % static_cast<int>(count)) + static_cast<int>(count)) % static_cast<int>(count));
+			unsigned char* entries = &palette[0][0];
+			std::rotate(entries + (first * 3), entries + ((first + count - shift) * 3), entries + ((first + count) * 3));
+		}
+
+		// Returns the palette index at (x, y)
+		// Note, the bounds are handled via clamping
+		unsigned char at(const unsigned int x, const unsigned int y) const
+		{
+			return indices[(std::min(y, height - 1) * width) + std::min(x, width - 1)];
+		}
+
+		// Returns a pointer to the palette index at (x, y)
+		// Note, no checks performed on x and y coordinates
+		const unsigned char* atUnchecked(const unsigned int x, const unsigned int y) const
+		{
+			return &indices[(y * width) + x];
+		}
+	};
+
+	// A rectangle of an atlas image holding one packed sprite
+	struct AtlasRegion
+	{
+		unsigned int x = 0;
+		unsigned int y = 0;
+		unsigned int width = 0;
+		unsigned int height = 0;
+	};
+
+	// The TextureAtlas class packs many images into one large image, so drawing a scene reads from one allocation instead of hundreds
+	// Images are packed with a skyline bottom left packer, tallest first. Each gets a handle, the order it was added, which maps to its region of the atlas image.
+	// An atlas can be saved once it is built and loaded later, so packing can be done offline.
+	class TextureAtlas
+	{
+	private:
+		// A segment of the skyline: the top of the packed area from x to x + width is at height y
+		struct Segment
+		{
+			unsigned int x;
+			unsigned int y;
+			unsigned int width;
+		};
+
+		std::vector<const Image*> sources;            // Images added since the last clear(), which must stay alive until build() is called
+		std::vector<std::string> names;               // Name of each handle, possibly empty
+		std::map<std::string, unsigned int> lookup;   // Handle of each non empty name
+
+		// Packs rectangles of the given sizes into an atlas width wide, recording their positions. Returns the height used, or 0 if they do not fit in maxHeight
+		static unsigned int pack(const std::vector<unsigned int>& order, const std::vector<AtlasRegion>& sizes, unsigned int width, unsigned int maxHeight, std::vector<AtlasRegion>& placed)
+		{
+			std::vector<Segment> skyline;
+			skyline.push_back({ 0, 0, width });
+			unsigned int used = 0;
+			for (unsigned int index : order)
+			{
+				unsigned int w = sizes[index].width;
+				unsigned int h = sizes[index].height;
+				if (w == 0 || h == 0)
+				{
+					placed[index] = AtlasRegion();
+					continue;
+				}
+
+				// Find the segment where the rectangle's bottom edge would be lowest, then leftmost
+				size_t best = skyline.size();
+				unsigned int bestTop = 0;
+				unsigned int bestY = 0;
+				for (size_t i = 0; i < skyline.size(); i++)
+				{
+					if (skyline[i].x + w > width)
+					{
+						break;
+					}
+					unsigned int y = 0;
+					unsigned int covered = 0;
+					for (size_t j = i; covered < w; j++)
+					{
+						y = std::max(y, skyline[j].y);
+						covered += skyline[j].width;
+					}
+					if (y + h <= maxHeight && (best == skyline.size() || y + h < bestTop))
+					{
+						best = i;
+						bestTop = y + h;
+						bestY = y;
+					}
+				}
+				if (best == skyline.size())
+				{
+					return 0;
+				}
+				unsigned int x = skyline[best].x;
+				placed[index].x = x;
+				placed[index].y = bestY;
+				placed[index].width = w;
+				placed[index].height = h;
+				used = std::max(used, bestTop);
+
+				// Raise the skyline under the rectangle, trimming the segments it covers
+				skyline.insert(skyline.begin() + best, { x, bestTop, w });
+				size_t i = best + 1;
+				while (i < skyline.size() && skyline[i].x < x + w)
+				{
+					unsigned int end = skyline[i].x + skyline[i].width;
+					if (end <= x + w)
+					{
+						skyline.erase(skyline.begin() + i);
+					} else
+					{
+						skyline[i].width = end - (x + w);
+						skyline[i].x = x + w;
+						break;
+					}
+				}
+				// Join neighbouring segments at the same height
+				for (i = 0; i + 1 < skyline.size();)
+				{
+					if (skyline[i].y == skyline[i + 1].y)
+					{
+						skyline[i].width += skyline[i + 1].width;
+						skyline.erase(skyline.begin() + i + 1);
+					} else
+					{
+						i++;
+					}
+				}
+			}
+			return std::max(used, 1u);
+		}
+
+	public:
+		Image image;                       // The packed images
+		std::vector<AtlasRegion> regions;  // Region of the atlas image holding each handle
+
+		// Adds an image to be packed by the next build() and returns its handle. The image must stay alive until then
+		// An optional name lets the handle be found again with find(), for example after load()
+		unsigned int add(const Image& source, const std::string& name = "")
+		{
+			unsigned int handle = static_cast<unsigned int>(names.size());
+			sources.push_back(&source);
+			names.push_back(name);
+			if (!name.empty())
+			{
+				lookup[name] = handle;
+			}
+			return handle;
+		}
+
+		// Packs every image added since clear() into one image at most maxWidth x maxHeight, leaving padding pixels between them
+		// The narrowest power of two width that fits is used. Returns false if the images do not fit, or if the atlas was loaded rather than built
+		bool build(unsigned int maxWidth = 4096, unsigned int maxHeight = 4096, unsigned int padding = 0)
+		{
+			image.free();
+			regions.clear();
+			if (sources.size() != names.size())
+			{
+				return false;
+			}
+
+			// The atlas has an alpha channel if any image does
+			unsigned int channels = 3;
+			uint64_t area = 0;
+			unsigned int widest = 1;
+			std::vector<AtlasRegion> sizes(sources.size());
+			for (size_t i = 0; i < sources.size(); i++)
+			{
+				const Image& source = *sources[i];
+				if (source.data != nullptr && source.channels != 3 && source.channels != 4)
+				{
+					return false;
+				}
+				if (source.channels == 4)
+				{
+					channels = 4;
+				}
+				if (source.data != nullptr)
+				{
+					sizes[i].width = source.width + padding;
+					sizes[i].height = source.height + padding;
+				}
+				area += static_cast<uint64_t>(sizes[i].width) * sizes[i].height;
+				widest = std::max(widest, sizes[i].width);
+			}
+			if (widest > maxWidth)
+			{
+				return false;
+			}
+
+			// Tallest first, then widest, packs most tightly
+			std::vector<unsigned int> order(sources.size());
+			for (unsigned int i = 0; i < order.size(); i++)
+			{
+				order[i] = i;
+			}
+			std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b)
+			{
+				return sizes[a].height != sizes[b].height ? sizes[a].height > sizes[b].height : sizes[a].width > sizes[b].width;
+			});
+
+			// Start from the narrowest power of two with room for the total area and widen until everything fits
+			unsigned int width = 1;
+			while (width < widest || static_cast<uint64_t>(width) * width < area)
+			{
+				width *= 2;
+			}
+			std::vector<AtlasRegion> placed(sources.size());
+			unsigned int height = 0;
+			while (true)
+			{
+				width = std::min(width, maxWidth);
+				height = pack(order, sizes, width, maxHeight, placed);
+				if (height != 0 || width == maxWidth)
+				{
+					break;
+				}
+				width *= 2;
+			}
+			if (height == 0)
+			{
+				return false;
+			}
+
+			// Copy the images in, converting RGB to RGBA if the atlas has alpha
+			image.allocate(width, height, channels);
+			memset(image.data, 0, static_cast<size_t>(width) * height * channels);
+			regions.resize(sources.size());
+			for (size_t i = 0; i < sources.size(); i++)
+			{
+				const Image& source = *sources[i];
+				AtlasRegion& region = regions[i];
+				region.x = placed[i].x;
+				region.y = placed[i].y;
+				region.width = source.data != nullptr ? source.width : 0;
+				region.height = source.data != nullptr ? source.height : 0;
+				for (unsigned int y = 0; y < region.height; y++)
+				{
+					unsigned char* dst = image.atUnchecked(region.x, region.y + y);
+					const unsigned char* src = source.atUnchecked(0, y);
+					if (source.channels == channels)
+					{
+						memcpy(dst, src, static_cast<size_t>(region.width) * channels);
+					} else
+					{
+						for (unsigned int x = 0; x < region.width; x++)
+						{
+							dst[(x * 4)] = src[(x * 3)];
+							dst[(x * 4) + 1] = src[(x * 3) + 1];
+							dst[(x * 4) + 2] = src[(x * 3) + 2];
+							dst[(x * 4) + 3] = 255;
+						}
+					}
+				}
+			}
+			return true;
+		}
+
+		// Returns the region of the atlas image holding a handle
+		const AtlasRegion& region(unsigned int handle) const
+		{
+			return regions[handle];
+		}
+
+		// Returns the handle added with a name, or -1 if there is none
+		int find(const std::string& name) const
+		{
+			std::map<std::string, unsigned int>::const_iterator it = lookup.find(name);
+			return it == lookup.end() ? -1 : static_cast<int>(it->second);
+		}
+
+		// Returns the number of handles
+		unsigned int count() const
+		{
+			return static_cast<unsigned int>(names.size());
+		}
+
+		// Removes every image and region
+		void clear()
+		{
+			sources.clear();
+			names.clear();
+			lookup.clear();
+			regions.clear();
+			image.free();
+			image.width = 0;
+			image.height = 0;
+			image.channels = 0;
+		}
+
+		// Saves the built atlas. The file holds "GEBA", the version, the image size and channels, the regions and names, then the deflate compressed pixels
+		bool save(const std::string& filename) const
+		{
+			if (image.data == nullptr || regions.size() != names.size())
+			{
+				return false;
+			}
+			std::vector<unsigned char> file = { 'G', 'E', 'B', 'A' };
+			Codecs::writeLittleEndian(file, 1);
+			Codecs::writeLittleEndian(file, image.width);
+			Codecs::writeLittleEndian(file, image.height);
+			Codecs::writeLittleEndian(file, image.channels);
+			Codecs::writeLittleEndian(file, static_cast<uint32_t>(regions.size()));
+			for (size_t i = 0; i < regions.size(); i++)
+			{
+				Codecs::writeLittleEndian(file, regions[i].x);
+				Codecs::writeLittleEndian(file, regions[i].y);
+				Codecs::writeLittleEndian(file, regions[i].width);
+				Codecs::writeLittleEndian(file, regions[i].height);
+				Codecs::writeLittleEndian(file, static_cast<uint32_t>(names[i].size()));
+				file.insert(file.end(), names[i].begin(), names[i].end());
+			}
+			std::vector<unsigned char> pixels;
+			Codecs::deflate(image.data, static_cast<size_t>(image.width) * image.height * image.channels, pixels);
+			Codecs::writeLittleEndian(file, static_cast<uint32_t>(pixels.size()));
+			file.insert(file.end(), pixels.begin(), pixels.end());
+			std::ofstream out(filename, std::ios::binary);
+			out.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+			return static_cast<bool>(out);
+		}
+
+		// Loads an atlas written by save(), replacing the current one. A loaded atlas cannot have more images added and built
+		bool load(const std::string& filename)
+		{
+			clear();
+			std::vector<unsigned char> file;
+			if (!Codecs::readFile(filename, file))
+			{
+				return false;
+			}
+			size_t position = 0;
+			// Reads the next value, failing if the file is too short
+			auto read = [&](uint32_t& value)
+			{
+				if (position + 4 > file.size())
+				{
+					return false;
+				}
+				value = Codecs::readLittleEndian(&file[position]);
+				position += 4;
+				return true;
+			};
+			uint32_t version, width, height, channels, count, size;
+			if (file.size() < 4 || memcmp(file.data(), "GEBA", 4) != 0)
+			{
+				return false;
+			}
+			position = 4;
+			if (!read(version) || version != 1 || !read(width) || !read(height) || !read(channels) || !read(count) || (channels != 3 && channels != 4) || width == 0 || height == 0)
+			{
+				return false;
+			}
+			for (uint32_t i = 0; i < count; i++)
+			{
+				AtlasRegion region;
+				uint32_t length;
+				if (!read(region.x) || !read(region.y) || !read(region.width) || !read(region.height) || !read(length) || length > file.size() - position ||
+					static_cast<uint64_t>(region.x) + region.width > width || static_cast<uint64_t>(region.y) + region.height > height)
+				{
+					clear();
+					return false;
+				}
+				std::string name(reinterpret_cast<const char*>(&file[position]), length);
+				position += length;
+				if (!name.empty())
+				{
+					lookup[name] = i;
+				}
+				names.push_back(name);
+				regions.push_back(region);
+			}
+			if (!read(size) || size > file.size() - position)
+			{
+				clear();
+				return false;
+			}
+			size_t bytes = static_cast<size_t>(width) * height * channels;
+			if (bytes / 1032 > size)
+			{
+				clear();
+				return false;
+			}
+			image.allocate(width, height, channels);
+			Codecs::Inflater inflater(&file[position], size);
+			if (!inflater.inflate(image.data, bytes))
+			{
+				clear();
+				return false;
+			}
+			return true;
+		}
+	};
+
+	// The AssetPackWriter class bakes decoded images into a single pack file for AssetPack, as an offline step
+	// The file starts with a 64 byte header: "GEBP", the version, the image count and the index size. The index follows, then the pixels from the next 4096 byte boundary.
+	// Each index entry holds the name length and name, the width, height, channels and number of levels, then a 64 bit offset for each level. Levels after the first are mips.
+	// Pixel data is 64 byte aligned, and is only read when used because the index is separate from it.
+	class AssetPackWriter
+	{
+	private:
+		std::vector<const Image*> images;             // Images to write, which must stay alive until write()
+		std::vector<std::string> names;               // Name of each image
+		std::deque<Image> loaded;                     // Images loaded by addFile(), owned by the writer
+
+	public:
+		// Adds an image, including its mip chain if it has one, under name. The image must stay alive until write()
+		void add(const std::string& name, const Image& image)
+		{
+			images.push_back(&image);
+			names.push_back(name);
+		}
+
+		// Loads an image file and adds it under its filename, building its mip chain if mips is set. Returns false if it could not be loaded
+		bool addFile(const std::string& filename, bool mips = false)
+		{
+			loaded.emplace_back();
+			if (!loaded.back().load(filename))
+			{
+				loaded.pop_back();
+				return false;
+			}
+			if (mips)
+			{
+				loaded.back().buildMips();
+			}
+			add(filename, loaded.back());
+			return true;
+		}
+
+		// Writes the pack file. Returns false if an image is empty or the file could not be written
+		bool write(const std::string& filename) const
+		{
+			// Build the index, placing each level at the next 64 byte boundary after the index
+			std::vector<unsigned char> index;
+			std::vector<uint64_t> offsets;
+			uint64_t position = 0;
+			for (size_t i = 0; i < images.size(); i++)
+			{
+				const Image& image = *images[i];
+				if (image.data == nullptr || image.width == 0 || image.height == 0)
+				{
+					return false;
+				}
+				Codecs::writeLittleEndian(index, static_cast<uint32_t>(names[i].size()));
+				index.insert(index.end(), names[i].begin(), names[i].end());
+				Codecs::writeLittleEndian(index, image.width);
+				Codecs::writeLittleEndian(index, image.height);
+				Codecs::writeLittleEndian(index, image.channels);
+				Codecs::writeLittleEndian(index, static_cast<uint32_t>(image.mips.size() + 1));
+				for (size_t level = 0; level <= image.mips.size(); level++)
+				{
+					const Image& source = level == 0 ? image : image.mips[level - 1];
+					offsets.push_back(position);
+					position = (position + (static_cast<uint64_t>(source.width) * source.height * source.channels) + 63) & ~static_cast<uint64_t>(63);
+				}
+				// Offsets are relative to the start of the pixels until the index size is known
+				for (size_t level = 0; level <= image.mips.size(); level++)
+				{
+					Codecs::writeLittleEndian(index, 0);
+					Codecs::writeLittleEndian(index, 0);
+				}
+			}
+			uint64_t dataStart = (64 + index.size() + 4095) & ~static_cast<uint64_t>(4095);
+
+			// Fill in the absolute offsets now the start of the pixels is known
+			size_t entry = 0;
+			size_t p = 0;
+			for (size_t i = 0; i < images.size(); i++)
+			{
+				p += 4 + names[i].size() + 12;
+				uint32_t levels = Codecs::readLittleEndian(&index[p]);
+				p += 4;
+				for (uint32_t level = 0; level < levels; level++)
+				{
+					uint64_t offset = dataStart + offsets[entry++];
+					for (unsigned int b = 0; b < 8; b++)
+					{
+						index[p + b] = static_cast<unsigned char>(offset >> (b * 8));
+					}
+					p += 8;
+				}
+			}
+
+			std::ofstream out(filename, std::ios::binary);
+			if (!out)
+			{
+				return false;
+			}
+			std::vector<unsigned char> header = { 'G', 'E', 'B', 'P' };
+			Codecs::writeLittleEndian(header, 1);
+			Codecs::writeLittleEndian(header, static_cast<uint32_t>(images.size()));
+			Codecs::writeLittleEndian(header, static_cast<uint32_t>(index.size()));
+			header.resize(64, 0);
+			out.write(reinterpret_cast<const char*>(header.data()), 64);
+			out.write(reinterpret_cast<const char*>(index.data()), static_cast<std::streamsize>(index.size()));
+			uint64_t written = 64 + index.size();
+			static const char zeros[4096] = {};
+			entry = 0;
+			for (size_t i = 0; i < images.size(); i++)
+			{
+				const Image& image = *images[i];
+				for (size_t level = 0; level <= image.mips.size(); level++)
+				{
+					const Image& source = level == 0 ? image : image.mips[level - 1];
+					uint64_t target = dataStart + offsets[entry++];
+					out.write(zeros, static_cast<std::streamsize>(target - written));
+					size_t bytes = static_cast<size_t>(source.width) * source.height * source.channels;
+					out.write(reinterpret_cast<const char*>(source.data), static_cast<std::streamsize>(bytes));
+					written = target + bytes;
+				}
+			}
+			return static_cast<bool>(out);
+		}
+	};
+
+	// The AssetPack class maps a pack file written by AssetPackWriter into memory and gives each image as a view straight into the mapping
+	// Opening only reads the index, so nothing is decoded or copied and pixels are paged in by the OS when first drawn. Images never used are never read.
+	// The mapping is copy on write, so drawing into a view changes a private copy of its pages and never the file. Views must not outlive the pack.
+	class AssetPack
+	{
+	private:
+		unsigned char* mapping = nullptr;             // Start of the mapped file
+		size_t mappingSize = 0;                       // Size of the mapped file in bytes
+#if defined(_WIN32)
+		HANDLE fileHandle = INVALID_HANDLE_VALUE;     // The open pack file
+		HANDLE mappingHandle = NULL;                  // The file mapping object
+#endif
+		std::vector<Image> views;                     // One view per image, with its mips as views too
+		std::vector<std::string> names;               // Name of each image
+		std::map<std::string, unsigned int> lookup;   // Index of each name
+
+		// Maps the whole file read only with copy on write. Returns false if it could not be mapped
+		bool map(const std::string& filename)
+		{
+#if defined(_WIN32)
+			fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (fileHandle == INVALID_HANDLE_VALUE)
+			{
+				return false;
+			}
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(fileHandle, &size) || size.QuadPart == 0)
+			{
+				return false;
+			}
+			mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+			if (mappingHandle == NULL)
+			{
+				return false;
+			}
+			mapping = static_cast<unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_COPY, 0, 0, 0));
+			mappingSize = static_cast<size_t>(size.QuadPart);
+			return mapping != nullptr;
+#else
+			int file = ::open(filename.c_str(), O_RDONLY);
+			if (file < 0)
+			{
+				return false;
+			}
+			struct stat info;
+			if (fstat(file, &info) != 0 || info.st_size == 0)
+			{
+				::close(file);
+				return false;
+			}
+			void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+			::close(file);
+			if (address == MAP_FAILED)
+			{
+				return false;
+			}
+			mapping = static_cast<unsigned char*>(address);
+			mappingSize = static_cast<size_t>(info.st_size);
+			return true;
+#endif
+		}
+
+	public:
+		AssetPack() {}
+
+		// Unmaps the file
+		~AssetPack()
+		{
+			close();
+		}
+
+		AssetPack(const AssetPack&) = delete;
+		AssetPack& operator=(const AssetPack&) = delete;
+
+		// Maps a pack file and reads its index. Returns false if the file cannot be mapped or is damaged
+		bool open(const std::string& filename)
+		{
+			close();
+			if (!map(filename) || mappingSize < 64 || memcmp(mapping, "GEBP", 4) != 0 || Codecs::readLittleEndian(&mapping[4]) != 1)
+			{
+				close();
+				return false;
+			}
+			uint32_t count = Codecs::readLittleEndian(&mapping[8]);
+			uint32_t indexSize = Codecs::readLittleEndian(&mapping[12]);
+			// The smallest entry is an empty name, the size and one level offset, 28 bytes, so a larger count cannot fit in the index
+			if (indexSize > mappingSize - 64 || count > indexSize / 28)
+			{
+				close();
+				return false;
+			}
+			const unsigned char* p = &mapping[64];
+			const unsigned char* end = p + indexSize;
+			views.resize(count);
+			names.resize(count);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				if (end - p < 4 || Codecs::readLittleEndian(p) > static_cast<size_t>(end - p) - 4)
+				{
+					close();
+					return false;
+				}
+				uint32_t length = Codecs::readLittleEndian(p);
+				names[i].assign(reinterpret_cast<const char*>(p + 4), length);
+				p += 4 + length;
+				if (end - p < 16)
+				{
+					close();
+					return false;
+				}
+				uint32_t width = Codecs::readLittleEndian(p);
+				uint32_t height = Codecs::readLittleEndian(p + 4);
+				uint32_t channels = Codecs::readLittleEndian(p + 8);
+				uint32_t levels = Codecs::readLittleEndian(p + 12);
+				p += 16;
+				if (levels == 0 || levels > 64 || static_cast<uint64_t>(end - p) < static_cast<uint64_t>(levels) * 8 || width == 0 || height == 0 || (channels != 3 && channels != 4))
+				{
+					close();
+					return false;
+				}
+				for (uint32_t level = 0; level < levels; level++)
+				{
+					uint64_t offset = static_cast<uint64_t>(Codecs::readLittleEndian(p)) | (static_cast<uint64_t>(Codecs::readLittleEndian(p + 4)) << 32);
+					p += 8;
+					if (offset > mappingSize || static_cast<uint64_t>(width) * height * channels > mappingSize - offset)
+					{
+						close();
+						return false;
+					}
+					Image view;
+					view.width = width;
+					view.height = height;
+					view.channels = channels;
+					view.data = &mapping[offset];
+					view.external = true;
+					if (level == 0)
+					{
+						views[i] = std::move(view);
+					} else
+					{
+						views[i].mips.push_back(std::move(view));
+					}
+					width = std::max(1u, width / 2);
+					height = std::max(1u, height / 2);
+				}
+				lookup[names[i]] = i;
+			}
+			return true;
+		}
+
+		// Drops the views and unmaps the file
+		void close()
+		{
+			views.clear();
+			names.clear();
+			lookup.clear();
+#if defined(_WIN32)
+			if (mapping != nullptr)
+			{
+				UnmapViewOfFile(mapping);
+			}
+			if (mappingHandle != NULL)
+			{
+				CloseHandle(mappingHandle);
+				mappingHandle = NULL;
+			}
+			if (fileHandle != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(fileHandle);
+				fileHandle = INVALID_HANDLE_VALUE;
+			}
+#else
+			if (mapping != nullptr)
+			{
+				munmap(mapping, mappingSize);
+			}
+#endif
+			mapping = nullptr;
+			mappingSize = 0;
+		}
+
+		// Returns the number of images
+		unsigned int count() const
+		{
+			return static_cast<unsigned int>(views.size());
+		}
+
+		// Returns the index of the image with a name, or -1 if there is none
+		int find(const std::string& name) const
+		{
+			std::map<std::string, unsigned int>::const_iterator it = lookup.find(name);
+			return it == lookup.end() ? -1 : static_cast<int>(it->second);
+		}
+
+		// Returns the view of an image. It can be drawn like any other Image
+		const Image& image(unsigned int index) const
+		{
+			return views[index];
+		}
+
+		// Returns the name of an image
+		const std::string& name(unsigned int index) const
+		{
+			return names[index];
+		}
+
+		// Returns the size of the mapped file in bytes. This is address space, not memory: pages are only read when used
+		size_t mappedBytes() const
+		{
+			return mappingSize;
+		}
+	};
+
+	// The DirtyTracker class records which parts of a pixel buffer have changed since it was last uploaded
+	// Each row stores the horizontal extent written to it. The changes are turned into byte ranges so only those need to be sent to the GPU
+	class DirtyTracker
+	{
+	private:
+		unsigned int width = 0;              // Width of the tracked buffer in pixels
+		unsigned int height = 0;             // Height of the tracked buffer in pixels
+		unsigned int bytesPerPixel = 3;      // Size of each pixel in bytes
+		std::vector<unsigned int> minX;      // First changed pixel of each row
+		std::vector<unsigned int> maxX;      // One past the last changed pixel of each row. Equal to minX when the row is clean
+		unsigned int firstRow = 0;           // First row that may be dirty
+		unsigned int lastRow = 0;            // One past the last row that may be dirty
+
+	public:
+		// A range of bytes in the buffer to upload
+		struct Range
+		{
+			unsigned int offset;   // Offset of the first byte
+			unsigned int size;     // Number of bytes
+		};
+
+		// Sets the size of the tracked buffer. Everything starts out dirty
+		void resize(unsigned int _width, unsigned int _height, unsigned int _bytesPerPixel = 3)
+		{
+			width = _width;
+			height = _height;
+			bytesPerPixel = _bytesPerPixel;
+			minX.assign(height, 0);
+			maxX.assign(height, 0);
+			markAll();
+		}
+
+		// Marks the w x h rectangle with its top left corner at (x, y) as changed
+		// The rectangle is clipped against the buffer
+		void markRect(int x, int y, int w, int h)
+		{
+			int x0 = std::max(x, 0);
+			int y0 = std::max(y, 0);
+			int x1 = std::min(x + w, static_cast<int>(width));
+			int y1 = std::min(y + h, static_cast<int>(height));
+			if (x0 >= x1 || y0 >= y1)
+			{
+				return;
+			}
+			for (int row = y0; row < y1; row++)
+			{
+				if (minX[row] == maxX[row])
+				{
+					minX[row] = x0;
+					maxX[row] = x1;
+				} else
+				{
+					minX[row] = std::min(minX[row], static_cast<unsigned int>(x0));
+					maxX[row] = std::max(maxX[row], static_cast<unsigned int>(x1));
+				}
+			}
+			if (firstRow == lastRow)
+			{
+				firstRow = y0;
+				lastRow = y1;
+			} else
+			{
+				firstRow = std::min(firstRow, static_cast<unsigned int>(y0));
+				lastRow = std::max(lastRow, static_cast<unsigned int>(y1));
+			}
+		}
+
+		// Marks a single pixel as changed. Note, no checks performed on x and y coordinates
+		void markPixel(unsigned int x, unsigned int y)
+		{
+			if (minX[y] == maxX[y])
+			{
+				minX[y] = x;
+				maxX[y] = x + 1;
+			} else
+			{
+				minX[y] = std::min(minX[y], x);
+				maxX[y] = std::max(maxX[y], x + 1);
+			}
+			if (firstRow == lastRow)
+			{
+				firstRow = y;
+				lastRow = y + 1;
+			} else
+			{
+				firstRow = std::min(firstRow, y);
+				lastRow = std::max(lastRow, y + 1);
+			}
+		}
+
+		// Marks the whole buffer as changed
+		void markAll()
+		{
+			markRect(0, 0, static_cast<int>(width), static_cast<int>(height));
+		}
+
+		// Checks if anything has changed
+		bool isDirty() const
+		{
+			return firstRow != lastRow;
+		}
+
+		// Fills ranges with the byte ranges that have changed and returns the total number of bytes to upload
+		// Ranges closer together than mergeGap bytes are joined to reduce the number of uploads. If more than fullFraction of the buffer is dirty, a single range covering the whole buffer is returned
+		unsigned int collect(std::vector<Range>& ranges, unsigned int mergeGap = 4096, float fullFraction = 0.5f) const
+		{
+			ranges.clear();
+			unsigned int total = 0;
+			for (unsigned int row = firstRow; row < lastRow; row++)
+			{
+				if (minX[row] == maxX[row])
+				{
+					continue;
+				}
+				unsigned int start = ((row * width) + minX[row]) * bytesPerPixel;
+				unsigned int end = ((row * width) + maxX[row]) * bytesPerPixel;
+				if (!ranges.empty() && start <= ranges.back().offset + ranges.back().size + mergeGap)
+				{
+					total += end - (ranges.back().offset + ranges.back().size);
+					ranges.back().size = end - ranges.back().offset;
+				} else
+				{
+					Range range;
+					range.offset = start;
+					range.size = end - start;
+					ranges.push_back(range);
+					total += range.size;
+				}
+			}
+			unsigned int size = width * height * bytesPerPixel;
+			if (total > static_cast<unsigned int>(size * fullFraction))
+			{
+				ranges.clear();
+				Range range;
+				range.offset = 0;
+				range.size = size;
+				ranges.push_back(range);
+				total = size;
+			}
+			return total;
+		}
+
+		// Marks everything as unchanged. Call this once the changes have been uploaded
+		void reset()
+		{
+			for (unsigned int row = firstRow; row < lastRow; row++)
+			{
+				minX[row] = 0;
+				maxX[row] = 0;
+			}
+			firstRow = 0;
+			lastRow = 0;
+		}
+	};
+
+	// A 2D affine transform from image coordinates (u, v) to surface coordinates (x, y)
+	// x = (a * u) + (b * v) + tx and y = (c * u) + (d * v) + ty
+	struct Transform
+	{
+		float a = 1.0f;       // x change per unit of u
+		float b = 0.0f;       // x change per unit of v
+		float c = 0.0f;       // y change per unit of u
+		float d = 1.0f;       // y change per unit of v
+		float tx = 0.0f;      // x position of the image origin
+		float ty = 0.0f;      // y position of the image origin
+
+		// Returns a transform that scales the image and rotates it by angle radians clockwise about (pivotX, pivotY), then places that point at (x, y)
+		// The pivot is given in image coordinates
+		static Transform rotateScale(float x, float y, float angle, float scaleX = 1.0f, float scaleY = 1.0f, float pivotX = 0.0f, float pivotY = 0.0f)
+		{
+			Transform t;
+			float cs = cosf(angle);
+			float sn = sinf(angle);
+			t.a = cs * scaleX;
+			t.b = -sn * scaleY;
+			t.c = sn * scaleX;
+			t.d = cs * scaleY;
+			t.tx = x - (t.a * pivotX) - (t.b * pivotY);
+			t.ty = y - (t.c * pivotX) - (t.d * pivotY);
+			return t;
+		}
+	};
+
+	// The Surface class describes a block of pixel memory that can be drawn into
+	// It does not own the memory. Window::getSurface() wraps the back buffer, but any buffer can be wrapped so drawing code can run without a window
+	class Surface
+	{
+	public:
+		unsigned char* data;      // Pointer to the first pixel
+		unsigned int width;       // Width in pixels
+		unsigned int height;      // Height in pixels
+		unsigned int pitch;       // Number of bytes from the start of one row to the next
+		PixelFormat format;       // Layout of each pixel
+		DirtyTracker* dirty;      // Optional tracker told about every area drawn to
+
+		// Default constructor
+		Surface()
+		{
+			data = nullptr;
+			width = 0;
+			height = 0;
+			pitch = 0;
+			format = PixelRGB888;
+			dirty = nullptr;
+		}
+
+		// Wraps existing pixel memory. A pitch of 0 means the rows are tightly packed
+		Surface(unsigned char* _data, unsigned int _width, unsigned int _height, unsigned int _pitch = 0, PixelFormat _format = PixelRGB888)
+		{
+			data = _data;
+			width = _width;
+			height = _height;
+			format = _format;
+			pitch = _pitch == 0 ? _width * bytesPerPixel() : _pitch;
+			dirty = nullptr;
+		}
+
+		// Returns the size of each pixel in bytes
+		unsigned int bytesPerPixel() const
+		{
+			return format == PixelRGB888 ? 3 : 4;
+		}
+
+		// Writes the bytes of an RGB colour in this surface's format into pixel, which must hold 4 bytes
+		void encode(unsigned char r, unsigned char g, unsigned char b, unsigned char* pixel) const
+		{
+			pixel[0] = format == PixelBGRX8888 ? b : r;
+			pixel[1] = g;
+			pixel[2] = format == PixelBGRX8888 ? r : b;
+			pixel[3] = 255;
+		}
+
+		// Returns a pointer to the pixel data at (x, y)
+		// Note, no checks performed on x and y coordinates
+		unsigned char* atUnchecked(const unsigned int x, const unsigned int y) const
+		{
+			return &data[(y * pitch) + (x * bytesPerPixel())];
+		}
+
+		// Fills the whole surface with a single colour
+		void clear(unsigned char r, unsigned char g, unsigned char b)
+		{
+			if (data == nullptr)
+			{
+				return;
+			}
+			if (pitch == width * bytesPerPixel())
+			{
+				// Tightly packed rows can be filled as one long row
+				unsigned char pixel[4];
+				encode(r, g, b, pixel);
+				Kernels::fillRow()(data, width * height, pixel, bytesPerPixel());
+				if (dirty != nullptr)
+				{
+					dirty->markAll();
+				}
+				return;
+			}
+			fillRect(0, 0, static_cast<int>(width), static_cast<int>(height), r, g, b);
+		}
+
+		// Fills a w x h rectangle with its top left corner at (x, y) with a single colour
+		// The rectangle is clipped against the surface
+		void fillRect(int x, int y, int w, int h, unsigned char r, unsigned char g, unsigned char b)
+		{
+			if (data == nullptr)
+			{
+				return;
+			}
+			int x0 = std::max(x, 0);
+			int y0 = std::max(y, 0);
+			int x1 = std::min(x + w, static_cast<int>(width));
+			int y1 = std::min(y + h, static_cast<int>(height));
+			if (x0 >= x1 || y0 >= y1)
+			{
+				return;
+			}
+			unsigned char pixel[4];
+			encode(r, g, b, pixel);
+			Kernels::FillRowFunc row = Kernels::fillRow();
+			for (int i = y0; i < y1; i++)
+			{
+				row(atUnchecked(x0, i), x1 - x0, pixel, bytesPerPixel());
+			}
+			if (dirty != nullptr)
+			{
+				dirty->markRect(x0, y0, x1 - x0, y1 - y0);
+			}
+		}
+
+		// Draws an image with its top left corner at (x, y)
+		// Pixels with an alpha value less than or equal to alphaThreshold are skipped. Images without an alpha channel are copied as they are.
+		void blit(const Image& image, int x, int y, unsigned char alphaThreshold = 0)
+		{
+			blit(image, x, y, 0, 0, static_cast<int>(image.width), static_cast<int>(image.height), alphaThreshold);
+		}
+
+		// Draws the w x h region of an image starting at (srcX, srcY) with its top left corner at (x, y)
+		// The region is clipped against the image and the surface once, then copied a row at a time
+		void blit(const Image& image, int x, int y, int srcX, int srcY, int w, int h, unsigned char alphaThreshold = 0)
+		{
+			if (image.data == nullptr || data == nullptr || (image.channels == 4 && alphaThreshold == 255))
+			{
+				return;
+			}
+			if (!clipBlit(x, y, srcX, srcY, w, h, image.width, image.height))
+			{
+				return;
+			}
+
+			bool swapRB = format == PixelBGRX8888;
+			if (image.channels == 4 && format == PixelRGB888)
+			{
+				Kernels::AlphaTestRowFunc row = Kernels::alphaTestRow();
+				for (int i = 0; i < h; i++)
+				{
+					row(atUnchecked(x, y + i), image.atUnchecked(srcX, srcY + i), static_cast<unsigned int>(w), alphaThreshold);
+				}
+			} else if (image.channels == 4)
+			{
+				Kernels::AlphaTestRow32Func row = Kernels::alphaTestRow32();
+				for (int i = 0; i < h; i++)
+				{
+					row(atUnchecked(x, y + i), image.atUnchecked(srcX, srcY + i), static_cast<unsigned int>(w), alphaThreshold, swapRB);
+				}
+			} else if (image.channels == 3 && format == PixelRGB888)
+			{
+				for (int i = 0; i < h; i++)
+				{
+					memcpy(atUnchecked(x, y + i), image.atUnchecked(srcX, srcY + i), w * 3);
+				}
+			} else if (image.channels == 3)
+			{
+				Kernels::ConvertRowFunc row = Kernels::expandRow32();
+				for (int i = 0; i < h; i++)
+				{
+					row(atUnchecked(x, y + i), image.atUnchecked(srcX, srcY + i), static_cast<unsigned int>(w), swapRB);
+				}
+			}
+		}
+
+		// Draws the image packed into an atlas under handle with its top left corner at (x, y)
+		void blit(const TextureAtlas& atlas, unsigned int handle, int x, int y, unsigned char alphaThreshold = 0)
+		{
+			const AtlasRegion& r = atlas.region(handle);
+			blit(atlas.image, x, y, static_cast<int>(r.x), static_cast<int>(r.y), static_cast<int>(r.width), static_cast<int>(r.height), alphaThreshold);
+		}
+
+		// Draws an indexed image with its top left corner at (x, y). If the image's transparentZero is set, pixels with index 0 are skipped
+		void blit(const IndexedImage& image, int x, int y)
+		{
+			blit(image, x, y, 0, 0, static_cast<int>(image.width), static_cast<int>(image.height));
+		}
+
+		// Draws the w x h region of an indexed image starting at (srcX, srcY) with its top left corner at (x, y)
+		// The palette is converted to the surface format once, then each row is expanded through it
+		void blit(const IndexedImage& image, int x, int y, int srcX, int srcY, int w, int h)
+		{
+			if (image.indices.empty() || data == nullptr)
+			{
+				return;
+			}
+			if (!clipBlit(x, y, srcX, srcY, w, h, image.width, image.height))
+			{
+				return;
+			}
+			alignas(32) uint32_t palette[256];
+			if (format == PixelRGB888)
+			{
+				// RGB888 copies the palette as it is, widened to 4 bytes per entry so the SIMD kernels can gather it
+				memset(palette, 0, sizeof(palette));
+				for (unsigned int i = 0; i < 256; i++)
+				{
+					memcpy(&palette[i], image.palette[i], 3);
+				}
+				Kernels::ExpandIndexedRow24Func row = Kernels::expandIndexedRow24();
+				for (int i = 0; i < h; i++)
+				{
+					row(atUnchecked(x, y + i), image.atUnchecked(srcX, srcY + i), static_cast<unsigned int>(w), palette, image.transparentZero);
+				}
+				return;
+			}
+			// Only the entries the image uses are converted, the rest read as black
+			unsigned int used = std::min(image.colors, 256u);
+			for (unsigned int i = 0; i < used; i++)
+			{
+				encode(image.palette[i][0], image.palette[i][1], image.palette[i][2], reinterpret_cast<unsigned char*>(&palette[i]));
+			}
+			memset(&palette[used], 0, (256 - used) * sizeof(uint32_t));
+			Kernels::ExpandIndexedRow32Func row = Kernels::expandIndexedRow32();
+			for (int i = 0; i < h; i++)
+			{
+				row(atUnchecked(x, y + i), image.atUnchecked(srcX, srcY + i), static_cast<unsigned int>(w), palette, image.transparentZero);
+			}
+		}
+
+		// Draws a compiled sprite with its top left corner at (x, y)
+		void blit(const CompiledSprite& sprite, int x, int y)
+		{
+			sprite.draw(data, width, height, pitch, x, y, format);
+			if (dirty != nullptr)
+			{
+				dirty->markRect(x, y, static_cast<int>(sprite.width), static_cast<int>(sprite.height));
+			}
+		}
+
+		// Returns the mip level of image closest in size to how t draws it, and changes t to map that level's coordinates
+		// The level is chosen from the larger of the image steps for one pixel right and one pixel down. An image with lazyMips set builds its chain first
+		static const Image& selectMip(const Image& image, Transform& t)
+		{
+			double det = (static_cast<double>(t.a) * t.d) - (static_cast<double>(t.b) * t.c);
+			if (image.data == nullptr || !(fabs(det) > 1e-12))
+			{
+				return image;
+			}
+			double texels = std::max(sqrt((static_cast<double>(t.c) * t.c) + (static_cast<double>(t.d) * t.d)), sqrt((static_cast<double>(t.a) * t.a) + (static_cast<double>(t.b) * t.b))) / fabs(det);
+			// Levels are picked by rounding log2(texels), so below sqrt(2) texels per pixel the image itself is closest
+			if (!(texels >= 1.41421356) || (image.mips.empty() && !image.lazyMips))
+			{
+				return image;
+			}
+			if (image.mips.empty())
+			{
+				image.buildMips();
+			}
+			if (image.mips.empty())
+			{
+				return image;
+			}
+			size_t level = std::min(static_cast<size_t>(floor(log2(texels) + 0.5)), image.mips.size());
+			const Image& mip = image.mips[level - 1];
+			float scaleX = static_cast<float>(image.width) / static_cast<float>(mip.width);
+			float scaleY = static_cast<float>(image.height) / static_cast<float>(mip.height);
+			t.a *= scaleX;
+			t.c *= scaleX;
+			t.b *= scaleY;
+			t.d *= scaleY;
+			return mip;
+		}
+
+		// Draws an image transformed by t, which maps image coordinates to surface coordinates
+		// Each row is clipped once to the pixels whose centres fall inside the image, then filled by walking the image in 16.16 fixed point.
+		// With BlendAlphaTest, pixels with an alpha value less than or equal to alphaThreshold are skipped. With BlendAlpha the image is mixed over the surface using its alpha.
+		// Images drawn shrunk are sampled from their closest mip level when they have one, which reads less memory and reduces aliasing
+		void blitTransformed(const Image& image, const Transform& t, SampleMode sampling = SampleNearest, BlendMode blend = BlendAlphaTest, unsigned char alphaThreshold = 0)
+		{
+			Transform mipTransform = t;
+			const Image& mip = selectMip(image, mipTransform);
+			if (&mip != &image)
+			{
+				blitTransformed(mip, mipTransform, sampling, blend, alphaThreshold);
+				return;
+			}
+
+			// Image coordinates in fixed point must fit in 31 bits
+			if (image.data == nullptr || data == nullptr || image.width == 0 || image.height == 0 || image.width >= 32768 || image.height >= 32768)
+			{
+				return;
+			}
+			unsigned char threshold = image.channels == 4 ? alphaThreshold : 0;
+			if (blend == BlendAlphaTest && threshold == 255)
+			{
+				return;
+			}
+
+			// Invert the transform to find the image step for one pixel right and one pixel down
+			double det = (static_cast<double>(t.a) * t.d) - (static_cast<double>(t.b) * t.c);
+			if (!(fabs(det) > 1e-12))
+			{
+				return;
+			}
+			double dudx = t.d / det;
+			double dvdx = -t.c / det;
+			// Images shrunk so far that one pixel steps over 16384 texels are not drawn, which keeps the fixed point walk from overflowing
+			if (!(fabs(dudx) < 16384.0 && fabs(dvdx) < 16384.0))
+			{
+				return;
+			}
+
+			// Clip the bounding box of the image corners against the surface
+			float cornersX[4] = { t.tx, t.tx + (t.a * image.width), t.tx + (t.b * image.height), t.tx + (t.a * image.width) + (t.b * image.height) };
+			float cornersY[4] = { t.ty, t.ty + (t.c * image.width), t.ty + (t.d * image.height), t.ty + (t.c * image.width) + (t.d * image.height) };
+			float minX = std::max(std::min(std::min(cornersX[0], cornersX[1]), std::min(cornersX[2], cornersX[3])), 0.0f);
+			float maxX = std::min(std::max(std::max(cornersX[0], cornersX[1]), std::max(cornersX[2], cornersX[3])), static_cast<float>(width));
+			float minY = std::max(std::min(std::min(cornersY[0], cornersY[1]), std::min(cornersY[2], cornersY[3])), 0.0f);
+			float maxY = std::min(std::max(std::max(cornersY[0], cornersY[1]), std::max(cornersY[2], cornersY[3])), static_cast<float>(height));
+			if (!(minX < maxX && minY < maxY))
+			{
+				return;
+			}
+			int x0 = static_cast<int>(floorf(minX));
+			int x1 = static_cast<int>(ceilf(maxX));
+			int y0 = static_cast<int>(floorf(minY));
+			int y1 = static_cast<int>(ceilf(maxY));
+
+			const int64_t stepU = llround(dudx * 65536.0);
+			const int64_t stepV = llround(dvdx * 65536.0);
+			const int64_t limitU = static_cast<int64_t>(image.width) << 16;
+			const int64_t limitV = static_cast<int64_t>(image.height) << 16;
+			const unsigned int chunk = 256;
+			alignas(32) unsigned char samples[chunk * 4];
+			bool swapRB = format == PixelBGRX8888;
+			Kernels::SampleRowFunc sample = Kernels::sampleRow(sampling);
+			Kernels::AlphaTestRowFunc testRow = Kernels::alphaTestRow();
+			Kernels::AlphaTestRow32Func testRow32 = Kernels::alphaTestRow32();
+			Kernels::BlendRow32Func blendRow32 = Kernels::blendRow32();
+
+			int drawnX0 = x1;
+			int drawnX1 = x0;
+			int drawnY0 = y1;
+			int drawnY1 = y0;
+			for (int y = y0; y < y1; y++)
+			{
+				// Image position of the centre of pixel (0, y)
+				double px = 0.5 - t.tx;
+				double py = (y + 0.5) - t.ty;
+				int64_t startU = llround((((t.d * px) - (t.b * py)) / det) * 65536.0);
+				int64_t startV = llround((((t.a * py) - (t.c * px)) / det) * 65536.0);
+
+				// Keep only the pixels whose samples lie inside the image
+				int64_t span0 = x0;
+				int64_t span1 = x1;
+				clipSpan(startU, stepU, limitU, span0, span1);
+				clipSpan(startV, stepV, limitV, span0, span1);
+				if (span0 >= span1)
+				{
+					continue;
+				}
+				int xs = static_cast<int>(span0);
+				int xe = static_cast<int>(span1);
+				drawnX0 = std::min(drawnX0, xs);
+				drawnX1 = std::max(drawnX1, xe);
+				drawnY0 = std::min(drawnY0, y);
+				drawnY1 = y + 1;
+
+				for (int x = xs; x < xe; x += chunk)
+				{
+					unsigned int count = std::min(chunk, static_cast<unsigned int>(xe - x));
+					sample(samples, image.data, image.width, image.height, image.channels, static_cast<int>(startU + (x * stepU)), static_cast<int>(startV + (x * stepV)),
+						static_cast<int>(stepU), static_cast<int>(stepV), count);
+					unsigned char* dst = atUnchecked(x, y);
+					if (blend == BlendAlpha && format == PixelRGB888)
+					{
+						Kernels::blendRowScalar(dst, samples, count);
+					} else if (blend == BlendAlpha)
+					{
+						blendRow32(dst, samples, count, swapRB);
+					} else if (format == PixelRGB888)
+					{
+						testRow(dst, samples, count, threshold);
+					} else
+					{
+						testRow32(dst, samples, count, threshold, swapRB);
+					}
+				}
+			}
+			if (dirty != nullptr && drawnX0 < drawnX1)
+			{
+				dirty->markRect(drawnX0, drawnY0, drawnX1 - drawnX0, drawnY1 - drawnY0);
+			}
+		}
+
+		// Draws an image scaled by scale and rotated by angle radians clockwise about its centre, with the centre placed at (x, y)
+		void blitRotated(const Image& image, float x, float y, float angle, float scale = 1.0f, SampleMode sampling = SampleNearest, BlendMode blend = BlendAlphaTest, unsigned char alphaThreshold = 0)
+		{
+			blitTransformed(image, Transform::rotateScale(x, y, angle, scale, scale, image.width * 0.5f, image.height * 0.5f), sampling, blend, alphaThreshold);
+		}
+
+		// Draws a line from (x0, y0) to (x1, y1), including both end points
+		// The steps along the line that fall inside the surface are found once, then walked with Bresenham's integer error term
+		void drawLine(int x0, int y0, int x1, int y1, unsigned char r, unsigned char g, unsigned char b)
+		{
+			if (data == nullptr)
+			{
+				return;
+			}
+			unsigned char pixel[4];
+			encode(r, g, b, pixel);
+
+			// Step i is at majorStart + (majorSign * i) along the longer axis and minorStart + (minorSign * q(i)) along the other,
+			// where q(i) = ((2 * i * minor) + major) / (2 * major) rounds i * minor / major to the nearest integer
+			int64_t dx = std::abs(static_cast<int64_t>(x1) - x0);
+			int64_t dy = std::abs(static_cast<int64_t>(y1) - y0);
+			bool steep = dy > dx;
+			int64_t major = steep ? dy : dx;
+			int64_t minor = steep ? dx : dy;
+			int64_t majorStart = steep ? y0 : x0;
+			int64_t minorStart = steep ? x0 : y0;
+			int64_t majorSign = (steep ? y1 >= y0 : x1 >= x0) ? 1 : -1;
+			int64_t minorSign = (steep ? x1 >= x0 : y1 >= y0) ? 1 : -1;
+			int64_t majorLimit = steep ? height : width;
+			int64_t minorLimit = steep ? width : height;
+
+			// Clip along the longer axis
+			int64_t i0 = 0;
+			int64_t i1 = major + 1;
+			clipSpan(majorStart, majorSign, majorLimit, i0, i1);
+
+			// Clip along the shorter axis. q(i) never decreases, so the allowed values of q give a range of steps
+			int64_t qLow = minorSign > 0 ? -minorStart : minorStart - (minorLimit - 1);
+			int64_t qHigh = minorSign > 0 ? (minorLimit - 1) - minorStart : minorStart;
+			if (minor == 0)
+			{
+				if (qLow > 0 || qHigh < 0)
+				{
+					return;
+				}
+			} else
+			{
+				i0 = std::max(i0, -floorDiv(major - (2 * major * qLow), 2 * minor));
+				i1 = std::min(i1, -floorDiv(major - (2 * major * (qHigh + 1)), 2 * minor));
+			}
+			if (i0 >= i1)
+			{
+				return;
+			}
+
+			// Start the error term at step i0 and walk the rest of the line
+			int64_t twoMajor = std::max<int64_t>(2 * major, 1);
+			int64_t twoMinor = 2 * minor;
+			int64_t q = ((2 * i0 * minor) + major) / twoMajor;
+			int64_t error = ((2 * i0 * minor) + major) % twoMajor;
+			int64_t start = majorStart + (majorSign * i0);
+			int64_t across = minorStart + (minorSign * q);
+			int64_t end = majorStart + (majorSign * (i1 - 1));
+			int64_t acrossEnd = minorStart + (minorSign * (((2 * (i1 - 1) * minor) + major) / twoMajor));
+			unsigned char* p = steep ? atUnchecked(static_cast<unsigned int>(across), static_cast<unsigned int>(start)) : atUnchecked(static_cast<unsigned int>(start), static_cast<unsigned int>(across));
+			unsigned int bpp = bytesPerPixel();
+			ptrdiff_t majorStep = steep ? majorSign * static_cast<ptrdiff_t>(pitch) : majorSign * static_cast<ptrdiff_t>(bpp);
+			ptrdiff_t minorStep = steep ? minorSign * static_cast<ptrdiff_t>(bpp) : minorSign * static_cast<ptrdiff_t>(pitch);
+			for (int64_t i = i0; ; )
+			{
+				memcpy(p, pixel, bpp);
+				if (++i == i1)
+				{
+					break;
+				}
+				p += majorStep;
+				error += twoMinor;
+				if (error >= twoMajor)
+				{
+					error -= twoMajor;
+					p += minorStep;
+				}
+			}
+			if (dirty != nullptr)
+			{
+				int64_t left = steep ? std::min(across, acrossEnd) : std::min(start, end);
+				int64_t top = steep ? std::min(start, end) : std::min(across, acrossEnd);
+				int64_t w = (steep ? std::abs(acrossEnd - across) : std::abs(end - start)) + 1;
+				int64_t h = (steep ? std::abs(end - start) : std::abs(acrossEnd - across)) + 1;
+				dirty->markRect(static_cast<int>(left), static_cast<int>(top), static_cast<int>(w), static_cast<int>(h));
+			}
+		}
+
+		// Draws the outline of a circle centred on (cx, cy)
+		void drawCircle(int cx, int cy, int radius, unsigned char r, unsigned char g, unsigned char b)
+		{
+			drawEllipse(cx, cy, radius, radius, r, g, b);
+		}
+
+		// Fills a circle centred on (cx, cy)
+		void fillCircle(int cx, int cy, int radius, unsigned char r, unsigned char g, unsigned char b)
+		{
+			fillEllipse(cx, cy, radius, radius, r, g, b);
+		}
+
+		// Draws the outline of an axis aligned ellipse centred on (cx, cy) with radii rx and ry
+		// Each row of the outline is drawn as up to two spans, so the outline has no gaps and matches the edge of fillEllipse
+		void drawEllipse(int cx, int cy, int rx, int ry, unsigned char r, unsigned char g, unsigned char b)
+		{
+			if (data == nullptr || rx < 0 || ry < 0)
+			{
+				return;
+			}
+			std::vector<int> extents;
+			ellipseExtents(rx, ry, extents);
+			rx = extents[0];
+			ry = static_cast<int>(extents.size()) - 1;
+			unsigned char pixel[4];
+			encode(r, g, b, pixel);
+			Kernels::FillRowFunc row = Kernels::fillRow();
+			int y0 = std::max(-ry, -cy);
+			int y1 = std::min(ry, static_cast<int>(height) - 1 - cy);
+			for (int y = y0; y <= y1; y++)
+			{
+				int outer = extents[std::abs(y)];
+				int above = std::abs(y - 1) <= ry ? extents[std::abs(y - 1)] : -1;
+				int below = std::abs(y + 1) <= ry ? extents[std::abs(y + 1)] : -1;
+				// Pixels beyond the narrower neighbouring row are on the edge
+				int inner = std::min(std::min(above, below) + 1, outer);
+				if (inner == 0)
+				{
+					fillSpan(static_cast<int64_t>(cx) - outer, static_cast<int64_t>(cx) + outer + 1, cy + y, pixel, row);
+				} else
+				{
+					fillSpan(static_cast<int64_t>(cx) - outer, static_cast<int64_t>(cx) - inner + 1, cy + y, pixel, row);
+					fillSpan(static_cast<int64_t>(cx) + inner, static_cast<int64_t>(cx) + outer + 1, cy + y, pixel, row);
+				}
+			}
+			if (dirty != nullptr)
+			{
+				dirty->markRect(cx - rx, cy - ry, (2 * rx) + 1, (2 * ry) + 1);
+			}
+		}
+
+		// Fills an axis aligned ellipse centred on (cx, cy) with radii rx and ry, one clipped span per row
+		void fillEllipse(int cx, int cy, int rx, int ry, unsigned char r, unsigned char g, unsigned char b)
+		{
+			if (data == nullptr || rx < 0 || ry < 0)
+			{
+				return;
+			}
+			std::vector<int> extents;
+			ellipseExtents(rx, ry, extents);
+			rx = extents[0];
+			ry = static_cast<int>(extents.size()) - 1;
+			unsigned char pixel[4];
+			encode(r, g, b, pixel);
+			Kernels::FillRowFunc row = Kernels::fillRow();
+			int y0 = std::max(-ry, -cy);
+			int y1 = std::min(ry, static_cast<int>(height) - 1 - cy);
+			for (int y = y0; y <= y1; y++)
+			{
+				int outer = extents[std::abs(y)];
+				fillSpan(static_cast<int64_t>(cx) - outer, static_cast<int64_t>(cx) + outer + 1, cy + y, pixel, row);
+			}
+			if (dirty != nullptr)
+			{
+				dirty->markRect(cx - rx, cy - ry, (2 * rx) + 1, (2 * ry) + 1);
+			}
+		}
+
+		// Draws the outline of a triangle
+		void drawTriangle(int x0, int y0, int x1, int y1, int x2, int y2, unsigned char r, unsigned char g, unsigned char b)
+		{
+			drawLine(x0, y0, x1, y1, r, g, b);
+			drawLine(x1, y1, x2, y2, r, g, b);
+			drawLine(x2, y2, x0, y0, r, g, b);
+		}
+
+		// Fills a triangle. A pixel is filled when its centre is inside the triangle, with a top-left rule for centres on an edge so triangles sharing an edge never overlap
+		// For each row the three edge functions are solved for the range of pixels where all are positive, which is then filled with the row fill kernel
+		// Coordinates must be within 2^29 of the surface so the edge functions fit in 64 bits
+		void fillTriangle(int x0, int y0, int x1, int y1, int x2, int y2, unsigned char r, unsigned char g, unsigned char b)
+		{
+			if (data == nullptr)
+			{
+				return;
+			}
+			int64_t xs[3] = { x0, x1, x2 };
+			int64_t ys[3] = { y0, y1, y2 };
+			int64_t area = ((xs[1] - xs[0]) * (ys[2] - ys[0])) - ((ys[1] - ys[0]) * (xs[2] - xs[0]));
+			if (area == 0)
+			{
+				return;
+			}
+			if (area < 0)
+			{
+				std::swap(xs[1], xs[2]);
+				std::swap(ys[1], ys[2]);
+			}
+			int64_t left = std::max<int64_t>(std::min(std::min(xs[0], xs[1]), xs[2]), 0);
+			int64_t right = std::min<int64_t>(std::max(std::max(xs[0], xs[1]), xs[2]), width);
+			int64_t top = std::max<int64_t>(std::min(std::min(ys[0], ys[1]), ys[2]), 0);
+			int64_t bottom = std::min<int64_t>(std::max(std::max(ys[0], ys[1]), ys[2]), height);
+			if (left >= right || top >= bottom)
+			{
+				return;
+			}
+
+			// Edge function of edge a -> b at the centre of pixel (x, y), doubled to stay in integers:
+			// (bx - ax) * (2y + 1 - 2ay) - (by - ay) * (2x + 1 - 2ax), which is positive inside the triangle
+			int64_t stepX[3];
+			int64_t bias[3];
+			for (int e = 0; e < 3; e++)
+			{
+				int a = e;
+				int n = (e + 1) % 3;
+				int64_t ex = xs[n] - xs[a];
+				int64_t ey = ys[n] - ys[a];
+				stepX[e] = -2 * ey;
+				// Centres exactly on top and left edges are inside, those on the other edges are not
+				bias[e] = (ey < 0 || (ey == 0 && ex > 0)) ? 0 : 1;
+			}
+			unsigned char pixel[4];
+			encode(r, g, b, pixel);
+			Kernels::FillRowFunc row = Kernels::fillRow();
+			int64_t drawnTop = bottom;
+			int64_t drawnBottom = top;
+			for (int64_t y = top; y < bottom; y++)
+			{
+				int64_t span0 = left;
+				int64_t span1 = right;
+				for (int e = 0; e < 3; e++)
+				{
+					int a = e;
+					int n = (e + 1) % 3;
+					int64_t start = ((xs[n] - xs[a]) * ((2 * y) + 1 - (2 * ys[a]))) - ((ys[n] - ys[a]) * (1 - (2 * xs[a])));
+					clipHalfSpan(start - bias[e], stepX[e], span0, span1);
+				}
+				if (span0 < span1)
+				{
+					row(atUnchecked(static_cast<unsigned int>(span0), static_cast<unsigned int>(y)), static_cast<unsigned int>(span1 - span0), pixel, bytesPerPixel());
+					drawnTop = std::min(drawnTop, y);
+					drawnBottom = y + 1;
+				}
+			}
+			if (dirty != nullptr && drawnTop < drawnBottom)
+			{
+				dirty->markRect(static_cast<int>(left), static_cast<int>(drawnTop), static_cast<int>(right - left), static_cast<int>(drawnBottom - drawnTop));
+			}
+		}
+
+		// Draws the outline of a polygon. points holds count (x, y) pairs, and the last point is joined to the first
+		void drawPolygon(const int* points, unsigned int count, unsigned char r, unsigned char g, unsigned char b)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				unsigned int next = (i + 1) % count;
+				drawLine(points[i * 2], points[(i * 2) + 1], points[next * 2], points[(next * 2) + 1], r, g, b);
+			}
+		}
+
+		// Fills a polygon using the even-odd rule. points holds count (x, y) pairs. The polygon may be concave or self-intersecting
+		// For each row the edges crossing the row's pixel centres are found, sorted, and the spans between pairs of crossings are filled
+		void fillPolygon(const int* points, unsigned int count, unsigned char r, unsigned char g, unsigned char b)
+		{
+			if (data == nullptr || count < 3)
+			{
+				return;
+			}
+			int top = points[1];
+			int bottom = points[1];
+			for (unsigned int i = 1; i < count; i++)
+			{
+				top = std::min(top, points[(i * 2) + 1]);
+				bottom = std::max(bottom, points[(i * 2) + 1]);
+			}
+			top = std::max(top, 0);
+			bottom = std::min(bottom, static_cast<int>(height));
+			unsigned char pixel[4];
+			encode(r, g, b, pixel);
+			Kernels::FillRowFunc row = Kernels::fillRow();
+			std::vector<double> crossings;
+			int drawnLeft = static_cast<int>(width);
+			int drawnRight = 0;
+			for (int y = top; y < bottom; y++)
+			{
+				double centre = y + 0.5;
+				crossings.clear();
+				for (unsigned int i = 0; i < count; i++)
+				{
+					unsigned int next = (i + 1) % count;
+					double ax = points[i * 2];
+					double ay = points[(i * 2) + 1];
+					double bx = points[next * 2];
+					double by = points[(next * 2) + 1];
+					if ((ay <= centre) != (by <= centre))
+					{
+						crossings.push_back(ax + (((centre - ay) * (bx - ax)) / (by - ay)));
+					}
+				}
+				std::sort(crossings.begin(), crossings.end());
+				for (size_t i = 0; i + 1 < crossings.size(); i += 2)
+				{
+					// Fill the pixels whose centres lie in [crossings[i], crossings[i + 1])
+					double x0 = std::max(ceil(crossings[i] - 0.5), 0.0);
+					double x1 = std::min(ceil(crossings[i + 1] - 0.5), static_cast<double>(width));
+					if (x0 < x1)
+					{
+						row(atUnchecked(static_cast<unsigned int>(x0), y), static_cast<unsigned int>(x1 - x0), pixel, bytesPerPixel());
+						drawnLeft = std::min(drawnLeft, static_cast<int>(x0));
+						drawnRight = std::max(drawnRight, static_cast<int>(x1));
+					}
+				}
+			}
+			if (dirty != nullptr && drawnLeft < drawnRight)
+			{
+				dirty->markRect(drawnLeft, top, drawnRight - drawnLeft, bottom - top);
+			}
+		}
+
+	private:
+		// Fills the pixels from x0 up to but not including x1 on row y, clipped to the surface
+		void fillSpan(int64_t x0, int64_t x1, int y, const unsigned char* pixel, Kernels::FillRowFunc row)
+		{
+			if (y < 0 || y >= static_cast<int>(height))
+			{
+				return;
+			}
+			x0 = std::max<int64_t>(x0, 0);
+			x1 = std::min<int64_t>(x1, width);
+			if (x0 < x1)
+			{
+				row(atUnchecked(static_cast<unsigned int>(x0), static_cast<unsigned int>(y)), static_cast<unsigned int>(x1 - x0), pixel, bytesPerPixel());
+			}
+		}
+
+		// Fills extents with the half width of each row of an ellipse, from the centre row to the top row
+		// A pixel offset (x, y) is inside when (x / (rx + 0.5))^2 + (y / (ry + 0.5))^2 <= 1, the same test the midpoint algorithm makes. Radii are limited to 16383
+		static void ellipseExtents(int rx, int ry, std::vector<int>& extents)
+		{
+			rx = std::min(rx, 16383);
+			ry = std::min(ry, 16383);
+			int64_t a = (2 * rx) + 1;
+			int64_t b = (2 * ry) + 1;
+			int64_t limit = a * a * b * b;
+			extents.resize(ry + 1);
+			int64_t x = rx;
+			for (int64_t y = 0; y <= ry; y++)
+			{
+				// The half width only shrinks moving away from the centre, so the search carries on from the previous row
+				while (x > 0 && (4 * x * x * b * b) + (4 * y * y * a * a) > limit)
+				{
+					x--;
+				}
+				extents[y] = static_cast<int>(x);
+			}
+		}
+
+		// Clips the w x h region starting at (srcX, srcY) of a srcWidth x srcHeight source, drawn at (x, y), against the source and the surface
+		// Returns false if nothing is left to draw, otherwise marks the clipped area dirty
+		bool clipBlit(int& x, int& y, int& srcX, int& srcY, int& w, int& h, unsigned int srcWidth, unsigned int srcHeight)
+		{
+			// Clip the region against the source
+			if (srcX < 0)
+			{
+				x -= srcX;
+				w += srcX;
+				srcX = 0;
+			}
+			if (srcY < 0)
+			{
+				y -= srcY;
+				h += srcY;
+				srcY = 0;
+			}
+			w = std::min(w, static_cast<int>(srcWidth) - srcX);
+			h = std::min(h, static_cast<int>(srcHeight) - srcY);
+
+			// Clip the region against the surface
+			if (x < 0)
+			{
+				srcX -= x;
+				w += x;
+				x = 0;
+			}
+			if (y < 0)
+			{
+				srcY -= y;
+				h += y;
+				y = 0;
+			}
+			w = std::min(w, static_cast<int>(width) - x);
+			h = std::min(h, static_cast<int>(height) - y);
+			if (w <= 0 || h <= 0)
+			{
+				return false;
+			}
+			if (dirty != nullptr)
+			{
+				dirty->markRect(x, y, w, h);
+			}
+			return true;
+		}
+
+		// Division rounding towards negative infinity, for a positive divisor
+		static int64_t floorDiv(int64_t n, int64_t divisor)
+		{
+			int64_t q = n / divisor;
+			return (n % divisor != 0 && n < 0) ? q - 1 : q;
+		}
+
+		// Narrows [x0, x1) to the values of x where start + (x * step) >= 0
+		static void clipHalfSpan(int64_t start, int64_t step, int64_t& x0, int64_t& x1)
+		{
+			if (step == 0)
+			{
+				if (start < 0)
+				{
+					x1 = x0;
+				}
+			} else if (step > 0)
+			{
+				x0 = std::max(x0, -floorDiv(start, step));
+			} else
+			{
+				x1 = std::min(x1, floorDiv(start, -step) + 1);
+			}
+		}
+
+		// Narrows [x0, x1) to the values of x where 0 <= start + (x * step) < limit
+		static void clipSpan(int64_t start, int64_t step, int64_t limit, int64_t& x0, int64_t& x1)
+		{
+			clipHalfSpan(start, step, x0, x1);
+			clipHalfSpan(limit - 1 - start, -step, x0, x1);
+		}
+	};
+
+	// The TextRun class holds a string laid out as horizontal runs of covered pixels, ready to be drawn in any colour
+	// Runs of neighbouring glyphs that touch are joined, so a line of text is usually only a few fills per row
+	class TextRun
+	{
+	private:
+		// A horizontal run of covered pixels within a row
+		struct Span
+		{
+			unsigned int x;        // Start of the run within the row
+			unsigned int length;   // Number of pixels in the run
+		};
+
+		std::vector<Span> spans;            // Runs of all rows, in row order
+		std::vector<unsigned int> rows;     // Index of the first run of each row, plus one entry marking the end
+
+		friend class Font;
+
+	public:
+		unsigned int width = 0;   // Width of the laid out text in pixels
+		unsigned int height = 0;  // Height of the laid out text in pixels
+
+		// Draws the text in a single colour with its top left corner at (x, y), clipped to the surface
+		void draw(Surface& surface, int x, int y, unsigned char r, unsigned char g, unsigned char b) const
+		{
+			if (surface.data == nullptr || rows.empty())
+			{
+				return;
+			}
+			unsigned char pixel[4];
+			surface.encode(r, g, b, pixel);
+			Kernels::FillRowFunc fill = Kernels::fillRow();
+			unsigned int bpp = surface.bytesPerPixel();
+			int y0 = std::max(0, -y);
+			int y1 = std::min(static_cast<int>(height), static_cast<int>(surface.height) - y);
+			for (int row = y0; row < y1; row++)
+			{
+				for (unsigned int i = rows[row]; i < rows[row + 1]; i++)
+				{
+					int start = std::max(x + static_cast<int>(spans[i].x), 0);
+					int end = std::min(x + static_cast<int>(spans[i].x + spans[i].length), static_cast<int>(surface.width));
+					if (start < end)
+					{
+						fill(surface.atUnchecked(start, row + y), end - start, pixel, bpp);
+					}
+				}
+			}
+			if (surface.dirty != nullptr)
+			{
+				surface.dirty->markRect(x, y, static_cast<int>(width), static_cast<int>(height));
+			}
+		}
+
+		// Returns the number of runs
+		unsigned int spanCount() const
+		{
+			return static_cast<unsigned int>(spans.size());
+		}
+	};
+
+	// The Font class holds a glyph atlas built once from a font sheet image
+	// The sheet is a grid of equally sized cells holding consecutive characters, left to right and top to bottom. Each glyph is stored as runs of covered pixels.
+	class Font
+	{
+	private:
+		// A horizontal run of covered pixels within a glyph row
+		struct Span
+		{
+			unsigned int x;        // Start of the run within the glyph
+			unsigned int length;   // Number of pixels in the run
+		};
+
+		std::vector<Span> spans;              // Runs of all glyphs, glyph by glyph and row by row
+		std::vector<unsigned int> rows;       // Index of the first run of each glyph row, glyphHeight entries per glyph, plus one entry marking the end
+		std::vector<unsigned int> advances;   // Horizontal distance from each glyph to the next
+		unsigned int glyphWidth = 0;          // Width of each cell
+		unsigned int glyphHeight = 0;         // Height of each cell
+		unsigned int firstChar = 32;          // Character held by the first cell
+
+		// Returns the index of the glyph for character c, or -1 if the sheet does not hold it
+		int glyphIndex(unsigned char c) const
+		{
+			if (c < firstChar || c - firstChar >= advances.size())
+			{
+				return -1;
+			}
+			return c - firstChar;
+		}
+
+	public:
+		unsigned int spacing = 1;   // Extra pixels between lines of text
+
+		// Builds the atlas from a font sheet with glyphWidth x glyphHeight cells, the first holding character firstChar
+		// A pixel is covered when its alpha, or for sheets without alpha its brightest channel, is above threshold.
+		// When proportional is true each glyph advances by its own width plus one pixel, otherwise by the cell width
+		bool build(const Image& sheet, unsigned int _glyphWidth, unsigned int _glyphHeight, unsigned char _firstChar = 32, unsigned char threshold = 0, bool proportional = false)
+		{
+			spans.clear();
+			rows.clear();
+			advances.clear();
+			glyphWidth = _glyphWidth;
+			glyphHeight = _glyphHeight;
+			firstChar = _firstChar;
+			if (sheet.data == nullptr || (sheet.channels != 3 && sheet.channels != 4) || glyphWidth == 0 || glyphHeight == 0)
+			{
+				return false;
+			}
+			unsigned int columns = sheet.width / glyphWidth;
+			unsigned int count = std::min(columns * (sheet.height / glyphHeight), 256u - firstChar);
+			for (unsigned int glyph = 0; glyph < count; glyph++)
+			{
+				unsigned int cellX = (glyph % columns) * glyphWidth;
+				unsigned int cellY = (glyph / columns) * glyphHeight;
+				unsigned int right = 0;
+				for (unsigned int y = 0; y < glyphHeight; y++)
+				{
+					rows.push_back(static_cast<unsigned int>(spans.size()));
+					auto covered = [&](unsigned int px)
+						{
+							const unsigned char* p = sheet.atUnchecked(cellX + px, cellY + y);
+							return (sheet.channels == 4 ? p[3] : std::max(std::max(p[0], p[1]), p[2])) > threshold;
+						};
+					unsigned int x = 0;
+					while (x < glyphWidth)
+					{
+						while (x < glyphWidth && !covered(x))
+						{
+							x++;
+						}
+						unsigned int start = x;
+						while (x < glyphWidth && covered(x))
+						{
+							x++;
+						}
+						if (x > start)
+						{
+							Span span;
+							span.x = start;
+							span.length = x - start;
+							spans.push_back(span);
+							right = std::max(right, x);
+						}
+					}
+				}
+				// Empty glyphs such as space keep half the cell width when proportional
+				advances.push_back(!proportional ? glyphWidth : (right > 0 ? right + 1 : (glyphWidth + 1) / 2));
+			}
+			rows.push_back(static_cast<unsigned int>(spans.size()));
+			return true;
+		}
+
+		// Returns the height of a line of text, including the spacing between lines
+		unsigned int lineHeight() const
+		{
+			return glyphHeight + spacing;
+		}
+
+		// Returns the horizontal distance from character c to the next. Characters not in the sheet take no space
+		unsigned int advance(unsigned char c) const
+		{
+			int glyph = glyphIndex(c);
+			return glyph < 0 ? 0 : advances[glyph];
+		}
+
+		// Lays out text, which may contain newlines, as runs of covered pixels
+		void layout(const std::string& text, TextRun& run) const
+		{
+			run.spans.clear();
+			run.rows.clear();
+			run.width = 0;
+			run.height = 0;
+			if (glyphHeight == 0 || text.empty())
+			{
+				return;
+			}
+
+			// Split the text into lines and measure them
+			std::vector<std::string> lines;
+			size_t begin = 0;
+			while (true)
+			{
+				size_t end = text.find('\n', begin);
+				lines.push_back(text.substr(begin, end == std::string::npos ? std::string::npos : end - begin));
+				if (end == std::string::npos)
+				{
+					break;
+				}
+				begin = end + 1;
+			}
+			for (const std::string& line : lines)
+			{
+				unsigned int lineWidth = 0;
+				for (unsigned char c : line)
+				{
+					lineWidth += advance(c);
+				}
+				run.width = std::max(run.width, lineWidth);
+			}
+			run.height = (static_cast<unsigned int>(lines.size()) * lineHeight()) - spacing;
+
+			// Gather each row's runs glyph by glyph, joining runs that touch
+			run.rows.reserve(run.height + 1);
+			for (unsigned int y = 0; y < run.height; y++)
+			{
+				run.rows.push_back(static_cast<unsigned int>(run.spans.size()));
+				unsigned int glyphRow = y % lineHeight();
+				if (glyphRow >= glyphHeight)
+				{
+					continue;
+				}
+				const std::string& line = lines[y / lineHeight()];
+				unsigned int penX = 0;
+				size_t rowStart = run.spans.size();
+				for (unsigned char c : line)
+				{
+					int glyph = glyphIndex(c);
+					if (glyph < 0)
+					{
+						continue;
+					}
+					unsigned int row = (glyph * glyphHeight) + glyphRow;
+					for (unsigned int i = rows[row]; i < rows[row + 1]; i++)
+					{
+						unsigned int x = penX + spans[i].x;
+						if (run.spans.size() > rowStart && run.spans.back().x + run.spans.back().length >= x)
+						{
+							TextRun::Span& last = run.spans.back();
+							last.length = std::max(last.length, x + spans[i].length - last.x);
+						} else
+						{
+							TextRun::Span span;
+							span.x = x;
+							span.length = spans[i].length;
+							run.spans.push_back(span);
+						}
+					}
+					penX += advances[glyph];
+				}
+			}
+			run.rows.push_back(static_cast<unsigned int>(run.spans.size()));
+		}
+
+		// Lays out and draws text in a single colour with its top left corner at (x, y)
+		// Use a TextCache for text that is drawn every frame
+		void draw(Surface& surface, const std::string& text, int x, int y, unsigned char r, unsigned char g, unsigned char b) const
+		{
+			TextRun run;
+			layout(text, run);
+			run.draw(surface, x, y, r, g, b);
+		}
+	};
+
+	// The TextCache class keeps laid out strings so text that does not change, such as labels and scores, is only laid out once
+	// When more than maxEntries strings are held the least recently used one is dropped
+	class TextCache
+	{
+	private:
+		// A cached string and when it was last used
+		struct Entry
+		{
+			TextRun run;
+			unsigned int lastUsed;
+		};
+
+		const Font* font;                          // Font used to lay out new strings
+		std::map<std::string, Entry> entries;      // Laid out strings
+		unsigned int maxEntries;                   // Maximum number of strings kept
+		unsigned int useCount = 0;                 // Incremented on every lookup to order entries by use
+
+	public:
+		// Creates a cache for strings laid out with font, which must stay alive as long as the cache
+		TextCache(const Font& _font, unsigned int _maxEntries = 256)
+		{
+			font = &_font;
+			maxEntries = std::max(1u, _maxEntries);
+		}
+
+		// Returns the laid out form of text, laying it out first if it is not cached
+		const TextRun& get(const std::string& text)
+		{
+			useCount++;
+			auto found = entries.find(text);
+			if (found != entries.end())
+			{
+				found->second.lastUsed = useCount;
+				return found->second.run;
+			}
+			if (entries.size() >= maxEntries)
+			{
+				auto oldest = entries.begin();
+				for (auto i = entries.begin(); i != entries.end(); ++i)
+				{
+					if (i->second.lastUsed < oldest->second.lastUsed)
+					{
+						oldest = i;
+					}
+				}
+				entries.erase(oldest);
+			}
+			Entry& entry = entries[text];
+			entry.lastUsed = useCount;
+			font->layout(text, entry.run);
+			return entry.run;
+		}
+
+		// Draws text in a single colour with its top left corner at (x, y)
+		void draw(Surface& surface, const std::string& text, int x, int y, unsigned char r, unsigned char g, unsigned char b)
+		{
+			get(text).draw(surface, x, y, r, g, b);
+		}
+
+		// Removes all cached strings. Call this after rebuilding the font
+		void clear()
+		{
+			entries.clear();
+		}
+
+		// Returns the number of cached strings
+		unsigned int size() const
+		{
+			return static_cast<unsigned int>(entries.size());
+		}
+	};
+
+	// The Tilemap class draws a large grid of tiles taken from a tile atlas image
+	// The map is split into square chunks which are pre-rendered the first time they are seen and kept until their tiles change.
+	// Drawing copies rows of the visible chunks only, so the cost depends on the size of the view, not of the map. The atlas is referenced, not copied, so it must stay alive as long as the map.
+	class Tilemap
+	{
+	private:
+		// A pre-rendered block of the map
+		struct Chunk
+		{
+			std::vector<unsigned char> pixels;   // Rendered pixels in the format they were last drawn in. Empty until the chunk is first seen
+			bool dirty = true;                   // True when a tile has changed since the chunk was rendered
+			unsigned int lastUsed = 0;           // Frame the chunk was last drawn
+		};
+
+		std::vector<int> tiles;                  // Tile index of every map cell, row by row. Negative values are empty
+		std::vector<Chunk> chunks;               // Chunks, row by row
+		std::vector<unsigned int> cached;        // Indices of chunks holding rendered pixels
+		const Image* atlas = nullptr;            // Source of the tile images
+		unsigned int tileSize = 0;               // Width and height of each tile in pixels
+		unsigned int chunkTiles = 0;             // Width and height of each chunk in tiles
+		unsigned int chunksX = 0;                // Number of chunks across the map
+		unsigned int chunksY = 0;                // Number of chunks down the map
+		PixelFormat format = PixelRGB888;        // Format the cached chunks were rendered in
+		unsigned int frame = 0;                  // Incremented on every draw
+		unsigned int baked = 0;                  // Number of chunks rendered by the last draw
+		unsigned char background[3] = { 0, 0, 0 }; // Colour behind empty and transparent tiles
+
+		// Returns the size in pixels of chunk (cx, cy), which is smaller at the right and bottom edges of the map
+		unsigned int chunkPixelsX(unsigned int cx) const
+		{
+			return (std::min((cx + 1) * chunkTiles, mapWidth) - (cx * chunkTiles)) * tileSize;
+		}
+
+		unsigned int chunkPixelsY(unsigned int cy) const
+		{
+			return (std::min((cy + 1) * chunkTiles, mapHeight) - (cy * chunkTiles)) * tileSize;
+		}
+
+		// Renders the tiles of chunk (cx, cy) into its pixel block
+		void bake(unsigned int cx, unsigned int cy)
+		{
+			Chunk& chunk = chunks[(cy * chunksX) + cx];
+			unsigned int w = chunkPixelsX(cx);
+			unsigned int h = chunkPixelsY(cy);
+			unsigned int bpp = format == PixelRGB888 ? 3 : 4;
+			if (chunk.pixels.empty())
+			{
+				cached.push_back((cy * chunksX) + cx);
+			}
+			chunk.pixels.resize(w * h * bpp);
+			Surface target(chunk.pixels.data(), w, h, 0, format);
+			target.clear(background[0], background[1], background[2]);
+			unsigned int atlasColumns = atlas->width / tileSize;
+			unsigned int atlasTiles = atlasColumns * (atlas->height / tileSize);
+			for (unsigned int ty = 0; ty < h / tileSize; ty++)
+			{
+				const int* row = &tiles[(((cy * chunkTiles) + ty) * mapWidth) + (cx * chunkTiles)];
+				for (unsigned int tx = 0; tx < w / tileSize; tx++)
+				{
+					if (row[tx] < 0 || static_cast<unsigned int>(row[tx]) >= atlasTiles)
+					{
+						continue;
+					}
+					unsigned int index = static_cast<unsigned int>(row[tx]);
+					target.blit(*atlas, tx * tileSize, ty * tileSize, (index % atlasColumns) * tileSize, (index / atlasColumns) * tileSize, tileSize, tileSize);
+				}
+			}
+			chunk.dirty = false;
+			baked++;
+		}
+
+		// Frees the least recently drawn chunks until at most maxCachedChunks remain. Chunks drawn this frame are kept
+		void evict()
+		{
+			if (cached.size() <= maxCachedChunks)
+			{
+				return;
+			}
+			std::sort(cached.begin(), cached.end(), [&](unsigned int a, unsigned int b) { return chunks[a].lastUsed > chunks[b].lastUsed; });
+			while (cached.size() > maxCachedChunks && chunks[cached.back()].lastUsed != frame)
+			{
+				Chunk& chunk = chunks[cached.back()];
+				std::vector<unsigned char>().swap(chunk.pixels);
+				chunk.dirty = true;
+				cached.pop_back();
+			}
+		}
+
+	public:
+		unsigned int mapWidth = 0;               // Width of the map in tiles
+		unsigned int mapHeight = 0;              // Height of the map in tiles
+		unsigned int maxCachedChunks = 256;      // Rendered chunks kept between draws. Chunks that are needed again after being dropped are rendered again
+
+		// Creates an empty map of mapWidth x mapHeight tiles. Tile index i is the i-th tileSize x tileSize cell of the atlas, counting left to right and top to bottom
+		// Chunks are chunkSize pixels across, rounded down to whole tiles
+		void create(unsigned int _mapWidth, unsigned int _mapHeight, const Image& _atlas, unsigned int _tileSize, unsigned int chunkSize = 256)
+		{
+			mapWidth = _mapWidth;
+			mapHeight = _mapHeight;
+			atlas = &_atlas;
+			tileSize = std::max(1u, _tileSize);
+			chunkTiles = std::max(1u, chunkSize / tileSize);
+			chunksX = (mapWidth + chunkTiles - 1) / chunkTiles;
+			chunksY = (mapHeight + chunkTiles - 1) / chunkTiles;
+			tiles.assign(mapWidth * mapHeight, -1);
+			chunks.clear();
+			chunks.resize(chunksX * chunksY);
+			cached.clear();
+			frame = 0;
+			baked = 0;
+		}
+
+		// Sets the tile at (x, y). Only the chunk holding it is rendered again
+		void setTile(unsigned int x, unsigned int y, int index)
+		{
+			if (x >= mapWidth || y >= mapHeight)
+			{
+				return;
+			}
+			int& tile = tiles[(y * mapWidth) + x];
+			if (tile != index)
+			{
+				tile = index;
+				chunks[((y / chunkTiles) * chunksX) + (x / chunkTiles)].dirty = true;
+			}
+		}
+
+		// Returns the tile at (x, y), or -1 outside the map
+		int getTile(unsigned int x, unsigned int y) const
+		{
+			if (x >= mapWidth || y >= mapHeight)
+			{
+				return -1;
+			}
+			return tiles[(y * mapWidth) + x];
+		}
+
+		// Sets every tile to index
+		void fill(int index)
+		{
+			std::fill(tiles.begin(), tiles.end(), index);
+			invalidate();
+		}
+
+		// Sets the colour shown behind empty and transparent tiles
+		void setBackground(unsigned char r, unsigned char g, unsigned char b)
+		{
+			background[0] = r;
+			background[1] = g;
+			background[2] = b;
+			invalidate();
+		}
+
+		// Renders every chunk again when it is next drawn. Call this after changing the atlas image
+		void invalidate()
+		{
+			for (Chunk& chunk : chunks)
+			{
+				chunk.dirty = true;
+			}
+		}
+
+		// Draws the part of the map seen by a camera whose top left corner is at map pixel (cameraX, cameraY), filling the whole surface
+		// Areas outside the map are left untouched
+		void draw(Surface& surface, int cameraX, int cameraY)
+		{
+			baked = 0;
+			frame++;
+			if (surface.data == nullptr || chunks.empty())
+			{
+				return;
+			}
+			if (surface.format != format)
+			{
+				// Cached chunks are in the old format, so render them again
+				format = surface.format;
+				invalidate();
+			}
+			unsigned int bpp = surface.bytesPerPixel();
+			int64_t chunkPixels = static_cast<int64_t>(chunkTiles) * tileSize;
+			int64_t mapPixelsX = static_cast<int64_t>(mapWidth) * tileSize;
+			int64_t mapPixelsY = static_cast<int64_t>(mapHeight) * tileSize;
+
+			// Visible part of the map in map pixels
+			int64_t viewX0 = std::max<int64_t>(cameraX, 0);
+			int64_t viewY0 = std::max<int64_t>(cameraY, 0);
+			int64_t viewX1 = std::min<int64_t>(static_cast<int64_t>(cameraX) + surface.width, mapPixelsX);
+			int64_t viewY1 = std::min<int64_t>(static_cast<int64_t>(cameraY) + surface.height, mapPixelsY);
+			if (viewX0 >= viewX1 || viewY0 >= viewY1)
+			{
+				return;
+			}
+			for (int64_t cy = viewY0 / chunkPixels; cy <= (viewY1 - 1) / chunkPixels; cy++)
+			{
+				for (int64_t cx = viewX0 / chunkPixels; cx <= (viewX1 - 1) / chunkPixels; cx++)
+				{
+					Chunk& chunk = chunks[(cy * chunksX) + cx];
+					if (chunk.dirty || chunk.pixels.empty())
+					{
+						bake(static_cast<unsigned int>(cx), static_cast<unsigned int>(cy));
+					}
+					chunk.lastUsed = frame;
+
+					// Copy the visible rows of the chunk
+					unsigned int w = chunkPixelsX(static_cast<unsigned int>(cx));
+					int64_t x0 = std::max(viewX0, cx * chunkPixels);
+					int64_t x1 = std::min(viewX1, (cx * chunkPixels) + w);
+					int64_t y0 = std::max(viewY0, cy * chunkPixels);
+					int64_t y1 = std::min(viewY1, (cy * chunkPixels) + chunkPixelsY(static_cast<unsigned int>(cy)));
+					size_t rowBytes = static_cast<size_t>(x1 - x0) * bpp;
+					for (int64_t y = y0; y < y1; y++)
+					{
+						const unsigned char* src = &chunk.pixels[((((y - (cy * chunkPixels)) * w) + (x0 - (cx * chunkPixels))) * bpp)];
+						memcpy(surface.atUnchecked(static_cast<unsigned int>(x0 - cameraX), static_cast<unsigned int>(y - cameraY)), src, rowBytes);
+					}
+				}
+			}
+			if (surface.dirty != nullptr)
+			{
+				surface.dirty->markRect(static_cast<int>(viewX0 - cameraX), static_cast<int>(viewY0 - cameraY), static_cast<int>(viewX1 - viewX0), static_cast<int>(viewY1 - viewY0));
+			}
+			evict();
+		}
+
+		// Returns the number of chunks rendered by the last draw
+		unsigned int bakedChunks() const
+		{
+			return baked;
+		}
+
+		// Returns the number of chunks currently holding rendered pixels
+		unsigned int cachedChunks() const
+		{
+			return static_cast<unsigned int>(cached.size());
+		}
+	};
+
+	// The ParticleSystem class stores particles as separate arrays of positions, velocities, lifetimes and colors
+	// Keeping each value in its own array lets update() move many particles with each SIMD instruction. Dead particles are removed by moving the last particle into their place, so the order is not kept.
+	class ParticleSystem
+	{
+	private:
+		std::vector<float> x;                // Positions in pixels
+		std::vector<float> y;
+		std::vector<float> vx;               // Velocities in pixels per second
+		std::vector<float> vy;
+		std::vector<float> life;             // Seconds left to live
+		std::vector<float> lifetime;         // Seconds each particle was created with, used to fade it out
+		std::vector<uint32_t> color;         // Colors with red in the lowest byte and alpha in the highest
+		unsigned int capacity;               // Maximum number of live particles
+
+		// Multiplies two values in 0-255 and divides by 255 with rounding
+		static unsigned int mul255(unsigned int a, unsigned int b)
+		{
+			unsigned int v = (a * b) + 128;
+			return (v + (v >> 8)) >> 8;
+		}
+
+		// Combines a color, given in the destination's channel order, with the pixel at p
+		static void splat(unsigned char* p, unsigned int c0, unsigned int c1, unsigned int c2, unsigned int a, ParticleBlend blend)
+		{
+			if (blend == ParticleAdd)
+			{
+				p[0] = static_cast<unsigned char>(std::min(255u, p[0] + mul255(c0, a)));
+				p[1] = static_cast<unsigned char>(std::min(255u, p[1] + mul255(c1, a)));
+				p[2] = static_cast<unsigned char>(std::min(255u, p[2] + mul255(c2, a)));
+			} else
+			{
+				unsigned int c[3] = { c0, c1, c2 };
+				for (int k = 0; k < 3; k++)
+				{
+					// Same rounding as Kernels::blendRowScalar
+					unsigned int v = (c[k] * a) + (p[k] * (255 - a)) + 128;
+					p[k] = static_cast<unsigned char>((v + (v >> 8)) >> 8);
+				}
+			}
+		}
+
+		// Returns the alpha value of particle i, faded by the life it has left when fade is set
+		unsigned int alpha(unsigned int i) const
+		{
+			unsigned int a = color[i] >> 24;
+			if (fade && lifetime[i] > 0.0f)
+			{
+				a = static_cast<unsigned int>((static_cast<float>(a) * std::min(1.0f, life[i] / lifetime[i])) + 0.5f);
+			}
+			return a;
+		}
+
+		// Removes particle i by moving the last particle into its place
+		void remove(unsigned int i)
+		{
+			x[i] = x.back(); x.pop_back();
+			y[i] = y.back(); y.pop_back();
+			vx[i] = vx.back(); vx.pop_back();
+			vy[i] = vy.back(); vy.pop_back();
+			life[i] = life.back(); life.pop_back();
+			lifetime[i] = lifetime.back(); lifetime.pop_back();
+			color[i] = color.back(); color.pop_back();
+		}
+
+	public:
+		float gravityX = 0.0f;               // Acceleration applied to every particle in pixels per second squared
+		float gravityY = 0.0f;
+		bool fade = true;                    // Fade particles out as they reach the end of their life
+
+		// Creates a system holding at most _capacity live particles. Memory for all of them is allocated up front
+		ParticleSystem(unsigned int _capacity = 65536) : capacity(_capacity)
+		{
+			x.reserve(capacity);
+			y.reserve(capacity);
+			vx.reserve(capacity);
+			vy.reserve(capacity);
+			life.reserve(capacity);
+			lifetime.reserve(capacity);
+			color.reserve(capacity);
+		}
+
+		// Adds a particle at (px, py) moving at (velX, velY) pixels per second that lives for seconds
+		// Returns false if the system is full or seconds is not positive
+		bool emit(float px, float py, float velX, float velY, float seconds, unsigned char r, unsigned char g, unsigned char b, unsigned char a = 255)
+		{
+			if (x.size() >= capacity || !(seconds > 0.0f))
+			{
+				return false;
+			}
+			x.push_back(px);
+			y.push_back(py);
+			vx.push_back(velX);
+			vy.push_back(velY);
+			life.push_back(seconds);
+			lifetime.push_back(seconds);
+			color.push_back(static_cast<uint32_t>(r) | (static_cast<uint32_t>(g) << 8) | (static_cast<uint32_t>(b) << 16) | (static_cast<uint32_t>(a) << 24));
+			return true;
+		}
+
+		// Moves every particle forward by dt seconds, usually the value returned by Timer::dt(), and removes particles whose life has run out
+		void update(float dt)
+		{
+			unsigned int n = count();
+			if (n == 0)
+			{
+				return;
+			}
+			Kernels::particleStep()(x.data(), y.data(), vx.data(), vy.data(), life.data(), n, dt, gravityX * dt, gravityY * dt);
+			for (unsigned int i = 0; i < count();)
+			{
+				if (life[i] <= 0.0f)
+				{
+					remove(i);
+				} else
+				{
+					i++;
+				}
+			}
+		}
+
+		// Draws every particle as a single pixel at its position, clipped to the surface
+		void draw(Surface& surface, ParticleBlend blend = ParticleAdd) const
+		{
+			if (surface.data == nullptr)
+			{
+				return;
+			}
+			bool swapRB = surface.format == PixelBGRX8888;
+			unsigned int bpp = surface.bytesPerPixel();
+			float w = static_cast<float>(surface.width);
+			float h = static_cast<float>(surface.height);
+			unsigned int left = surface.width, top = surface.height, right = 0, bottom = 0;
+			for (unsigned int i = 0; i < count(); i++)
+			{
+				// Written so NaN positions are skipped too
+				if (!(x[i] >= 0.0f && y[i] >= 0.0f && x[i] < w && y[i] < h))
+				{
+					continue;
+				}
+				unsigned int a = alpha(i);
+				if (a == 0)
+				{
+					continue;
+				}
+				unsigned int px = static_cast<unsigned int>(x[i]);
+				unsigned int py = static_cast<unsigned int>(y[i]);
+				unsigned int r = color[i] & 0xFF, g = (color[i] >> 8) & 0xFF, b = (color[i] >> 16) & 0xFF;
+				unsigned char* p = surface.atUnchecked(px, py);
+				splat(p, swapRB ? b : r, g, swapRB ? r : b, a, blend);
+				if (bpp == 4)
+				{
+					p[3] = 255;
+				}
+				left = std::min(left, px);
+				top = std::min(top, py);
+				right = std::max(right, px + 1);
+				bottom = std::max(bottom, py + 1);
+			}
+			if (surface.dirty != nullptr && left < right)
+			{
+				surface.dirty->markRect(static_cast<int>(left), static_cast<int>(top), static_cast<int>(right - left), static_cast<int>(bottom - top));
+			}
+		}
+
+		// Draws every particle as a copy of sprite centred on its position, clipped to the surface
+		// The sprite's colors are multiplied by the particle color and its alpha by the particle alpha
+		void draw(Surface& surface, const Image& sprite, ParticleBlend blend = ParticleAdd) const
+		{
+			if (surface.data == nullptr || sprite.data == nullptr)
+			{
+				return;
+			}
+			bool swapRB = surface.format == PixelBGRX8888;
+			unsigned int bpp = surface.bytesPerPixel();
+			float halfW = static_cast<float>(sprite.width) * 0.5f;
+			float halfH = static_cast<float>(sprite.height) * 0.5f;
+			float w = static_cast<float>(surface.width);
+			float h = static_cast<float>(surface.height);
+			int left = static_cast<int>(surface.width), top = static_cast<int>(surface.height), right = 0, bottom = 0;
+
+			// RGBA sprites drawn to 32 bit pixels use a SIMD kernel, other combinations are drawn a pixel at a time
+			Kernels::ParticleSpriteRow32Func row = sprite.channels == 4 && bpp == 4 ? Kernels::particleSpriteRow32() : nullptr;
+			for (unsigned int i = 0; i < count(); i++)
+			{
+				float sx = floorf(x[i] - halfW);
+				float sy = floorf(y[i] - halfH);
+				if (!(sx > -static_cast<float>(sprite.width) && sy > -static_cast<float>(sprite.height) && sx < w && sy < h))
+				{
+					continue;
+				}
+				unsigned int a = alpha(i);
+				if (a == 0)
+				{
+					continue;
+				}
+				int spriteX = static_cast<int>(sx);
+				int spriteY = static_cast<int>(sy);
+				int x0 = std::max(spriteX, 0);
+				int y0 = std::max(spriteY, 0);
+				int x1 = std::min(spriteX + static_cast<int>(sprite.width), static_cast<int>(surface.width));
+				int y1 = std::min(spriteY + static_cast<int>(sprite.height), static_cast<int>(surface.height));
+				left = std::min(left, x0);
+				top = std::min(top, y0);
+				right = std::max(right, x1);
+				bottom = std::max(bottom, y1);
+				if (row != nullptr)
+				{
+					uint32_t tint = (color[i] & 0x00FFFFFF) | (a << 24);
+					for (int py = y0; py < y1; py++)
+					{
+						row(surface.atUnchecked(x0, py), sprite.atUnchecked(x0 - spriteX, py - spriteY), x1 - x0, tint, blend, swapRB);
+					}
+					continue;
+				}
+				unsigned int tint[3] = { color[i] & 0xFF, (color[i] >> 8) & 0xFF, (color[i] >> 16) & 0xFF };
+				for (int py = y0; py < y1; py++)
+				{
+					const unsigned char* src = sprite.atUnchecked(x0 - spriteX, py - spriteY);
+					unsigned char* dst = surface.atUnchecked(x0, py);
+					for (int px = x0; px < x1; px++)
+					{
+						unsigned int weight = sprite.channels == 4 ? mul255(src[3], a) : a;
+						if (weight != 0)
+						{
+							unsigned int r = mul255(src[0], tint[0]), g = mul255(src[1], tint[1]), b = mul255(src[2], tint[2]);
+							splat(dst, swapRB ? b : r, g, swapRB ? r : b, weight, blend);
+						}
+						if (bpp == 4)
+						{
+							dst[3] = 255;
+						}
+						src += sprite.channels;
+						dst += bpp;
+					}
+				}
+			}
+			if (surface.dirty != nullptr && left < right)
+			{
+				surface.dirty->markRect(left, top, right - left, bottom - top);
+			}
+		}
+
+		// Returns the number of live particles
+		unsigned int count() const
+		{
+			return static_cast<unsigned int>(x.size());
+		}
+
+		// Returns the maximum number of live particles
+		unsigned int getCapacity() const
+		{
+			return capacity;
+		}
+
+		// Removes every particle
+		void clear()
+		{
+			x.clear();
+			y.clear();
+			vx.clear();
+			vy.clear();
+			life.clear();
+			lifetime.clear();
+			color.clear();
+		}
+	};
+
+	// The ThreadPool class keeps a set of worker threads alive so work can be spread over all cores without creating threads every frame
+	class ThreadPool
+	{
+	private:
+		std::vector<std::thread> threads;             // Worker threads. The calling thread acts as worker 0
+		std::mutex mutex;                             // Protects the job state below
+		std::condition_variable wake;                 // Signals workers that a job is ready
+		std::condition_variable finished;             // Signals the caller that all workers are done
+		std::function<void(unsigned int)> job;        // Current job, called with the worker index
+		unsigned int generation = 0;                  // Incremented for every job so workers run each job once
+		unsigned int busy = 0;                        // Number of workers still running the current job
+		bool quit = false;                            // Set when the pool is destroyed
+
+		// Main loop of each worker thread
+		void workerLoop(unsigned int index)
+		{
+			unsigned int seen = 0;
+			while (true)
+			{
+				std::function<void(unsigned int)> current;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					wake.wait(lock, [&] { return quit || generation != seen; });
+					if (quit)
+					{
+						return;
+					}
+					seen = generation;
+					current = job;
+				}
+				current(index);
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					busy--;
+				}
+				finished.notify_one();
+			}
+		}
+
+	public:
+		// Creates the pool. A threadCount of 0 uses one worker per hardware thread
+		ThreadPool(unsigned int threadCount = 0)
+		{
+			if (threadCount == 0)
+			{
+				threadCount = std::max(1u, std::thread::hardware_concurrency());
+			}
+			for (unsigned int i = 1; i < threadCount; i++)
+			{
+				threads.emplace_back(&ThreadPool::workerLoop, this, i);
+			}
+		}
+
+		// Returns the number of workers, including the calling thread
+		unsigned int size() const
+		{
+			return static_cast<unsigned int>(threads.size()) + 1;
+		}
+
+		// Calls fn(worker) once for every worker index in parallel and waits for all of them to finish
+		// The calling thread runs worker 0
+		void run(const std::function<void(unsigned int)>& fn)
+		{
+			if (threads.empty())
+			{
+				fn(0);
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				job = fn;
+				busy = static_cast<unsigned int>(threads.size());
+				generation++;
+			}
+			wake.notify_all();
+			fn(0);
+			std::unique_lock<std::mutex> lock(mutex);
+			finished.wait(lock, [&] { return busy == 0; });
+		}
+
+		// Destructor stops and joins the worker threads
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				quit = true;
+			}
+			wake.notify_all();
+			for (auto& thread : threads)
+			{
+				thread.join();
+			}
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+	};
+
+	// The CommandList class records draw calls so they can be executed later by several threads at once
+	// Each call is binned into the screen tiles it touches. On execute the tiles are shared between the workers of a ThreadPool, with idle workers stealing tiles from busy ones.
+	// Within a tile the calls run in the order they were recorded, so the output is identical to drawing serially.
+	// Images, sprites and text runs are referenced, not copied, so they must stay alive until the list has been executed.
+	class CommandList
+	{
+	private:
+		// Types of recorded draw calls
+		enum CommandType
+		{
+			CommandFill = 0,
+			CommandBlitImage = 1,
+			CommandBlitSprite = 2,
+			CommandBlitIndexed = 3,
+			CommandText = 4
+		};
+
+		// A recorded draw call. Coordinates are in surface space
+		struct Command
+		{
+			CommandType type;
+			int x, y, w, h;                      // Destination rectangle or position
+			int srcX, srcY;                      // Source position for image blits
+			unsigned char r, g, b;               // Fill or text colour
+			unsigned char alphaThreshold;        // Alpha threshold for image blits
+			const Image* image;                  // Source image for image blits
+			const CompiledSprite* sprite;        // Source sprite for sprite blits
+			const IndexedImage* indexed;         // Source image for indexed image blits
+			const TextRun* text;                 // Laid out text for text draws
+		};
+
+		// A range of tiles owned by one worker. Other workers take from it once their own range is empty
+		struct alignas(64) TileRange
+		{
+			std::atomic<unsigned int> next;
+			unsigned int end;
+		};
+
+		unsigned int width;                            // Width of the target surface
+		unsigned int height;                           // Height of the target surface
+		unsigned int tileSize;                         // Width and height of a tile in pixels
+		unsigned int tilesX;                           // Number of tile columns
+		unsigned int tilesY;                           // Number of tile rows
+		std::vector<Command> commands;                 // Recorded calls, in order
+		std::vector<std::vector<unsigned int>> bins;   // Indices of the calls touching each tile, in order
+
+		// Stores a call and adds it to the bins of every tile overlapped by the rectangle (x, y, w, h)
+		void record(const Command& command, int x, int y, int w, int h)
+		{
+			unsigned int index = static_cast<unsigned int>(commands.size());
+			commands.push_back(command);
+			int x0 = std::max(x, 0);
+			int y0 = std::max(y, 0);
+			int x1 = std::min(x + w, static_cast<int>(width));
+			int y1 = std::min(y + h, static_cast<int>(height));
+			if (x0 >= x1 || y0 >= y1)
+			{
+				return;
+			}
+			for (int ty = y0 / static_cast<int>(tileSize); ty <= (y1 - 1) / static_cast<int>(tileSize); ty++)
+			{
+				for (int tx = x0 / static_cast<int>(tileSize); tx <= (x1 - 1) / static_cast<int>(tileSize); tx++)
+				{
+					bins[(ty * tilesX) + tx].push_back(index);
+				}
+			}
+		}
+
+		// Runs the calls binned into one tile against the part of the surface it covers
+		void executeTile(Surface& target, unsigned int tile) const
+		{
+			int tileX = static_cast<int>((tile % tilesX) * tileSize);
+			int tileY = static_cast<int>((tile / tilesX) * tileSize);
+			Surface part(target.atUnchecked(tileX, tileY), std::min(tileSize, width - tileX), std::min(tileSize, height - tileY), target.pitch, target.format);
+			for (unsigned int index : bins[tile])
+			{
+				const Command& c = commands[index];
+				switch (c.type)
+				{
+				case CommandFill:
+					part.fillRect(c.x - tileX, c.y - tileY, c.w, c.h, c.r, c.g, c.b);
+					break;
+				case CommandBlitImage:
+					part.blit(*c.image, c.x - tileX, c.y - tileY, c.srcX, c.srcY, c.w, c.h, c.alphaThreshold);
+					break;
+				case CommandBlitSprite:
+					part.blit(*c.sprite, c.x - tileX, c.y - tileY);
+					break;
+				case CommandBlitIndexed:
+					part.blit(*c.indexed, c.x - tileX, c.y - tileY, c.srcX, c.srcY, c.w, c.h);
+					break;
+				case CommandText:
+					c.text->draw(part, c.x - tileX, c.y - tileY, c.r, c.g, c.b);
+					break;
+				}
+			}
+		}
+
+		// Tells the target's dirty tracker about every tile with calls in it
+		void markDirty(Surface& target) const
+		{
+			if (target.dirty == nullptr)
+			{
+				return;
+			}
+			for (unsigned int tile = 0; tile < bins.size(); tile++)
+			{
+				if (!bins[tile].empty())
+				{
+					target.dirty->markRect((tile % tilesX) * tileSize, (tile / tilesX) * tileSize, tileSize, tileSize);
+				}
+			}
+		}
+
+	public:
+		// Creates a list for a width x height target split into tileSize x tileSize tiles
+		CommandList(unsigned int _width, unsigned int _height, unsigned int _tileSize = 64)
+		{
+			width = _width;
+			height = _height;
+			tileSize = std::max(_tileSize, 1u);
+			tilesX = (width + tileSize - 1) / tileSize;
+			tilesY = (height + tileSize - 1) / tileSize;
+			bins.resize(tilesX * tilesY);
+		}
+
+		// Removes all recorded calls. The bins keep their memory so recording the next frame does not allocate
+		void reset()
+		{
+			commands.clear();
+			for (auto& bin : bins)
+			{
+				bin.clear();
+			}
+		}
+
+		// Records filling the whole target with a single colour
+		void clear(unsigned char r, unsigned char g, unsigned char b)
+		{
+			fillRect(0, 0, static_cast<int>(width), static_cast<int>(height), r, g, b);
+		}
+
+		// Records filling a w x h rectangle with its top left corner at (x, y) with a single colour
+		void fillRect(int x, int y, int w, int h, unsigned char r, unsigned char g, unsigned char b)
+		{
+			Command c = {};
+			c.type = CommandFill;
+			c.x = x;
+			c.y = y;
+			c.w = w;
+			c.h = h;
+			c.r = r;
+			c.g = g;
+			c.b = b;
+			record(c, x, y, w, h);
+		}
+
+		// Records drawing an image with its top left corner at (x, y)
+		void blit(const Image& image, int x, int y, unsigned char alphaThreshold = 0)
+		{
+			blit(image, x, y, 0, 0, static_cast<int>(image.width), static_cast<int>(image.height), alphaThreshold);
+		}
+
+		// Records drawing the w x h region of an image starting at (srcX, srcY) with its top left corner at (x, y)
+		void blit(const Image& image, int x, int y, int srcX, int srcY, int w, int h, unsigned char alphaThreshold = 0)
+		{
+			Command c = {};
+			c.type = CommandBlitImage;
+			c.x = x;
+			c.y = y;
+			c.w = w;
+			c.h = h;
+			c.srcX = srcX;
+			c.srcY = srcY;
+			c.alphaThreshold = alphaThreshold;
+			c.image = &image;
+			record(c, x, y, w, h);
+		}
+
+		// Records drawing the image packed into an atlas under handle with its top left corner at (x, y)
+		void blit(const TextureAtlas& atlas, unsigned int handle, int x, int y, unsigned char alphaThreshold = 0)
+		{
+			const AtlasRegion& r = atlas.region(handle);
+			blit(atlas.image, x, y, static_cast<int>(r.x), static_cast<int>(r.y), static_cast<int>(r.width), static_cast<int>(r.height), alphaThreshold);
+		}
+
+		// Records drawing an indexed image with its top left corner at (x, y)
+		void blit(const IndexedImage& image, int x, int y)
+		{
+			blit(image, x, y, 0, 0, static_cast<int>(image.width), static_cast<int>(image.height));
+		}
+
+		// Records drawing the w x h region of an indexed image starting at (srcX, srcY) with its top left corner at (x, y)
+		void blit(const IndexedImage& image, int x, int y, int srcX, int srcY, int w, int h)
+		{
+			Command c = {};
+			c.type = CommandBlitIndexed;
+			c.x = x;
+			c.y = y;
+			c.w = w;
+			c.h = h;
+			c.srcX = srcX;
+			c.srcY = srcY;
+			c.indexed = &image;
+			record(c, x, y, w, h);
+		}
+
+		// Records drawing a compiled sprite with its top left corner at (x, y)
+		void blit(const CompiledSprite& sprite, int x, int y)
+		{
+			Command c = {};
+			c.type = CommandBlitSprite;
+			c.x = x;
+			c.y = y;
+			c.sprite = &sprite;
+			record(c, x, y, static_cast<int>(sprite.width), static_cast<int>(sprite.height));
+		}
+
+		// Records drawing laid out text in a single colour with its top left corner at (x, y)
+		// A run taken from a TextCache must not be evicted before the list is executed
+		void drawText(const TextRun& run, int x, int y, unsigned char r, unsigned char g, unsigned char b)
+		{
+			Command c = {};
+			c.type = CommandText;
+			c.x = x;
+			c.y = y;
+			c.r = r;
+			c.g = g;
+			c.b = b;
+			c.text = &run;
+			record(c, x, y, static_cast<int>(run.width), static_cast<int>(run.height));
+		}
+
+		// Runs the recorded calls on a single thread
+		void execute(Surface& target) const
+		{
+			markDirty(target);
+			for (unsigned int tile = 0; tile < bins.size(); tile++)
+			{
+				executeTile(target, tile);
+			}
+		}
+
+		// Runs the recorded calls on all workers of the pool
+		// The target must be at least as large as the size given to the constructor
+		void execute(Surface& target, ThreadPool& pool) const
+		{
+			markDirty(target);
+			unsigned int tileCount = static_cast<unsigned int>(bins.size());
+			unsigned int workers = pool.size();
+			std::unique_ptr<TileRange[]> ranges(new TileRange[workers]);
+			for (unsigned int i = 0; i < workers; i++)
+			{
+				ranges[i].next = (tileCount * i) / workers;
+				ranges[i].end = (tileCount * (i + 1)) / workers;
+			}
+			pool.run([&](unsigned int worker)
+				{
+					// Work through our own range first, then steal from the others
+					for (unsigned int k = 0; k < workers; k++)
+					{
+						TileRange& range = ranges[(worker + k) % workers];
+						while (true)
+						{
+							unsigned int tile = range.next.fetch_add(1);
+							if (tile >= range.end)
+							{
+								break;
+							}
+							executeTile(target, tile);
+						}
+					}
+				});
+		}
+
+		// Returns the number of recorded calls
+		unsigned int commandCount() const
+		{
+			return static_cast<unsigned int>(commands.size());
+		}
+
+		// Returns the number of tiles
+		unsigned int tileCount() const
+		{
+			return tilesX * tilesY;
+		}
+	};
+
+	// The PresentQueue class rotates a set of back buffers between the game thread and a presenter thread
+	// The game draws into current() while finished frames are passed to the present function on the presenter thread, oldest first.
+	// submit() only waits when every other buffer is still queued, so the game never runs more than bufferCount - 1 frames ahead of the display.
+	class PresentQueue
+	{
+	private:
+		std::vector<unsigned char*> buffers;          // All buffers, owned by the queue
+		std::vector<unsigned int> queued;             // Buffers waiting to be presented, oldest first
+		std::vector<unsigned int> available;          // Buffers free for drawing, oldest first
+		unsigned int drawing = 0;                     // Buffer the game is drawing into
+		std::function<void(const unsigned char*, unsigned int)> presentFn; // Called with each finished buffer and its frame number
+		std::thread thread;                           // Presenter thread
+		mutable std::mutex mutex;                     // Protects the queue state below
+		std::condition_variable work;                 // Signals the presenter that a frame has been queued
+		std::condition_variable done;                 // Signals the game thread that a frame has been presented
+		bool presenting = false;                      // True while the presenter is working on a buffer
+		unsigned int presented = 0;                   // Number of frames presented since start()
+		bool quit = false;                            // Set by stop()
+
+		// Main loop of the presenter thread. Queued frames are still presented after quit is set
+		void presenterLoop()
+		{
+			while (true)
+			{
+				unsigned int index;
+				unsigned int frame;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					work.wait(lock, [&] { return quit || !queued.empty(); });
+					if (queued.empty())
+					{
+						return;
+					}
+					index = queued.front();
+					queued.erase(queued.begin());
+					frame = presented;
+					presenting = true;
+				}
+				presentFn(buffers[index], frame);
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					available.push_back(index);
+					presenting = false;
+					presented++;
+				}
+				done.notify_all();
+			}
+		}
+
+	public:
+		PresentQueue() {}
+
+		// Allocates bufferCount buffers of bufferSize bytes and starts the presenter thread. At least 2 buffers are used
+		// The buffers are copied from initial if it is given, otherwise they are cleared to zero
+		void start(unsigned int bufferCount, unsigned int bufferSize, const std::function<void(const unsigned char*, unsigned int)>& fn, const unsigned char* initial = nullptr)
+		{
+			stop();
+			bufferCount = std::max(2u, bufferCount);
+			for (unsigned int i = 0; i < bufferCount; i++)
+			{
+				unsigned char* data = new unsigned char[bufferSize];
+				if (initial)
+				{
+					memcpy(data, initial, bufferSize);
+				} else
+				{
+					memset(data, 0, bufferSize);
+				}
+				buffers.push_back(data);
+				if (i > 0)
+				{
+					available.push_back(i);
+				}
+			}
+			drawing = 0;
+			presented = 0;
+			quit = false;
+			presentFn = fn;
+			thread = std::thread(&PresentQueue::presenterLoop, this);
+		}
+
+		// Presents any queued frames, stops the presenter thread and frees the buffers
+		void stop()
+		{
+			if (thread.joinable())
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					quit = true;
+				}
+				work.notify_one();
+				thread.join();
+			}
+			for (unsigned char* data : buffers)
+			{
+				delete[] data;
+			}
+			buffers.clear();
+			queued.clear();
+			available.clear();
+		}
+
+		// Returns true between start() and stop()
+		bool active() const
+		{
+			return !buffers.empty();
+		}
+
+		// Returns the number of buffers in the rotation
+		unsigned int bufferCount() const
+		{
+			return static_cast<unsigned int>(buffers.size());
+		}
+
+		// Returns the buffer to draw into
+		unsigned char* current() const
+		{
+			return buffers.empty() ? nullptr : buffers[drawing];
+		}
+
+		// Queues the current buffer to be presented and returns the next buffer to draw into
+		// The returned buffer still holds the frame drawn bufferCount frames ago. Returns nullptr, queuing nothing, before start() or after stop()
+		unsigned char* submit()
+		{
+			if (buffers.empty())
+			{
+				return nullptr;
+			}
+			std::unique_lock<std::mutex> lock(mutex);
+			queued.push_back(drawing);
+			work.notify_one();
+			done.wait(lock, [&] { return !available.empty(); });
+			drawing = available.front();
+			available.erase(available.begin());
+			return buffers[drawing];
+		}
+
+		// Returns the number of frames queued or being presented
+		unsigned int queueDepth() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return static_cast<unsigned int>(queued.size()) + (presenting ? 1 : 0);
+		}
+
+		// Returns the number of frames presented since start()
+		unsigned int presentedCount() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return presented;
+		}
+
+		// Waits until every submitted frame has been presented
+		void flush()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [&] { return queued.empty() && !presenting; });
+		}
+
+		// Destructor presents any queued frames and stops the presenter thread
+		~PresentQueue()
+		{
+			stop();
+		}
+
+		PresentQueue(const PresentQueue&) = delete;
+		PresentQueue& operator=(const PresentQueue&) = delete;
+	};
+
+	// The FrameCapture class saves screenshots without stalling the frame
+	// capture() only copies the pixels into a free staging buffer. Encoding and writing the file happen on a background thread.
+	// The number of staging buffers bounds the queue. When they are all busy the capture is dropped, or with dropOldest the oldest waiting capture is dropped instead.
+	class FrameCapture
+	{
+	private:
+		// A capture waiting to be written
+		struct Job
+		{
+			unsigned int buffer;             // Staging buffer holding the pixels
+			unsigned int width;
+			unsigned int height;
+			PixelFormat format;              // Layout of the pixels, rows are tightly packed
+			CaptureEncoding encoding;
+			std::string filename;
+		};
+
+		std::vector<std::vector<unsigned char>> buffers;  // Staging buffers, kept between captures so they are only allocated once
+		std::vector<unsigned int> available;          // Buffers free for the next capture
+		std::vector<Job> queued;                      // Captures waiting to be written, oldest first
+		std::thread thread;                           // Writer thread
+		mutable std::mutex mutex;                     // Protects the state below
+		std::condition_variable work;                 // Signals the writer that a capture has been queued
+		std::condition_variable done;                 // Signals that a capture has been written
+		bool writing = false;                         // True while the writer is working on a capture
+		bool quit = false;                            // Set by the destructor
+		unsigned int written = 0;                     // Number of files written
+		unsigned int dropped = 0;                     // Number of captures dropped because the queue was full
+		unsigned int failed = 0;                      // Number of files that could not be written
+		float lastCost = 0.0f;                        // Time spent in the last capture() call in milliseconds
+		float totalCost = 0.0f;                       // Time spent in all capture() calls in milliseconds
+		unsigned int calls = 0;                       // Number of capture() calls
+		float lastEncode = 0.0f;                      // Time taken to encode and write the last file in milliseconds
+
+		// Converts the pixels of a job to RGB888, encodes them and writes the file
+		static bool writeJob(const Job& job, const std::vector<unsigned char>& pixels)
+		{
+			std::vector<unsigned char> rgb;
+			const unsigned char* source = pixels.data();
+			if (job.format != PixelRGB888)
+			{
+				rgb.resize(static_cast<size_t>(job.width) * job.height * 3);
+				Kernels::ConvertRowFunc pack = Kernels::packRow24();
+				for (unsigned int y = 0; y < job.height; y++)
+				{
+					pack(&rgb[static_cast<size_t>(y) * job.width * 3], &pixels[static_cast<size_t>(y) * job.width * 4], job.width, job.format == PixelBGRX8888);
+				}
+				source = rgb.data();
+			}
+			std::vector<unsigned char> file;
+			if (job.encoding == CaptureQOI)
+			{
+				Codecs::encodeQOI(source, job.width, job.height, file);
+			} else
+			{
+				Codecs::encodePNG(source, job.width, job.height, file);
+			}
+			std::ofstream out(job.filename, std::ios::binary);
+			if (!out)
+			{
+				return false;
+			}
+			out.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+			return static_cast<bool>(out);
+		}
+
+		// Main loop of the writer thread. Queued captures are still written after quit is set
+		void writerLoop()
+		{
+			while (true)
+			{
+				Job job;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					work.wait(lock, [&] { return quit || !queued.empty(); });
+					if (queued.empty())
+					{
+						return;
+					}
+					job = queued.front();
+					queued.erase(queued.begin());
+					writing = true;
+				}
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				bool ok = writeJob(job, buffers[job.buffer]);
+				float elapsed = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					available.push_back(job.buffer);
+					writing = false;
+					lastEncode = elapsed;
+					if (ok)
+					{
+						written++;
+					} else
+					{
+						failed++;
+					}
+				}
+				done.notify_all();
+			}
+		}
+
+	public:
+		bool dropOldest = false;                      // When the queue is full, drop the oldest waiting capture instead of the new one
+
+		// Creates bufferCount staging buffers, at least 1, and starts the writer thread
+		FrameCapture(unsigned int bufferCount = 3)
+		{
+			bufferCount = std::max(1u, bufferCount);
+			buffers.resize(bufferCount);
+			for (unsigned int i = 0; i < bufferCount; i++)
+			{
+				available.push_back(i);
+			}
+			thread = std::thread(&FrameCapture::writerLoop, this);
+		}
+
+		// Writes any queued captures and stops the writer thread
+		~FrameCapture()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				quit = true;
+			}
+			work.notify_one();
+			thread.join();
+		}
+
+		FrameCapture(const FrameCapture&) = delete;
+		FrameCapture& operator=(const FrameCapture&) = delete;
+
+		// Copies the surface into a staging buffer and queues it to be written to filename
+		// Returns false if the capture was dropped because every staging buffer was busy
+		bool capture(const Surface& surface, const std::string& filename, CaptureEncoding encoding = CapturePNG)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			bool queuedCapture = false;
+			if (surface.data != nullptr)
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				if (available.empty() && dropOldest && !queued.empty())
+				{
+					available.push_back(queued.front().buffer);
+					queued.erase(queued.begin());
+					dropped++;
+				}
+				if (available.empty())
+				{
+					dropped++;
+				} else
+				{
+					unsigned int index = available.front();
+					available.erase(available.begin());
+					lock.unlock();
+
+					// The buffer is not shared with the writer until it is queued, so copy without holding the lock
+					size_t rowBytes = static_cast<size_t>(surface.width) * surface.bytesPerPixel();
+					std::vector<unsigned char>& buffer = buffers[index];
+					buffer.resize(rowBytes * surface.height);
+					for (unsigned int y = 0; y < surface.height; y++)
+					{
+						memcpy(&buffer[y * rowBytes], surface.atUnchecked(0, y), rowBytes);
+					}
+					lock.lock();
+					queued.push_back({ index, surface.width, surface.height, surface.format, encoding, filename });
+					queuedCapture = true;
+				}
+			}
+			if (queuedCapture)
+			{
+				work.notify_one();
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			lastCost = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+			totalCost += lastCost;
+			calls++;
+			return queuedCapture;
+		}
+
+		// Waits until every queued capture has been written
+		void flush()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [&] { return queued.empty() && !writing; });
+		}
+
+		// Returns the number of captures queued or being written
+		unsigned int pending() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return static_cast<unsigned int>(queued.size()) + (writing ? 1 : 0);
+		}
+
+		// Returns the number of files written
+		unsigned int writtenCount() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return written;
+		}
+
+		// Returns the number of captures dropped because the queue was full
+		unsigned int droppedCount() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return dropped;
+		}
+
+		// Returns the number of files that could not be written
+		unsigned int failedCount() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return failed;
+		}
+
+		// Returns the time the last capture() call took on the calling thread, in milliseconds. This is the cost the frame pays
+		float lastCaptureCost() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return lastCost;
+		}
+
+		// Returns the average time of all capture() calls in milliseconds
+		float averageCaptureCost() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return calls == 0 ? 0.0f : totalCost / static_cast<float>(calls);
+		}
+
+		// Returns the time the writer thread took to encode and write the last file, in milliseconds
+		float lastEncodeCost() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return lastEncode;
+		}
+	};
+
+	// The FrameRecorder class records a stream of frames to a single file without slowing the game down
+	// record() copies the frame into a ring of reusable buffers and a worker thread converts, compresses and writes it. When the ring is full the frame is dropped and counted.
+	// Window::setRecorder() makes every present() record the frame.
+	class FrameRecorder
+	{
+	private:
+		// A frame waiting to be written
+		struct Job
+		{
+			unsigned int buffer;             // Ring buffer holding the pixels
+			unsigned int frame;              // Number of the frame since start(), including dropped frames
+		};
+
+		std::vector<std::vector<unsigned char>> buffers;  // Ring of frame copies
+		std::vector<unsigned int> available;          // Buffers free for the next frame
+		std::vector<Job> queued;                      // Frames waiting to be written, oldest first
+		std::thread thread;                           // Writer thread
+		mutable std::mutex mutex;                     // Protects the state below
+		std::condition_variable work;                 // Signals the writer that a frame has been queued
+		std::condition_variable done;                 // Signals that a frame has been written
+		bool writing = false;                         // True while the writer is working on a frame
+		bool quit = false;                            // Set by stop()
+		bool active = false;                          // True between start() and stop()
+		unsigned int frames = 0;                      // Number of record() calls since start()
+		unsigned int written = 0;                     // Number of frames written
+		unsigned int dropped = 0;                     // Number of frames dropped
+		uint64_t bytes = 0;                           // Number of bytes written to the file
+		float lastCost = 0.0f;                        // Time spent in the last record() call in milliseconds
+		float totalCost = 0.0f;                       // Time spent in all record() calls in milliseconds
+
+		// Stream settings, fixed by start() and the first frame
+		std::ofstream out;
+		RecordFormat format = RecordDelta;
+		unsigned int fps = 60;
+		unsigned int tileSize = 32;
+		unsigned int width = 0;
+		unsigned int height = 0;
+		PixelFormat pixelFormat = PixelRGB888;
+
+		// Used only by the writer thread
+		std::vector<unsigned char> rgb;               // Frame being written, as RGB888
+		std::vector<unsigned char> previous;          // Last frame written, as RGB888
+		std::vector<unsigned char> encoded;           // Encoded frame
+
+		// Run length encodes count RGB pixels taken a row at a time from a tile of the frame
+		// A header byte h below 128 is followed by h + 1 literal pixels, otherwise the single pixel that follows repeats h - 126 times
+		static void encodeTile(const unsigned char* frame, unsigned int pitch, unsigned int tileWidth, unsigned int tileHeight, std::vector<unsigned char>& data)
+		{
+			std::vector<const unsigned char*> pixels;
+			pixels.reserve(tileWidth * tileHeight);
+			for (unsigned int y = 0; y < tileHeight; y++)
+			{
+				for (unsigned int x = 0; x < tileWidth; x++)
+				{
+					pixels.push_back(&frame[(y * pitch) + (x * 3)]);
+				}
+			}
+			auto same = [&](size_t a, size_t b) { return memcmp(pixels[a], pixels[b], 3) == 0; };
+			size_t i = 0;
+			while (i < pixels.size())
+			{
+				size_t run = 1;
+				while (i + run < pixels.size() && run < 129 && same(i + run, i))
+				{
+					run++;
+				}
+				if (run >= 2)
+				{
+					data.push_back(static_cast<unsigned char>(126 + run));
+					data.insert(data.end(), pixels[i], pixels[i] + 3);
+					i += run;
+					continue;
+				}
+				size_t start = i;
+				do
+				{
+					i++;
+				} while (i < pixels.size() && i - start < 128 && !(i + 1 < pixels.size() && same(i, i + 1)));
+				data.push_back(static_cast<unsigned char>(i - start - 1));
+				for (size_t k = start; k < i; k++)
+				{
+					data.insert(data.end(), pixels[k], pixels[k] + 3);
+				}
+			}
+		}
+
+		// Encodes the tiles of rgb that differ from previous. The first frame stores every tile
+		void encodeDelta(unsigned int frame)
+		{
+			encoded.clear();
+			if (written == 0)
+			{
+				encoded.insert(encoded.end(), { 'G', 'E', 'B', 'R' });
+				Codecs::writeLittleEndian(encoded, 1);
+				Codecs::writeLittleEndian(encoded, width);
+				Codecs::writeLittleEndian(encoded, height);
+				Codecs::writeLittleEndian(encoded, tileSize);
+			}
+			Codecs::writeLittleEndian(encoded, frame);
+			size_t countAt = encoded.size();
+			Codecs::writeLittleEndian(encoded, 0);
+			uint32_t changed = 0;
+			unsigned int pitch = width * 3;
+			unsigned int tilesX = (width + tileSize - 1) / tileSize;
+			unsigned int tilesY = (height + tileSize - 1) / tileSize;
+			for (unsigned int ty = 0; ty < tilesY; ty++)
+			{
+				for (unsigned int tx = 0; tx < tilesX; tx++)
+				{
+					unsigned int x0 = tx * tileSize;
+					unsigned int y0 = ty * tileSize;
+					unsigned int w = std::min(tileSize, width - x0);
+					unsigned int h = std::min(tileSize, height - y0);
+					const unsigned char* tile = &rgb[(y0 * pitch) + (x0 * 3)];
+					bool differs = previous.empty();
+					for (unsigned int y = 0; y < h && !differs; y++)
+					{
+						differs = memcmp(&tile[y * pitch], &previous[((y0 + y) * pitch) + (x0 * 3)], w * 3) != 0;
+					}
+					if (!differs)
+					{
+						continue;
+					}
+					Codecs::writeLittleEndian(encoded, (ty * tilesX) + tx);
+					size_t sizeAt = encoded.size();
+					Codecs::writeLittleEndian(encoded, 0);
+					encodeTile(tile, pitch, w, h, encoded);
+					uint32_t size = static_cast<uint32_t>(encoded.size() - sizeAt - 4);
+					memcpy(&encoded[sizeAt], &size, 4);
+					changed++;
+				}
+			}
+			encoded[countAt] = static_cast<unsigned char>(changed);
+			encoded[countAt + 1] = static_cast<unsigned char>(changed >> 8);
+			encoded[countAt + 2] = static_cast<unsigned char>(changed >> 16);
+			encoded[countAt + 3] = static_cast<unsigned char>(changed >> 24);
+			previous.swap(rgb);
+		}
+
+		// Converts rgb to a Y4M frame using BT.601 studio swing coefficients
+		void encodeY4M()
+		{
+			encoded.clear();
+			if (written == 0)
+			{
+				std::string header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) + " F" + std::to_string(fps) + ":1 Ip A1:1 C444\n";
+				encoded.insert(encoded.end(), header.begin(), header.end());
+			}
+			static const char frameHeader[] = "FRAME\n";
+			encoded.insert(encoded.end(), frameHeader, frameHeader + 6);
+			size_t count = static_cast<size_t>(width) * height;
+			size_t start = encoded.size();
+			encoded.resize(start + (count * 3));
+			unsigned char* planeY = &encoded[start];
+			unsigned char* planeU = planeY + count;
+			unsigned char* planeV = planeU + count;
+			for (size_t i = 0; i < count; i++)
+			{
+				int r = rgb[(i * 3)];
+				int g = rgb[(i * 3) + 1];
+				int b = rgb[(i * 3) + 2];
+				planeY[i] = static_cast<unsigned char>((((66 * r) + (129 * g) + (25 * b) + 128) >> 8) + 16);
+				planeU[i] = static_cast<unsigned char>((((-38 * r) - (74 * g) + (112 * b) + 128) >> 8) + 128);
+				planeV[i] = static_cast<unsigned char>((((112 * r) - (94 * g) - (18 * b) + 128) >> 8) + 128);
+			}
+		}
+
+		// Main loop of the writer thread. Queued frames are still written after quit is set
+		void writerLoop()
+		{
+			while (true)
+			{
+				Job job;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					work.wait(lock, [&] { return quit || !queued.empty(); });
+					if (queued.empty())
+					{
+						return;
+					}
+					job = queued.front();
+					queued.erase(queued.begin());
+					writing = true;
+				}
+				const std::vector<unsigned char>& pixels = buffers[job.buffer];
+				rgb.resize(static_cast<size_t>(width) * height * 3);
+				if (pixelFormat == PixelRGB888)
+				{
+					memcpy(rgb.data(), pixels.data(), rgb.size());
+				} else
+				{
+					Kernels::ConvertRowFunc pack = Kernels::packRow24();
+					for (unsigned int y = 0; y < height; y++)
+					{
+						pack(&rgb[static_cast<size_t>(y) * width * 3], &pixels[static_cast<size_t>(y) * width * 4], width, pixelFormat == PixelBGRX8888);
+					}
+				}
+				{
+					// The ring buffer is no longer needed once converted
+					std::lock_guard<std::mutex> lock(mutex);
+					available.push_back(job.buffer);
+				}
+				done.notify_all();
+				if (format == RecordY4M)
+				{
+					encodeY4M();
+				} else
+				{
+					encodeDelta(job.frame);
+				}
+				out.write(reinterpret_cast<const char*>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					writing = false;
+					written++;
+					bytes += encoded.size();
+				}
+				done.notify_all();
+			}
+		}
+
+	public:
+		// Creates a recorder with a ring of bufferCount frame buffers, at least 1
+		FrameRecorder(unsigned int bufferCount = 4)
+		{
+			buffers.resize(std::max(1u, bufferCount));
+		}
+
+		// Writes any queued frames and closes the file
+		~FrameRecorder()
+		{
+			stop();
+		}
+
+		FrameRecorder(const FrameRecorder&) = delete;
+		FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+		// Opens filename and starts the writer thread. The frame size is taken from the first recorded frame
+		// fps is only stored in Y4M headers. tileSize is the size of the squares compared between frames in RecordDelta streams
+		bool start(const std::string& filename, RecordFormat _format = RecordDelta, unsigned int _fps = 60, unsigned int _tileSize = 32)
+		{
+			stop();
+			out.open(filename, std::ios::binary);
+			if (!out)
+			{
+				return false;
+			}
+			format = _format;
+			fps = std::max(1u, _fps);
+			tileSize = std::max(1u, _tileSize);
+			width = 0;
+			height = 0;
+			previous.clear();
+			queued.clear();
+			available.clear();
+			for (unsigned int i = 0; i < buffers.size(); i++)
+			{
+				available.push_back(i);
+			}
+			frames = 0;
+			written = 0;
+			dropped = 0;
+			bytes = 0;
+			lastCost = 0.0f;
+			totalCost = 0.0f;
+			quit = false;
+			active = true;
+			thread = std::thread(&FrameRecorder::writerLoop, this);
+			return true;
+		}
+
+		// Writes any queued frames, stops the writer thread and closes the file
+		void stop()
+		{
+			if (!active)
+			{
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				quit = true;
+			}
+			work.notify_one();
+			thread.join();
+			out.close();
+			active = false;
+		}
+
+		// Returns true between start() and stop()
+		bool recording() const
+		{
+			return active;
+		}
+
+		// Copies the surface into the ring and queues it to be written
+		// Returns false if the frame was dropped, either because the ring was full or because its size or format differs from the first frame
+		bool record(const Surface& surface)
+		{
+			if (!active || surface.data == nullptr)
+			{
+				return false;
+			}
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			std::unique_lock<std::mutex> lock(mutex);
+			unsigned int frame = frames++;
+			if (width == 0)
+			{
+				width = surface.width;
+				height = surface.height;
+				pixelFormat = surface.format;
+			}
+			bool ok = !available.empty() && surface.width == width && surface.height == height && surface.format == pixelFormat;
+			if (ok)
+			{
+				unsigned int index = available.front();
+				available.erase(available.begin());
+				lock.unlock();
+
+				// The buffer is not shared with the writer until it is queued, so copy without holding the lock
+				size_t rowBytes = static_cast<size_t>(width) * surface.bytesPerPixel();
+				std::vector<unsigned char>& buffer = buffers[index];
+				buffer.resize(rowBytes * height);
+				for (unsigned int y = 0; y < height; y++)
+				{
+					memcpy(&buffer[y * rowBytes], surface.atUnchecked(0, y), rowBytes);
+				}
+				lock.lock();
+				queued.push_back({ index, frame });
+				work.notify_one();
+			} else
+			{
+				dropped++;
+			}
+			lastCost = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+			totalCost += lastCost;
+			return ok;
+		}
+
+		// Waits until every queued frame has been written
+		void flush()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [&] { return queued.empty() && !writing; });
+		}
+
+		// Returns the number of frames queued or being written. This reaches the ring size when the writer cannot keep up
+		unsigned int queueDepth() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return static_cast<unsigned int>(queued.size()) + (writing ? 1 : 0);
+		}
+
+		// Returns the number of frames written
+		unsigned int writtenCount() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return written;
+		}
+
+		// Returns the number of frames dropped
+		unsigned int droppedCount() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return dropped;
+		}
+
+		// Returns the number of bytes written to the file
+		uint64_t bytesWritten() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return bytes;
+		}
+
+		// Returns the time the last record() call took on the calling thread, in milliseconds
+		float lastRecordCost() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return lastCost;
+		}
+
+		// Returns the average time of all record() calls since start() in milliseconds
+		float averageRecordCost() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return frames == 0 ? 0.0f : totalCost / static_cast<float>(frames);
+		}
+	};
+
+	// The RecordingReader class plays back streams written by FrameRecorder in the RecordDelta format
+	class RecordingReader
+	{
+	private:
+		std::ifstream in;                          // Stream being read
+		std::vector<unsigned char> pixels;         // Current frame as RGB888
+		std::vector<unsigned char> data;           // Encoded tile being read
+
+		// Reads a 32 bit little endian value
+		bool read(uint32_t& value)
+		{
+			unsigned char b[4];
+			if (!in.read(reinterpret_cast<char*>(b), 4))
+			{
+				return false;
+			}
+			value = static_cast<uint32_t>(b[0]) | (static_cast<uint32_t>(b[1]) << 8) | (static_cast<uint32_t>(b[2]) << 16) | (static_cast<uint32_t>(b[3]) << 24);
+			return true;
+		}
+
+	public:
+		unsigned int width = 0;                    // Frame width
+		unsigned int height = 0;                   // Frame height
+		unsigned int tileSize = 0;                 // Size of the tiles stored in the stream
+		unsigned int frame = 0;                    // Number of the current frame. Gaps show frames dropped while recording
+
+		// Opens a stream and reads its header. The frame starts black
+		bool open(const std::string& filename)
+		{
+			in.close();
+			in.clear();
+			in.open(filename, std::ios::binary);
+			char magic[4];
+			uint32_t version;
+			if (!in.read(magic, 4) || memcmp(magic, "GEBR", 4) != 0 || !read(version) || version != 1 || !read(width) || !read(height) || !read(tileSize) || tileSize == 0)
+			{
+				return false;
+			}
+			pixels.assign(static_cast<size_t>(width) * height * 3, 0);
+			frame = 0;
+			return true;
+		}
+
+		// Reads the next frame. Returns false at the end of the stream or if it is damaged
+		bool next()
+		{
+			uint32_t number, tiles;
+			if (!read(number) || !read(tiles))
+			{
+				return false;
+			}
+			unsigned int tilesX = (width + tileSize - 1) / tileSize;
+			unsigned int tilesY = (height + tileSize - 1) / tileSize;
+			unsigned int pitch = width * 3;
+			for (uint32_t t = 0; t < tiles; t++)
+			{
+				uint32_t index, size;
+				if (!read(index) || !read(size) || index >= tilesX * tilesY)
+				{
+					return false;
+				}
+				data.resize(size);
+				if (!in.read(reinterpret_cast<char*>(data.data()), size))
+				{
+					return false;
+				}
+				unsigned int x0 = (index % tilesX) * tileSize;
+				unsigned int y0 = (index / tilesX) * tileSize;
+				unsigned int w = std::min(tileSize, width - x0);
+				unsigned int h = std::min(tileSize, height - y0);
+				size_t count = static_cast<size_t>(w) * h;
+				size_t pixel = 0;
+				size_t i = 0;
+				while (pixel < count)
+				{
+					if (i >= data.size())
+					{
+						return false;
+					}
+					unsigned int header = data[i++];
+					bool run = header >= 128;
+					size_t n = run ? header - 126 : header + 1;
+					if (pixel + n > count || i + (run ? 3 : n * 3) > data.size())
+					{
+						return false;
+					}
+					for (size_t k = 0; k < n; k++, pixel++)
+					{
+						unsigned char* p = &pixels[((y0 + (pixel / w)) * pitch) + ((x0 + (pixel % w)) * 3)];
+						memcpy(p, &data[run ? i : i + (k * 3)], 3);
+					}
+					i += run ? 3 : n * 3;
+				}
+			}
+			frame = number;
+			return true;
+		}
+
+		// Returns the current frame as tightly packed RGB888 pixels
+		const unsigned char* frameData() const
+		{
+			return pixels.data();
+		}
+	};
+
+	// Enum for mouse buttons
+	enum MouseButton
+	{
+		MouseLeft = 0,
+		MouseMiddle = 1,
+		MouseRight = 2
+	};
+
+	// Enum for button states
+	enum MouseButtonState
+	{
+		MouseUp = 0,
+		MouseDown = 1,
+		MousePressed = 2
+	};
+
+	// The WindowBase class holds the back buffer, drawing functions and input state shared by Window and HeadlessWindow
+	// Drawing code written against it behaves the same with or without a display
+	class WindowBase
+	{
+	protected:
+		unsigned char* image = nullptr;          // Back buffer image data
+		bool keys[256];                          // Keyboard state array
+		int mousex = 0;                          // Mouse X-coordinate
+		int mousey = 0;                          // Mouse Y-coordinate
+		MouseButtonState buttonStates[3];		 // Mouse button states
+		int mouseWheel = 0;                      // Mouse wheel value
+		unsigned int width = 0;                  // Window width
+		unsigned int height = 0;                 // Window height
+		unsigned int paddedDataSize = 0;         // Padding for backbuffer memory allocation
+		PixelFormat format = PixelRGB888;        // Layout of the back buffer pixels
+		unsigned int bytesPerPixel = 3;          // Size of each back buffer pixel in bytes
+		DirtyTracker dirty;                      // Areas of the back buffer changed since the last present
+		std::vector<DirtyTracker::Range> dirtyRanges; // Byte ranges uploaded by the last present
+		bool dirtyTracking = false;              // Upload only changed areas when true
+		unsigned int uploadBytes = 0;            // Number of bytes uploaded by the last present
+		PresentQueue presentQueue;               // Back buffers handed to the presenter thread when pipelined present is enabled. While active it owns image
+		FrameRecorder* recorder = nullptr;       // Given every presented frame when set
+
+		// Writes an RGB color to the pixel at pixelIndex in the back buffer's format
+		void writePixel(int pixelIndex, unsigned char r, unsigned char g, unsigned char b)
+		{
+			if (bytesPerPixel == 3)
+			{
+				int index = pixelIndex * 3;
+				image[index] = r;
+				image[index + 1] = g;
+				image[index + 2] = b;
+			} else
+			{
+				// 32 bit formats are written with a single aligned store
+				uint32_t value = (format == PixelBGRX8888) ? ((r << 16) | (g << 8) | b) : ((b << 16) | (g << 8) | r);
+				reinterpret_cast<uint32_t*>(image)[pixelIndex] = value | 0xFF000000;
+			}
+		}
+
+		// Allocates and clears the back buffer for the given size and format
+		void allocate(unsigned int _width, unsigned int _height, PixelFormat _format)
+		{
+			stopPipeline();
+			delete[] image;
+			width = _width;
+			height = _height;
+			format = _format;
+			bytesPerPixel = (format == PixelRGB888) ? 3 : 4;
+			unsigned int dataSize = width * height * bytesPerPixel;
+			paddedDataSize = ((dataSize + 3) / 4) * 4;
+			image = new unsigned char[paddedDataSize];
+			dirty.resize(width, height, bytesPerPixel);
+			clear(); // Clear the image data
+		}
+
+		// Sets all keys and mouse buttons to released
+		void resetInput()
+		{
+			memset(keys, 0, 256 * sizeof(bool));
+			for (int i = 0; i < 3; i++)
+			{
+				buttonStates[i] = MouseUp;
+			}
+		}
+
+		// Switches to bufferCount back buffers, with finished frames passed to fn on a presenter thread. A count below 2 presents on the calling thread again
+		void startPipeline(unsigned int bufferCount, const std::function<void(const unsigned char*, unsigned int)>& fn)
+		{
+			stopPipeline();
+			if (bufferCount < 2 || !image)
+			{
+				return;
+			}
+			presentQueue.start(bufferCount, paddedDataSize, fn, image);
+			delete[] image;
+			image = presentQueue.current();
+		}
+
+		// Presents any queued frames and goes back to a single back buffer holding the current frame
+		void stopPipeline()
+		{
+			if (!presentQueue.active())
+			{
+				return;
+			}
+			unsigned char* owned = new unsigned char[paddedDataSize];
+			memcpy(owned, image, paddedDataSize);
+			presentQueue.stop();
+			image = owned;
+			// The presented image may differ from the current frame anywhere
+			dirty.markAll();
+		}
+
+		// Gives the finished back buffer to the recorder, if one is set and recording
+		void recordFrame()
+		{
+			if (recorder != nullptr && recorder->recording())
+			{
+				recorder->record(getSurface());
+			}
+		}
+
+		// Hands the finished back buffer to the presenter thread and switches drawing to the next free buffer
+		// Every buffer holds a different frame, so the whole buffer is always uploaded
+		void submitFrame()
+		{
+			uploadBytes = paddedDataSize;
+			dirty.reset();
+			image = presentQueue.submit();
+		}
+
+		// Works out what needs to be sent to the GPU this frame and stores the number of bytes in uploadBytes
+		// Returns true if the whole buffer should be uploaded. Otherwise the changed byte ranges are left in dirtyRanges
+		bool prepareUpload()
+		{
+			if (!dirtyTracking)
+			{
+				uploadBytes = paddedDataSize;
+				return true;
+			}
+			uploadBytes = dirty.collect(dirtyRanges);
+			dirty.reset();
+			if (uploadBytes == width * height * bytesPerPixel)
+			{
+				uploadBytes = paddedDataSize;
+				return true;
+			}
+			return false;
+		}
+
+	public:
+		// Constructor sets the input state to released
+		WindowBase()
+		{
+			resetInput();
+		}
+
+		// Returns a pointer to the back buffer image data
+		unsigned char* backBuffer() const
+		{
+			return image;
+		}
+
+		// Draws a pixel at (x, y) with the specified RGB color
+		void draw(int x, int y, unsigned char r, unsigned char g, unsigned char b)
+		{
+			writePixel((y * width) + x, r, g, b);
+			if (dirtyTracking)
+			{
+				dirty.markPixel(x, y);
+			}
+		}
+
+		// Draws a pixel at the specified pixel index with the given RGB color
+		void draw(int pixelIndex, unsigned char r, unsigned char g, unsigned char b)
+		{
+			writePixel(pixelIndex, r, g, b);
+			if (dirtyTracking)
+			{
+				dirty.markPixel(pixelIndex % width, pixelIndex / width);
+			}
+		}
+
+		// Draws a pixel at (x, y) using the color from the provided pixel array
+		void draw(int x, int y, unsigned char* pixel)
+		{
+			writePixel((y * width) + x, pixel[0], pixel[1], pixel[2]);
+			if (dirtyTracking)
+			{
+				dirty.markPixel(x, y);
+			}
+		}
+
+		// Clears the back buffer by setting all pixels to black
+		void clear()
+		{
+			memset(image, 0, width * height * bytesPerPixel * sizeof(unsigned char));
+			if (dirtyTracking)
+			{
+				dirty.markAll();
+			}
+		}
+
+		// Clears the back buffer by setting all pixels to the specified RGB color
+		void clear(unsigned char r, unsigned char g, unsigned char b)
+		{
+			getSurface().clear(r, g, b);
+		}
+
+		// Fills a w x h rectangle with its top left corner at (x, y) with the specified RGB color
+		// The rectangle is clipped to the window
+		void fillRect(int x, int y, int w, int h, unsigned char r, unsigned char g, unsigned char b)
+		{
+			getSurface().fillRect(x, y, w, h, r, g, b);
+		}
+
+		// Runs a recorded command list into the back buffer using all workers of the pool. Call this before present()
+		void execute(const CommandList& commands, ThreadPool& pool)
+		{
+			Surface surface = getSurface();
+			commands.execute(surface, pool);
+		}
+
+		// Returns the window's width
+		unsigned int getWidth() const
+		{
+			return width;
+		}
+
+		// Returns the window's height
+		unsigned int getHeight() const
+		{
+			return height;
+		}
+
+		// Returns the layout of the back buffer pixels
+		PixelFormat getPixelFormat() const
+		{
+			return format;
+		}
+
+		// Provide raw access to back buffer
+		// There are no checks done on this so any writes to this buffer should be within bounds
+		// Can be used for screenshots
+		unsigned char* getBackBuffer() const
+		{
+			return image;
+		}
+
+		// Returns a Surface describing the back buffer so it can be passed to drawing code
+		// Drawing through the surface is reported to the dirty tracker when dirty tracking is enabled
+		Surface getSurface()
+		{
+			Surface surface(image, width, height, 0, format);
+			surface.dirty = dirtyTracking ? &dirty : nullptr;
+			return surface;
+		}
+
+		// Enables or disables dirty tracking. When enabled, present() uploads only the areas changed since the last present
+		// Writes made through getBackBuffer() or backBuffer() are not tracked, so call markDirty() for them
+		void enableDirtyTracking(bool enable)
+		{
+			dirtyTracking = enable;
+			dirty.markAll();
+		}
+
+		// Marks the w x h rectangle with its top left corner at (x, y) as changed so the next present() uploads it
+		void markDirty(int x, int y, int w, int h)
+		{
+			dirty.markRect(x, y, w, h);
+		}
+
+		// Returns the number of bytes uploaded to the GPU by the last present()
+		unsigned int getUploadBytes() const
+		{
+			return uploadBytes;
+		}
+
+		// Makes every present() pass the finished frame to recorder while it is recording. Pass nullptr to stop
+		// The recorder must stay alive until it is replaced or the window is destroyed
+		void setRecorder(FrameRecorder* _recorder)
+		{
+			recorder = _recorder;
+		}
+
+		// Returns the number of back buffers. This is 1 unless pipelined present is enabled
+		unsigned int getBufferCount() const
+		{
+			return presentQueue.active() ? presentQueue.bufferCount() : 1;
+		}
+
+		// Returns the number of finished frames waiting for or being presented by the presenter thread
+		unsigned int getPresentQueueDepth() const
+		{
+			return presentQueue.queueDepth();
+		}
+
+		// Waits until every finished frame has been presented
+		void flushPresent()
+		{
+			presentQueue.flush();
+		}
+
+		// Draws an image with its top left corner at (x, y), skipping pixels with an alpha value less than or equal to alphaThreshold
+		// Unlike draw(), the image is clipped to the window
+		void blit(const Image& img, int x, int y, unsigned char alphaThreshold = 0)
+		{
+			getSurface().blit(img, x, y, alphaThreshold);
+		}
+
+		// Draws the w x h region of an image starting at (srcX, srcY) with its top left corner at (x, y)
+		void blit(const Image& img, int x, int y, int srcX, int srcY, int w, int h, unsigned char alphaThreshold = 0)
+		{
+			getSurface().blit(img, x, y, srcX, srcY, w, h, alphaThreshold);
+		}
+
+		// Draws a compiled sprite with its top left corner at (x, y), clipped to the window
+		void blit(const CompiledSprite& sprite, int x, int y)
+		{
+			getSurface().blit(sprite, x, y);
+		}
+
+		// Draws the image packed into an atlas under handle with its top left corner at (x, y)
+		void blit(const TextureAtlas& atlas, unsigned int handle, int x, int y, unsigned char alphaThreshold = 0)
+		{
+			getSurface().blit(atlas, handle, x, y, alphaThreshold);
+		}
+
+		// Draws an indexed image with its top left corner at (x, y), expanding it through its palette
+		void blit(const IndexedImage& img, int x, int y)
+		{
+			getSurface().blit(img, x, y);
+		}
+
+		// Draws the w x h region of an indexed image starting at (srcX, srcY) with its top left corner at (x, y)
+		void blit(const IndexedImage& img, int x, int y, int srcX, int srcY, int w, int h)
+		{
+			getSurface().blit(img, x, y, srcX, srcY, w, h);
+		}
+
+		// Draws an image transformed by t, which maps image coordinates to window coordinates, clipped to the window
+		void blitTransformed(const Image& img, const Transform& t, SampleMode sampling = SampleNearest, BlendMode blend = BlendAlphaTest, unsigned char alphaThreshold = 0)
+		{
+			getSurface().blitTransformed(img, t, sampling, blend, alphaThreshold);
+		}
+
+		// Draws an image scaled by scale and rotated by angle radians clockwise about its centre, with the centre placed at (x, y)
+		void blitRotated(const Image& img, float x, float y, float angle, float scale = 1.0f, SampleMode sampling = SampleNearest, BlendMode blend = BlendAlphaTest, unsigned char alphaThreshold = 0)
+		{
+			getSurface().blitRotated(img, x, y, angle, scale, sampling, blend, alphaThreshold);
+		}
+
+		// Draws a line from (x0, y0) to (x1, y1) clipped to the window
+		void drawLine(int x0, int y0, int x1, int y1, unsigned char r, unsigned char g, unsigned char b)
+		{
+			getSurface().drawLine(x0, y0, x1, y1, r, g, b);
+		}
+
+		// Draws the outline of a circle centred on (cx, cy) clipped to the window
+		void drawCircle(int cx, int cy, int radius, unsigned char r, unsigned char g, unsigned char b)
+		{
+			getSurface().drawCircle(cx, cy, radius, r, g, b);
+		}
+
+		// Fills a circle centred on (cx, cy) clipped to the window
+		void fillCircle(int cx, int cy, int radius, unsigned char r, unsigned char g, unsigned char b)
+		{
+			getSurface().fillCircle(cx, cy, radius, r, g, b);
+		}
+
+		// Draws the outline of an axis aligned ellipse centred on (cx, cy) clipped to the window
+		void drawEllipse(int cx, int cy, int rx, int ry, unsigned char r, unsigned char g, unsigned char b)
+		{
+			getSurface().drawEllipse(cx, cy, rx, ry, r, g, b);
+		}
+
+		// Fills an axis aligned ellipse centred on (cx, cy) clipped to the window
+		void fillEllipse(int cx, int cy, int rx, int ry, unsigned char r, unsigned char g, unsigned char b)
+		{
+			getSurface().fillEllipse(cx, cy, rx, ry, r, g, b);
+		}
+
+		// Draws the outline of a triangle clipped to the window
+		void drawTriangle(int x0, int y0, int x1, int y1, int x2, int y2, unsigned char r, unsigned char g, unsigned char b)
+		{
+			getSurface().drawTriangle(x0, y0, x1, y1, x2, y2, r, g, b);
+		}
+
+		// Fills a triangle clipped to the window
+		void fillTriangle(int x0, int y0, int x1, int y1, int x2, int y2, unsigned char r, unsigned char g, unsigned char b)
+		{
+			getSurface().fillTriangle(x0, y0, x1, y1, x2, y2, r, g, b);
+		}
+
+		// Draws the outline of a polygon given as count (x, y) pairs, clipped to the window
+		void drawPolygon(const int* points, unsigned int count, unsigned char r, unsigned char g, unsigned char b)
+		{
+			getSurface().drawPolygon(points, count, r, g, b);
+		}
+
+		// Fills a polygon given as count (x, y) pairs using the even-odd rule, clipped to the window
+		void fillPolygon(const int* points, unsigned int count, unsigned char r, unsigned char g, unsigned char b)
+		{
+			getSurface().fillPolygon(points, count, r, g, b);
+		}
+
+		// Draws laid out text in a single colour with its top left corner at (x, y), clipped to the window
+		void drawText(const TextRun& run, int x, int y, unsigned char r, unsigned char g, unsigned char b)
+		{
+			Surface surface = getSurface();
+			run.draw(surface, x, y, r, g, b);
+		}
+
+		// Draws text through a cache in a single colour with its top left corner at (x, y), clipped to the window
+		void drawText(TextCache& cache, const std::string& text, int x, int y, unsigned char r, unsigned char g, unsigned char b)
+		{
+			Surface surface = getSurface();
+			cache.draw(surface, text, x, y, r, g, b);
+		}
+
+		// Draws the part of a tilemap seen by a camera whose top left corner is at map pixel (cameraX, cameraY)
+		void drawTilemap(Tilemap& map, int cameraX, int cameraY)
+		{
+			Surface surface = getSurface();
+			map.draw(surface, cameraX, cameraY);
+		}
+
+		// Queues a copy of the back buffer to be saved to filename by capture's writer thread. Call this after drawing and before present()
+		// Returns false if the capture was dropped because the queue was full
+		bool captureFrame(FrameCapture& capture, const std::string& filename, CaptureEncoding encoding = CapturePNG)
+		{
+			return capture.capture(getSurface(), filename, encoding);
+		}
+
+		// Draws every particle as a single pixel, blended with the back buffer
+		void drawParticles(const ParticleSystem& particles, ParticleBlend blend = ParticleAdd)
+		{
+			Surface surface = getSurface();
+			particles.draw(surface, blend);
+		}
+
+		// Draws every particle as a tinted copy of sprite centred on its position, blended with the back buffer
+		void drawParticles(const ParticleSystem& particles, const Image& sprite, ParticleBlend blend = ParticleAdd)
+		{
+			Surface surface = getSurface();
+			particles.draw(surface, sprite, blend);
+		}
+
+		// Checks if a specific key is currently pressed
+		bool keyPressed(int key) const
+		{
+			return keys[key];
+		}
+
+		// Check if a mouse button is pressed. Takes a MouseButton enum
+		bool mouseButtonPressed(MouseButton button) const
+		{
+			return (buttonStates[button] == MouseDown || buttonStates[button] == MousePressed);
+		}
+
+		// Check mouse button is state. Takes a MouseButton enum
+		MouseButtonState mouseButtonState(MouseButton button) const
+		{
+			return buttonStates[button];
+		}
+
+		// Returns the mouse x coordinate
+		int getMouseX() const
+		{
+			return mousex;
+		}
+
+		// Returns the mouse y coordinate
+		int getMouseY() const
+		{
+			return mousey;
+		}
+
+		// Returns the mouse wheel value
+		int getMouseWheel() const
+		{
+			return mouseWheel;
+		}
+
+		// Reset the mouse wheel
+		void resetMouseWheelPosition()
+		{
+			mouseWheel = 0;
+		}
+
+		// Destructor to free the back buffer
+		~WindowBase()
+		{
+			if (presentQueue.active())
+			{
+				presentQueue.stop();
+			} else
+			{
+				delete[] image;
+			}
+		}
+
+		WindowBase(const WindowBase&) = delete;
+		WindowBase& operator=(const WindowBase&) = delete;
+	};
+
+	// Types of input event that can be queued on a HeadlessWindow
+	enum InputEventType
+	{
+		InputKeyDown = 0,
+		InputKeyUp = 1,
+		InputMouseMove = 2,
+		InputMouseDown = 3,
+		InputMouseUp = 4,
+		InputMouseWheel = 5
+	};
+
+	// An input event queued on a HeadlessWindow. Only the fields used by the event type need to be set
+	struct InputEvent
+	{
+		InputEventType type;         // Kind of event
+		int key;                     // Key code for key events, using the same values as Window::keyPressed
+		int x;                       // Mouse X-coordinate for mouse events
+		int y;                       // Mouse Y-coordinate for mouse events
+		MouseButton button;          // Button for mouse button events
+		int wheel;                   // Wheel movement for wheel events
+	};
+
+	// The HeadlessWindow class has the same drawing and input interface as Window but renders to memory with no display
+	// Input comes from a queue filled by pushInput(), so games can be driven by scripts, tests or a server. Presented frames can optionally be written out as PPM files.
+	class HeadlessWindow : public WindowBase
+	{
+	private:
+		std::string name;                        // Window name/title
+		std::vector<InputEvent> inputQueue;      // Events waiting to be applied by the next checkInput() or present()
+		std::mutex inputMutex;                   // Protects inputQueue so events can be pushed from other threads
+		std::string dumpPrefix;                  // Frames are written to dumpPrefix followed by the frame number when not empty
+		unsigned int frameCount = 0;             // Number of frames presented
+
+		// Applies queued input events in the same way Window handles window messages
+		void pumpLoop()
+		{
+			std::vector<InputEvent> events;
+			{
+				std::lock_guard<std::mutex> lock(inputMutex);
+				events.swap(inputQueue);
+			}
+			for (const InputEvent& e : events)
+			{
+				for (int i = 0; i < 3; i++)
+				{
+					if (buttonStates[i] == MouseDown)
+					{
+						buttonStates[i] = MousePressed;
+					}
+				}
+				switch (e.type)
+				{
+				case InputKeyDown:
+					keys[e.key & 255] = true;
+					break;
+				case InputKeyUp:
+					keys[e.key & 255] = false;
+					break;
+				case InputMouseMove:
+					mousex = e.x;
+					mousey = e.y;
+					break;
+				case InputMouseDown:
+					mousex = e.x;
+					mousey = e.y;
+					buttonStates[e.button] = MouseDown;
+					break;
+				case InputMouseUp:
+					mousex = e.x;
+					mousey = e.y;
+					buttonStates[e.button] = MouseUp;
+					break;
+				case InputMouseWheel:
+					mouseWheel += e.wheel;
+					break;
+				}
+			}
+		}
+
+		// Returns the file name used to dump the given frame
+		std::string frameFilename(unsigned int frame) const
+		{
+			std::string number = std::to_string(frame);
+			return dumpPrefix + std::string(number.length() < 6 ? 6 - number.length() : 0, '0') + number + ".ppm";
+		}
+
+		// Writes a frame in the back buffer's format to a binary PPM file
+		bool writeFrame(const std::string& filename, const unsigned char* data) const
+		{
+			std::ofstream file(filename, std::ios::binary);
+			if (!file)
+			{
+				return false;
+			}
+			file << "P6\n" << width << " " << height << "\n255\n";
+			if (format == PixelRGB888)
+			{
+				file.write(reinterpret_cast<const char*>(data), width * height * 3);
+			} else
+			{
+				std::vector<unsigned char> row(width * 3);
+				for (unsigned int y = 0; y < height; y++)
+				{
+					const unsigned char* src = &data[y * width * 4];
+					for (unsigned int x = 0; x < width; x++)
+					{
+						row[(x * 3) + 0] = src[(x * 4) + (format == PixelBGRX8888 ? 2 : 0)];
+						row[(x * 3) + 1] = src[(x * 4) + 1];
+						row[(x * 3) + 2] = src[(x * 4) + (format == PixelBGRX8888 ? 0 : 2)];
+					}
+					file.write(reinterpret_cast<const char*>(row.data()), row.size());
+				}
+			}
+			return file.good();
+		}
+
+	public:
+		// Creates the back buffer. The fullscreen and position arguments are accepted for compatibility with Window and ignored
+		void create(unsigned int window_width, unsigned int window_height, const std::string window_name, bool window_fullscreen = false, int window_x = 0, int window_y = 0, PixelFormat window_format = PixelRGB888)
+		{
+			(void)window_fullscreen;
+			(void)window_x;
+			(void)window_y;
+			name = window_name;
+			allocate(window_width, window_height, window_format);
+			resetInput();
+			frameCount = 0;
+		}
 
-// Stop warnings about possible NULL values for buffer and backbuffer. This should work on any modern hardware.
-#pragma warning( disable : 6387)
+		// Applies queued input events
+		void checkInput()
+		{
+			pumpLoop();
+		}
 
-// Define the namespace to encapsulate the library's classes
-namespace GamesEngineeringBase
-{
+		// Finishes the frame. The upload size is still measured, and the frame is written out if frame dumping is enabled
+		void present()
+		{
+			recordFrame();
+			if (presentQueue.active())
+			{
+				submitFrame();
+			} else
+			{
+				prepareUpload();
+				if (!dumpPrefix.empty())
+				{
+					writeFrame(frameFilename(frameCount), image);
+				}
+			}
+			frameCount++;
+			pumpLoop();
+		}
 
-	// Macros to extract mouse coordinates from LPARAM
-#define CANVAS_GET_X_LPARAM(lp) ((int)(short)LOWORD(lp))
-#define CANVAS_GET_Y_LPARAM(lp) ((int)(short)HIWORD(lp))
+		// Uses bufferCount back buffers, with frames dumped on a presenter thread so present() returns straight away
+		// After present() the back buffer holds the frame drawn bufferCount frames earlier, so call backBuffer() or getSurface() again and redraw the whole frame
+		// A count of 1 goes back to presenting on the calling thread
+		void setBufferCount(unsigned int bufferCount)
+		{
+			unsigned int firstFrame = frameCount;
+			startPipeline(bufferCount, [this, firstFrame](const unsigned char* data, unsigned int frame)
+				{
+					if (!dumpPrefix.empty())
+					{
+						writeFrame(frameFilename(firstFrame + frame), data);
+					}
+				});
+		}
 
-	// Enum for mouse buttons
-	enum MouseButton
-	{
-		MouseLeft = 0,
-		MouseMiddle = 1,
-		MouseRight = 2
+		// Queues an input event to be applied by the next checkInput() or present()
+		void pushInput(const InputEvent& e)
+		{
+			std::lock_guard<std::mutex> lock(inputMutex);
+			inputQueue.push_back(e);
+		}
+
+		// Queues a key press or release
+		void pushKey(int key, bool down)
+		{
+			InputEvent e = {};
+			e.type = down ? InputKeyDown : InputKeyUp;
+			e.key = key;
+			pushInput(e);
+		}
+
+		// Queues a mouse movement to (x, y)
+		void pushMouseMove(int x, int y)
+		{
+			InputEvent e = {};
+			e.type = InputMouseMove;
+			e.x = x;
+			e.y = y;
+			pushInput(e);
+		}
+
+		// Queues a mouse button press or release at (x, y)
+		void pushMouseButton(MouseButton button, bool down, int x, int y)
+		{
+			InputEvent e = {};
+			e.type = down ? InputMouseDown : InputMouseUp;
+			e.button = button;
+			e.x = x;
+			e.y = y;
+			pushInput(e);
+		}
+
+		// Queues a mouse wheel movement
+		void pushMouseWheel(int wheel)
+		{
+			InputEvent e = {};
+			e.type = InputMouseWheel;
+			e.wheel = wheel;
+			pushInput(e);
+		}
+
+		// Gets the mouse X-coordinate relative to the window
+		int getMouseInWindowX() const
+		{
+			return mousex;
+		}
+
+		// Gets the mouse Y-coordinate relative to the window
+		int getMouseInWindowY() const
+		{
+			return mousey;
+		}
+
+		// There is no cursor to restrict, so this does nothing
+		void clipMouseToWindow() const
+		{
+		}
+
+		// Writes every presented frame to a PPM file named prefix followed by a 6 digit frame number. An empty prefix stops writing frames
+		void dumpFrames(const std::string& prefix)
+		{
+			presentQueue.flush();
+			dumpPrefix = prefix;
+		}
+
+		// Returns the number of frames presented since create()
+		unsigned int getFrameCount() const
+		{
+			return frameCount;
+		}
+
+		// Writes the current back buffer to a binary PPM file
+		bool saveFrame(const std::string& filename) const
+		{
+			return writeFrame(filename, image);
+		}
+
+		// Destructor presents any queued frames before the window is destroyed
+		~HeadlessWindow()
+		{
+			stopPipeline();
+		}
 	};
 
-	// Enum for button states
-	enum MouseButtonState
+#if !defined(_WIN32) || defined(GEB_HEADLESS)
+	// Without a display the headless window takes the place of Window, so games build unchanged
+	typedef HeadlessWindow Window;
+#endif
+
+	// The Timer class provides high-resolution timing functionality
+	class Timer
 	{
-		MouseUp = 0,
-		MouseDown = 1,
-		MousePressed = 2
+	private:
+#if defined(_WIN32)
+		LARGE_INTEGER freq;   // Frequency of the performance counter
+		LARGE_INTEGER start;  // Starting time
+#else
+		std::chrono::steady_clock::time_point start;  // Starting time
+#endif
+
+	public:
+		// Constructor that initializes the frequency
+		Timer()
+		{
+#if defined(_WIN32)
+			QueryPerformanceFrequency(&freq);
+#endif
+			reset();
+		}
+
+		// Resets the timer
+		void reset()
+		{
+#if defined(_WIN32)
+			QueryPerformanceCounter(&start);
+#else
+			start = std::chrono::steady_clock::now();
+#endif
+		}
+
+		// Returns the elapsed time since the last reset in seconds. Note this should only be called once per frame as it resets the timer.
+		float dt()
+		{
+#if defined(_WIN32)
+			LARGE_INTEGER cur;
+			QueryPerformanceCounter(&cur);
+			float value = static_cast<float>(cur.QuadPart - start.QuadPart) / freq.QuadPart;
+#else
+			std::chrono::steady_clock::time_point cur = std::chrono::steady_clock::now();
+			float value = std::chrono::duration<float>(cur - start).count();
+#endif
+			reset();
+			return value;
+		}
 	};
 
+#if defined(_WIN32)
+	// Macros to extract mouse coordinates from LPARAM
+#define CANVAS_GET_X_LPARAM(lp) ((int)(short)LOWORD(lp))
+#define CANVAS_GET_Y_LPARAM(lp) ((int)(short)HIWORD(lp))
+
+#if !defined(GEB_HEADLESS)
 	// The Window class manages the creation and rendering of a window
-	class Window
+	class Window : public WindowBase
 	{
 	private:
 		// Private member variables
@@ -89,15 +9106,6 @@ namespace GamesEngineeringBase
 		ID3D11ShaderResourceView* srv;           // Shader resource view
 		ID3D11PixelShader* ps;                   // Pixel shader
 		ID3D11VertexShader* vs;                  // Vertex shader
-		unsigned char* image;                    // Back buffer image data
-		bool keys[256];                          // Keyboard state array
-		int mousex;                              // Mouse X-coordinate
-		int mousey;                              // Mouse Y-coordinate
-		MouseButtonState buttonStates[3];		 // Mouse button states
-		int mouseWheel;                          // Mouse wheel value
-		unsigned int width = 0;                  // Window width
-		unsigned int height = 0;                 // Window height
-		unsigned int paddedDataSize = 0;         // Padding for backbuffer memory allocation
 
 		// Static window procedure to handle window messages
 		static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
@@ -232,9 +9240,24 @@ namespace GamesEngineeringBase
 			}
 		}
 
+		// Draws the uploaded buffer to the render target and presents the swap chain
+		void display()
+		{
+			// Clear the render target view
+			float ClearColor[4] = { 0.0f, 0.0f, 1.0f, 1.0f }; // RGBA
+			devcontext->ClearRenderTargetView(rtv, ClearColor);
+
+			// Draw the vertices
+			devcontext->Draw(3, 0);
+
+			// Present the swap chain
+			sc->Present(0, 0);
+		}
+
 	public:
 		// Creates and initializes the window
-		void create(unsigned int window_width, unsigned int window_height, const std::string window_name, bool window_fullscreen = false, int window_x = 0, int window_y = 0)
+		// The back buffer uses 3 bytes per pixel by default. The 32 bit formats store each pixel as one aligned word, which is faster to draw into at the cost of more memory
+		void create(unsigned int window_width, unsigned int window_height, const std::string window_name, bool window_fullscreen = false, int window_x = 0, int window_y = 0, PixelFormat window_format = PixelRGB888)
 		{
 			// Window class structure
 			WNDCLASSEX wc;
@@ -363,9 +9386,8 @@ namespace GamesEngineeringBase
 			devcontext->RSSetViewports(1, &vp);
 			devcontext->OMSetRenderTargets(1, &rtv, NULL);
 
-			// Calculate padding for GPU alignment
-			unsigned int dataSize = width * height * 3;
-			paddedDataSize = ((dataSize + 3) / 4) * 4;
+			// Allocate memory for the back buffer image data, padded for GPU alignment
+			allocate(width, height, window_format);
 
 			// Create buffer to hold the back buffer image
 			D3D11_BUFFER_DESC bufferDesc = {};
@@ -429,6 +9451,26 @@ namespace GamesEngineeringBase
 				float b = ((data >> 16) & 0xFF) / 255.0; \
                 return float4(r, g, b, 1.0f);\
             }";
+			if (bytesPerPixel == 4)
+			{
+				// 32 bit formats need a single aligned load per pixel. The positions of red and blue are written into the shader code at compile time
+				pixelShader = "ByteAddressBuffer buf : register(t0);\
+				struct VSOut\
+				{\
+					float4 pos : SV_Position;\
+				};\
+				float4 PS(VSOut psInput) : SV_Target0\
+				{\
+					uint pixelIndex = (int(psInput.pos.y) * WIDTH) + int(psInput.pos.x); \
+					uint data = buf.Load(pixelIndex * 4);\
+					float r = ((data >> RSHIFT) & 0xFF) / 255.0;\
+					float g = ((data >> 8) & 0xFF) / 255.0; \
+					float b = ((data >> BSHIFT) & 0xFF) / 255.0; \
+					return float4(r, g, b, 1.0f);\
+				}";
+				pixelShader.replace(pixelShader.find("RSHIFT"), 6, format == PixelBGRX8888 ? "16" : "0");
+				pixelShader.replace(pixelShader.find("BSHIFT"), 6, format == PixelBGRX8888 ? "0" : "16");
+			}
 			unsigned int startPos = 0;
 			std::string widthStr = std::to_string(width);
 			std::string widthConst = "WIDTH";
@@ -475,16 +9517,8 @@ namespace GamesEngineeringBase
 			devcontext->PSSetShader(ps, NULL, 0);
 			devcontext->PSSetShaderResources(0, 1, &srv);
 
-			// Allocate memory for the back buffer image data
-			image = new unsigned char[paddedDataSize];
-			clear(); // Clear the image data
-
 			// Initialize input states
-			memset(keys, 0, 256 * sizeof(bool));
-			for (int i = 0; i < 3; i++)
-			{
-				buttonStates[i] = MouseUp;
-			}
+			resetInput();
 
 			// Initialize COM library for image loading
 			HRESULT comResult;
@@ -497,125 +9531,48 @@ namespace GamesEngineeringBase
 			pumpLoop();
 		}
 
-		// Returns a pointer to the back buffer image data
-		unsigned char* backBuffer() const
-		{
-			return image;
-		}
-
-		// Draws a pixel at (x, y) with the specified RGB color
-		void draw(int x, int y, unsigned char r, unsigned char g, unsigned char b)
-		{
-			int index = ((y * width) + x) * 3;
-			image[index] = r;
-			image[index + 1] = g;
-			image[index + 2] = b;
-		}
-
-		// Draws a pixel at the specified pixel index with the given RGB color
-		void draw(int pixelIndex, unsigned char r, unsigned char g, unsigned char b)
-		{
-			int index = pixelIndex * 3;
-			image[index] = r;
-			image[index + 1] = g;
-			image[index + 2] = b;
-		}
-
-		// Draws a pixel at (x, y) using the color from the provided pixel array
-		void draw(int x, int y, unsigned char* pixel)
-		{
-			int index = ((y * width) + x) * 3;
-			image[index] = pixel[0];
-			image[index + 1] = pixel[1];
-			image[index + 2] = pixel[2];
-		}
-
-		// Clears the back buffer by setting all pixels to black
-		void clear()
-		{
-			memset(image, 0, width * height * 3 * sizeof(unsigned char));
-		}
-
-		// Presents the back buffer to the screen
-		void present()
-		{
-			// Update the texture data
-			devcontext->UpdateSubresource(buffer, 0, nullptr, image, paddedDataSize, 0);
-
-			// Clear the render target view
-			float ClearColor[4] = { 0.0f, 0.0f, 1.0f, 1.0f }; // RGBA
-			devcontext->ClearRenderTargetView(rtv, ClearColor);
-
-			// Draw the vertices
-			devcontext->Draw(3, 0);
-
-			// Present the swap chain
-			sc->Present(0, 0);
-
-			// Process any pending messages
-			pumpLoop();
-		}
-
-		// Returns the window's width
-		unsigned int getWidth() const
-		{
-			return width;
-		}
-
-		// Returns the window's height
-		unsigned int getHeight() const
-		{
-			return height;
-		}
-
-		// Provide raw access to back buffer
-		// There are no checks done on this so any writes to this buffer should be within bounds
-		// Can be used for screenshots
-		unsigned char* getBackBuffer() const
-		{
-			return image;
-		}
-
-		// Checks if a specific key is currently pressed
-		bool keyPressed(int key) const
-		{
-			return keys[key];
-		}
-
-		// Check if a mouse button is pressed. Takes a MouseButton enum
-		bool mouseButtonPressed(MouseButton button) const
-		{
-			return (buttonStates[button] == MouseDown || buttonStates[button] == MousePressed);
-		}
-
-		// Check mouse button is state. Takes a MouseButton enum
-		MouseButtonState mouseButtonState(MouseButton button) const
-		{
-			return buttonStates[button];
-		}
-
-		// Returns the mouse x coordinate
-		int getMouseX() const
-		{
-			return mousex;
-		}
-
-		// Returns the mouse y coordinate
-		int getMouseY() const
-		{
-			return mousey;
-		}
-
-		// Returns the mouse wheel value
-		int getMouseWheel() const
+		// Presents the back buffer to the screen
+		void present()
 		{
-			return mouseWheel;
+			recordFrame();
+
+			// With pipelined present the presenter thread uploads and presents the frame
+			if (presentQueue.active())
+			{
+				submitFrame();
+				pumpLoop();
+				return;
+			}
+
+			// Update the texture data, either the whole buffer or only the byte ranges that have changed
+			if (prepareUpload())
+			{
+				devcontext->UpdateSubresource(buffer, 0, nullptr, image, paddedDataSize, 0);
+			} else
+			{
+				for (const DirtyTracker::Range& range : dirtyRanges)
+				{
+					D3D11_BOX box = { range.offset, 0, 0, range.offset + range.size, 1, 1 };
+					devcontext->UpdateSubresource(buffer, 0, &box, &image[range.offset], 0, 0);
+				}
+			}
+			display();
+
+			// Process any pending messages
+			pumpLoop();
 		}
 
-		// Reset the mouse wheel
-		void resetMouseWheelPosition()
+		// Uses bufferCount back buffers. present() hands the finished frame to a presenter thread, which uploads and presents it, and returns straight away with the next free buffer
+		// After present() the back buffer holds the frame drawn bufferCount frames earlier, so call backBuffer() or getSurface() again and redraw the whole frame
+		// A count of 1 goes back to presenting on the calling thread. Window messages are always processed on the calling thread
+		void setBufferCount(unsigned int bufferCount)
 		{
-			mouseWheel = 0;
+			startPipeline(bufferCount, [this](const unsigned char* data, unsigned int frame)
+				{
+					(void)frame;
+					devcontext->UpdateSubresource(buffer, 0, nullptr, data, paddedDataSize, 0);
+					display();
+				});
 		}
 
 		// Gets the mouse X-coordinate relative to the window, accounting for zoom
@@ -667,6 +9624,8 @@ namespace GamesEngineeringBase
 		// Destructor to release resources
 		~Window()
 		{
+			// The presenter thread uses the device, so stop it first
+			stopPipeline();
 			vs->Release();
 			ps->Release();
 			srv->Release();
@@ -678,6 +9637,7 @@ namespace GamesEngineeringBase
 			CoUninitialize();
 		}
 	};
+#endif
 
 	// FourCC codes for WAV file parsing (big-Endian)
 #ifdef _XBOX
@@ -944,243 +9904,6 @@ namespace GamesEngineeringBase
 		}
 	};
 
-	// The Timer class provides high-resolution timing functionality
-	class Timer
-	{
-	private:
-		LARGE_INTEGER freq;   // Frequency of the performance counter
-		LARGE_INTEGER start;  // Starting time
-
-	public:
-		// Constructor that initializes the frequency
-		Timer()
-		{
-			QueryPerformanceFrequency(&freq);
-			reset();
-		}
-
-		// Resets the timer
-		void reset()
-		{
-			QueryPerformanceCounter(&start);
-		}
-
-		// Returns the elapsed time since the last reset in seconds. Note this should only be called once per frame as it resets the timer.
-		float dt()
-		{
-			LARGE_INTEGER cur;
-			QueryPerformanceCounter(&cur);
-			float value = static_cast<float>(cur.QuadPart - start.QuadPart) / freq.QuadPart;
-			reset();
-			return value;
-		}
-	};
-
-	// The Image class handles loading and manipulating images
-	// This class is a bit of an exception in that the members are public. The reason for this is users may want to create procedural images.
-	class Image
-	{
-	public:
-		unsigned int width;       // Image width
-		unsigned int height;      // Image height
-		unsigned int channels;    // Number of color channels
-		unsigned char* data;      // Pointer to image data
-
-		// Default constructor
-		Image()
-		{
-			width = 0;
-			height = 0;
-			channels = 0;
-			data = nullptr;
-		}
-
-		// Move constructor
-		Image(Image&& other)
-		{
-			width = other.width;
-			height = other.height;
-			channels = other.channels;
-			data = other.data;
-			other.width = 0;
-			other.height = 0;
-			other.channels = 0;
-			other.data = nullptr;
-		}
-
-		// Move assignment
-		Image& operator=(Image&& other)
-		{
-			if (this != &other)
-			{
-				free();
-				width = other.width;
-				height = other.height;
-				channels = other.channels;
-				data = other.data;
-				other.width = 0;
-				other.height = 0;
-				other.channels = 0;
-				other.data = nullptr;
-			}
-			return *this;
-		}
-
-		// Remove copy constructors
-		Image(const Image&) = delete;
-		Image& operator=(const Image&) = delete;
-
-		// Loads an image from a file using WIC
-		bool load(std::string filename)
-		{
-			Microsoft::WRL::ComPtr<IWICImagingFactory> factory;
-			HRESULT hr = ::CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
-			if (FAILED(hr))
-			{
-				return false;
-			}
-
-			Microsoft::WRL::ComPtr<IWICBitmapDecoder> decoder;
-			IWICStream* stream = NULL;
-			factory->CreateStream(&stream);
-
-			std::wstring wFilename = std::wstring(filename.begin(), filename.end());
-			stream->InitializeFromFilename(wFilename.c_str(), GENERIC_READ);
-			factory->CreateDecoderFromStream(stream, 0, WICDecodeMetadataCacheOnDemand, &decoder);
-
-			Microsoft::WRL::ComPtr<IWICBitmapFrameDecode> frame;
-			decoder->GetFrame(0, &frame);
-
-			stream->Release();
-
-			frame->GetSize(&width, &height);
-			WICPixelFormatGUID pixelFormat = { 0 };
-			frame->GetPixelFormat(&pixelFormat);
-
-			channels = 0;
-			int isRGB = 0;
-			// Determine the number of channels based on the pixel format
-			if (pixelFormat == GUID_WICPixelFormat24bppBGR)
-			{
-				channels = 3;
-			}
-			if (pixelFormat == GUID_WICPixelFormat32bppBGRA)
-			{
-				channels = 4;
-			}
-			if (pixelFormat == GUID_WICPixelFormat24bppRGB)
-			{
-				channels = 3;
-				isRGB = 1;
-			}
-			if (pixelFormat == GUID_WICPixelFormat32bppRGBA)
-			{
-				channels = 4;
-				isRGB = 1;
-			}
-			if (channels == 0)
-			{
-				return false;
-			}
-
-			data = new unsigned char[width * height * channels];
-			unsigned int stride = (width * channels + 3) & ~3; // Align stride to 4 bytes
-
-			if (stride == (width * channels))
-			{
-				// Copy pixels directly if stride matches
-				frame->CopyPixels(0, stride, width * height * channels, data);
-			} else
-			{
-				// Handle images with padded stride
-				unsigned char* strideData = new unsigned char[stride * height];
-				frame->CopyPixels(0, stride, width * height * channels, strideData);
-				for (unsigned int i = 0; i < height; i++)
-				{
-					memcpy(&data[i * width * channels], &strideData[i * stride], width * channels * sizeof(unsigned char));
-				}
-				delete[] strideData;
-			}
-
-			if (isRGB == 0)
-			{
-				// Swap red and blue channels for BGR formats
-				for (unsigned int i = 0; i < width * height; i++)
-				{
-					unsigned char p = data[i * channels];
-					data[i * channels] = data[(i * channels) + 2];
-					data[(i * channels) + 2] = p;
-				}
-			}
-			return true;
-		}
-
-		// Returns a pointer to the pixel data at (x, y)
-		// Note, the bounds are handled via clamping
-		unsigned char* at(const unsigned int x, const unsigned int y) const
-		{
-			return &data[((std::min(y, height - 1) * width) + std::min(x, width  - 1)) * channels];
-		}
-
-		// Returns the alpha value of the pixel at (x, y)
-		// Note, the bounds are handled via clamping
-		unsigned char alphaAt(const unsigned int x, const unsigned int y) const
-		{
-			if (channels == 4)
-			{
-				return data[((std::min(y, height - 1) * width) + std::min(x, width - 1)) * channels + 3];
-			}
-			return 255;
-		}
-
-		// Returns a the colour specified by index at (x, y)
-		// Note, the image bounds are handled via clamping, but the index is not checked
-		unsigned char at(const unsigned int x, const unsigned int y, const unsigned int index) const
-		{
-			return data[(((std::min(y, height - 1) * width) + std::min(x, width - 1)) * channels) + index];
-		}
-
-		// Returns a pointer to the pixel data at (x, y)
-		// Note, no checks performed on x and y coordinates
-		unsigned char* atUnchecked(const unsigned int x, const unsigned int y) const
-		{
-			return &data[((y * width) + x) * channels];
-		}
-
-		// Returns the alpha value of the pixel at (x, y)
-		// Note, no checks performed on x and y coordinates
-		unsigned char alphaAtUnchecked(const unsigned int x, const unsigned int y) const
-		{
-			if (channels == 4)
-			{
-				return data[(((y * width) + x) * channels) + 3];
-			}
-			return 255;
-		}
-
-		// Checks if the image has an alpha channel
-		bool hasAlpha() const
-		{
-			return channels == 4;
-		}
-
-		// Frees the allocated image data
-		void free()
-		{
-			if (data != NULL)
-			{
-				delete[] data;
-				data = NULL;
-			}
-		}
-
-		// Destructor to free resources
-		~Image()
-		{
-			free();
-		}
-	};
-
 	// The XBoxController class represents a single Xbox controller
 	class XBoxController
 	{
@@ -1362,5 +10085,6 @@ namespace GamesEngineeringBase
 			}
 		}
 	};
+#endif
 
 }
\ No newline at end of file
@@ -0,0 +1,116 @@
+// Compares loading 200 256 x 256 PNGs with Image::load against opening the same images baked into an AssetPack
+// On Linux the resident memory after opening, touching one image and touching all of them is reported too
+
+#include "TestUtils.h"
+#include <fstream>
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+using namespace GamesEngineeringBase;
+
+// Returns the resident memory of the process in KB, or 0 where it is not known
+static size_t residentKB()
+{
+#if defined(__linux__)
+	std::ifstream statm("/proc/self/statm");
+	size_t total = 0;
+	size_t resident = 0;
+	statm >> total >> resident;
+	return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE)) / 1024;
+#else
+	return 0;
+#endif
+}
+
+int main()
+{
+	const unsigned int count = 200;
+	const unsigned int size = 256;
+	std::vector<std::string> filenames;
+	{
+		// Noisy RGB images, so the PNGs do not compress to almost nothing
+		AssetPackWriter writer;
+		std::deque<Image> images;
+		uint32_t seed = 1;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			images.emplace_back();
+			Image& image = images.back();
+			image.allocate(size, size, 3);
+			for (unsigned int p = 0; p < size * size * 3; p++)
+			{
+				seed = (seed * 1664525u) + 1013904223u;
+				image.data[p] = static_cast<unsigned char>((p / 3) + ((seed >> 24) & 15));
+			}
+			std::vector<unsigned char> png;
+			Codecs::encodePNG(image.data, size, size, png);
+			filenames.push_back("AssetPackBenchmark" + std::to_string(i) + ".png");
+			std::ofstream out(filenames.back(), std::ios::binary);
+			out.write(reinterpret_cast<const char*>(png.data()), static_cast<std::streamsize>(png.size()));
+			writer.add(filenames.back(), image);
+		}
+		if (!writer.write("AssetPackBenchmark.pack"))
+		{
+			printf("Could not write the pack\n");
+			return 1;
+		}
+	}
+
+	Timer timer;
+	std::vector<Image> loaded(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		loaded[i].load(filenames[i]);
+	}
+	double loadMs = timer.dt() * 1000.0;
+	loaded.clear();
+
+	size_t before = residentKB();
+	timer.reset();
+	AssetPack pack;
+	bool opened = pack.open("AssetPackBenchmark.pack");
+	double openMs = timer.dt() * 1000.0;
+	if (!opened)
+	{
+		printf("Could not open the pack\n");
+		return 1;
+	}
+	size_t afterOpen = residentKB();
+	// Reads one byte per page of an image, as drawing it would
+	auto touch = [&](unsigned int index)
+		{
+			const Image& image = pack.image(index);
+			unsigned int sum = 0;
+			for (size_t p = 0; p < static_cast<size_t>(image.width) * image.height * image.channels; p += 4096)
+			{
+				sum += image.data[p];
+			}
+			return sum;
+		};
+	unsigned int sum = touch(0);
+	size_t afterOne = residentKB();
+	for (unsigned int i = 1; i < count; i++)
+	{
+		sum += touch(i);
+	}
+	size_t afterAll = residentKB();
+
+	printf("%u %u x %u images, pack %.1f MB\n", count, size, size, pack.mappedBytes() / (1024.0 * 1024.0));
+	printf("Image::load of every PNG  %9.2f ms\n", loadMs);
+	printf("AssetPack::open           %9.2f ms\n", openMs);
+	if (before != 0)
+	{
+		printf("Resident growth: open %zu KB, one image touched %zu KB, all touched %zu KB\n", afterOpen - before, afterOne - before, afterAll - before);
+	}
+	pack.close();
+	for (const std::string& filename : filenames)
+	{
+		std::remove(filename.c_str());
+	}
+	std::remove("AssetPackBenchmark.pack");
+	// Keeps the reads from being optimised away
+	volatile unsigned int sink = sum;
+	(void)sink;
+	return 0;
+}
@@ -0,0 +1,137 @@
+// Checks that images written by AssetPackWriter come back unchanged as views from AssetPack, and that damaged packs are rejected
+
+#include "TestUtils.h"
+#include <fstream>
+
+using namespace GamesEngineeringBase;
+
+// Writes bytes to a file, replacing it
+static void writeBytes(const std::string& filename, const std::vector<unsigned char>& bytes)
+{
+	std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+// Returns whether two images have the same size, channels and pixels
+static bool sameImage(const Image& a, const Image& b)
+{
+	return a.width == b.width && a.height == b.height && a.channels == b.channels &&
+		memcmp(a.data, b.data, static_cast<size_t>(a.width) * a.height * a.channels) == 0;
+}
+
+int main()
+{
+	const std::string packName = "AssetPackTest.pack";
+	const std::string damagedName = "AssetPackTest.damaged.pack";
+
+	// A.png with its mips, a generated RGB image with an odd size and a single pixel
+	Image a;
+	CHECK(a.load(GEB_RESOURCE_DIR "A.png"));
+	if (a.data == nullptr)
+	{
+		return report();
+	}
+	a.buildMips();
+	Image rgb;
+	rgb.allocate(77, 33, 3);
+	for (unsigned int i = 0; i < 77 * 33 * 3; i++)
+	{
+		rgb.data[i] = static_cast<unsigned char>((i * 31) ^ (i >> 3));
+	}
+	Image pixel;
+	pixel.allocate(1, 1, 4);
+	pixel.data[0] = 1;
+	pixel.data[1] = 2;
+	pixel.data[2] = 3;
+	pixel.data[3] = 4;
+	const Image* sources[] = { &a, &rgb, &pixel };
+	const char* names[] = { "A.png", "generated", "" };
+
+	AssetPackWriter writer;
+	for (unsigned int i = 0; i < 3; i++)
+	{
+		writer.add(names[i], *sources[i]);
+	}
+	CHECK(writer.write(packName));
+
+	{
+		AssetPack pack;
+		CHECK(pack.open(packName));
+		CHECK(pack.count() == 3);
+		for (unsigned int i = 0; i < pack.count(); i++)
+		{
+			const Image& view = pack.image(i);
+			CHECK(pack.name(i) == names[i]);
+			CHECK(pack.find(names[i]) == static_cast<int>(i));
+			CHECK(sameImage(view, *sources[i]));
+			CHECK(view.mips.size() == sources[i]->mips.size());
+			for (size_t level = 0; level < view.mips.size() && level < sources[i]->mips.size(); level++)
+			{
+				CHECK(sameImage(view.mips[level], sources[i]->mips[level]));
+			}
+			// Pixels are 64 byte aligned within the mapping
+			CHECK((reinterpret_cast<uintptr_t>(view.data) % 64) == 0);
+		}
+		CHECK(pack.find("missing") == -1);
+	}
+
+	// An empty image cannot be written
+	AssetPackWriter emptyWriter;
+	Image empty;
+	emptyWriter.add("empty", empty);
+	CHECK(!emptyWriter.write(damagedName));
+
+	std::vector<unsigned char> file;
+	CHECK(Codecs::readFile(packName, file));
+	AssetPack pack;
+
+	// Every truncation is rejected: inside the header, inside the index and inside the pixels of the last image
+	uint32_t indexSize = Codecs::readLittleEndian(&file[12]);
+	const size_t lengths[] = { 0, 4, 63, 64, 64 + (indexSize / 2), 64 + indexSize, file.size() / 2, file.size() - 1 };
+	for (size_t length : lengths)
+	{
+		writeBytes(damagedName, std::vector<unsigned char>(file.begin(), file.begin() + length));
+		bool opened = pack.open(damagedName);
+		CHECK(!opened);
+		if (opened)
+		{
+			printf("Truncated to %zu of %zu bytes opened\n", length, file.size());
+		}
+		CHECK(pack.count() == 0);
+	}
+
+	// Counts too large for the index are rejected before any entries are allocated
+	const uint32_t counts[] = { 4, (indexSize / 28) + 1, 0x10000000, 0xFFFFFFFF };
+	for (uint32_t count : counts)
+	{
+		std::vector<unsigned char> damaged = file;
+		for (unsigned int b = 0; b < 4; b++)
+		{
+			damaged[8 + b] = static_cast<unsigned char>(count >> (b * 8));
+		}
+		writeBytes(damagedName, damaged);
+		CHECK(!pack.open(damagedName));
+	}
+
+	// As are an index larger than the file, a wrong signature and a wrong version
+	std::vector<unsigned char> damaged = file;
+	damaged[15] = 0x7F;
+	writeBytes(damagedName, damaged);
+	CHECK(!pack.open(damagedName));
+	damaged = file;
+	damaged[0] = 'X';
+	writeBytes(damagedName, damaged);
+	CHECK(!pack.open(damagedName));
+	damaged = file;
+	damaged[4] = 2;
+	writeBytes(damagedName, damaged);
+	CHECK(!pack.open(damagedName));
+	CHECK(!pack.open("missing.pack"));
+
+	// The undamaged pack still opens with the same object after the failures
+	CHECK(pack.open(packName) && pack.count() == 3);
+	pack.close();
+	std::remove(packName.c_str());
+	std::remove(damagedName.c_str());
+	return report();
+}
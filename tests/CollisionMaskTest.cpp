@@ -0,0 +1,114 @@
+// Checks CollisionMask against a brute force per pixel test, for masks and offsets crossing 64 bit word boundaries
+
+#include "TestUtils.h"
+#include <random>
+
+using namespace GamesEngineeringBase;
+
+// Builds a random image with roughly density percent of its pixels solid
+static void randomImage(Image& image, unsigned int width, unsigned int height, unsigned int density, std::mt19937& random)
+{
+	image.allocate(width, height, 4);
+	for (unsigned int i = 0; i < width * height; i++)
+	{
+		image.data[(i * 4) + 3] = (random() % 100) < density ? 255 : 0;
+	}
+}
+
+// Returns whether pixel (x, y) of image is solid, with pixels outside the image empty
+static bool solid(const Image& image, int x, int y)
+{
+	return x >= 0 && y >= 0 && x < static_cast<int>(image.width) && y < static_cast<int>(image.height) && image.alphaAtUnchecked(x, y) > 0;
+}
+
+int main()
+{
+	std::mt19937 random(25);
+	// Widths on both sides of word boundaries
+	const unsigned int widths[] = { 1, 5, 63, 64, 65, 127, 128, 129, 200 };
+	unsigned int pairs = 0;
+	unsigned int touching = 0;
+	for (unsigned int n = 0; n < 3000; n++)
+	{
+		Image a;
+		Image b;
+		randomImage(a, widths[random() % 9], 1 + (random() % 12), 1 + (random() % 40), random);
+		randomImage(b, widths[random() % 9], 1 + (random() % 12), 1 + (random() % 40), random);
+		CollisionMask maskA;
+		CollisionMask maskB;
+		CHECK(maskA.build(a) && maskB.build(b));
+		// Offsets anywhere from fully left of a to fully right, including whole word steps and both signs
+		int dx = static_cast<int>(random() % (a.width + b.width + 2)) - static_cast<int>(b.width) - 1;
+		if (random() % 4 == 0)
+		{
+			dx = (static_cast<int>(random() % 5) - 2) * 64 + (static_cast<int>(random() % 3) - 1);
+		}
+		int dy = static_cast<int>(random() % (a.height + b.height)) - static_cast<int>(b.height);
+		unsigned int expected = 0;
+		int expectedX = -1;
+		int expectedY = -1;
+		for (int y = 0; y < static_cast<int>(a.height); y++)
+		{
+			for (int x = 0; x < static_cast<int>(a.width); x++)
+			{
+				if (solid(a, x, y) && solid(b, x - dx, y - dy))
+				{
+					if (expected == 0)
+					{
+						expectedX = x;
+						expectedY = y;
+					}
+					expected++;
+				}
+			}
+		}
+		pairs++;
+		touching += expected > 0 ? 1 : 0;
+		CHECK(maskA.overlapCount(maskB, dx, dy) == expected);
+		CHECK(maskA.overlaps(maskB, dx, dy) == (expected > 0));
+		int x = -1;
+		int y = -1;
+		CHECK(maskA.firstContact(maskB, dx, dy, x, y) == (expected > 0));
+		CHECK(x == expectedX && y == expectedY);
+		// The test is symmetric with the offset negated
+		CHECK(maskB.overlapCount(maskA, -dx, -dy) == expected);
+		if (failures() > 20)
+		{
+			printf("Stopping after pair %u: %u x %u against %u x %u at (%d, %d)\n", n, a.width, a.height, b.width, b.height, dx, dy);
+			break;
+		}
+	}
+	// Most pairs should touch, so the first contact and count paths are both exercised
+	CHECK(touching > pairs / 4);
+
+	// Per pixel queries and counts on a mask with bits in several words
+	Image image;
+	randomImage(image, 130, 3, 50, random);
+	CollisionMask mask;
+	CHECK(mask.build(image));
+	unsigned int solidPixels = 0;
+	bool agrees = true;
+	for (int y = -1; y <= 3; y++)
+	{
+		for (int x = -1; x <= 130; x++)
+		{
+			agrees = agrees && mask.solidAt(x, y) == solid(image, x, y);
+			solidPixels += solid(image, x, y) ? 1 : 0;
+		}
+	}
+	CHECK(agrees);
+	CHECK(mask.solidCount() == solidPixels);
+	CHECK(mask.overlapCount(mask, 0, 0) == solidPixels);
+
+	// An empty mask never overlaps, and images without alpha are solid everywhere
+	Image empty;
+	randomImage(empty, 70, 4, 0, random);
+	CollisionMask emptyMask;
+	CHECK(emptyMask.build(empty) && emptyMask.solidCount() == 0);
+	CHECK(!mask.overlaps(emptyMask, 0, 0) && !emptyMask.overlaps(mask, 0, 0));
+	Image rgb;
+	rgb.allocate(65, 2, 3);
+	CollisionMask rgbMask;
+	CHECK(rgbMask.build(rgb) && rgbMask.solidCount() == 130);
+	return report();
+}
@@ -0,0 +1,51 @@
+// Measures the time per frame of a recorded CommandList executed on 1 to hardware_concurrency threads
+
+#include "TestUtils.h"
+#include <random>
+
+using namespace GamesEngineeringBase;
+
+int main()
+{
+	Image image;
+	if (!image.load(GEB_RESOURCE_DIR "A.png"))
+	{
+		printf("Could not load A.png\n");
+		return 1;
+	}
+	CompiledSprite sprite;
+	sprite.build(image, 128);
+	const unsigned int width = 1920;
+	const unsigned int height = 1080;
+	HeadlessWindow window;
+	window.create(width, height, "CommandListBenchmark", false, 0, 0, PixelRGBX8888);
+	Surface target(window.backBuffer(), width, height, 0, PixelRGBX8888);
+
+	// A frame of a background, 500 fills, 200 alpha tested blits and 200 sprites
+	CommandList list(width, height);
+	std::mt19937 random(7);
+	list.clear(30, 30, 40);
+	for (unsigned int i = 0; i < 500; i++)
+	{
+		list.fillRect(static_cast<int>(random() % width) - 32, static_cast<int>(random() % height) - 32, 64, 64,
+			static_cast<unsigned char>(random()), static_cast<unsigned char>(random()), static_cast<unsigned char>(random()));
+	}
+	for (unsigned int i = 0; i < 200; i++)
+	{
+		list.blit(image, static_cast<int>(random() % width) - 165, static_cast<int>(random() % height) - 230, 210);
+		list.blit(sprite, static_cast<int>(random() % width) - 165, static_cast<int>(random() % height) - 230);
+	}
+
+	double serial = bestMilliseconds(5, [&] { list.execute(target); });
+	printf("%zu commands into %u tiles of a %u x %u RGBX8888 target\n", static_cast<size_t>(list.commandCount()), list.tileCount(), width, height);
+	printf("%8s %14s %10s\n", "Threads", "ms per frame", "Speedup");
+	printf("%8s %14.3f %10s\n", "serial", serial, "");
+	unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned int count = 1; count <= threads; count++)
+	{
+		ThreadPool pool(count);
+		double ms = bestMilliseconds(5, [&] { list.execute(target, pool); });
+		printf("%8u %14.3f %9.2fx\n", count, ms, serial / ms);
+	}
+	return 0;
+}
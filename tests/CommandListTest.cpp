@@ -0,0 +1,120 @@
+// Checks that a CommandList gives the same pixels as drawing the same calls directly, on one thread and on a pool
+
+#include "TestUtils.h"
+#include <random>
+
+using namespace GamesEngineeringBase;
+
+int main()
+{
+	Image image;
+	CHECK(image.load(GEB_RESOURCE_DIR "A.png"));
+	if (image.data == nullptr)
+	{
+		return report();
+	}
+	CompiledSprite sprite;
+	CHECK(sprite.build(image, 128));
+	IndexedImage indexed;
+	CHECK(indexed.build(image, true, 128));
+	// A font sheet of 8 x 10 cells with a fixed pattern of covered pixels
+	Image sheet;
+	sheet.allocate(8 * 16, 10 * 6, 4);
+	for (unsigned int i = 0; i < sheet.width * sheet.height; i++)
+	{
+		sheet.data[(i * 4) + 3] = ((i * 2654435761u) >> 13) % 3 == 0 ? 255 : 0;
+	}
+	Font font;
+	CHECK(font.build(sheet, 8, 10, 32, 0, true));
+	TextRun texts[2];
+	font.layout("Tiled text\nacross lines", texts[0]);
+	font.layout("x", texts[1]);
+	CHECK(texts[0].spanCount() > 0 && texts[1].spanCount() > 0);
+
+	const unsigned int width = 640;
+	const unsigned int height = 480;
+	const PixelFormat formats[] = { PixelRGB888, PixelRGBX8888, PixelBGRX8888 };
+	ThreadPool pool(4);
+	std::mt19937 random(2024);
+	for (PixelFormat format : formats)
+	{
+		unsigned int bpp = format == PixelRGB888 ? 3 : 4;
+		for (unsigned int tileSize : { 16u, 64u, 100u })
+		{
+			std::vector<unsigned char> expected(width * height * bpp, 0);
+			std::vector<unsigned char> serial(expected);
+			std::vector<unsigned char> pooled(expected);
+			Surface reference(expected.data(), width, height, 0, format);
+			CommandList list(width, height, tileSize);
+			reference.clear(10, 20, 30);
+			list.clear(10, 20, 30);
+			// Positions reach past every edge so calls are clipped by the surface as well as the tiles
+			auto position = [&](int size, int limit) { return static_cast<int>(random() % (limit + size)) - size; };
+			for (unsigned int i = 0; i < 300; i++)
+			{
+				unsigned char r = static_cast<unsigned char>(random());
+				unsigned char g = static_cast<unsigned char>(random());
+				unsigned char b = static_cast<unsigned char>(random());
+				switch (random() % 5)
+				{
+				case 0:
+				{
+					int w = static_cast<int>(random() % 200);
+					int h = static_cast<int>(random() % 200);
+					int x = position(w, width);
+					int y = position(h, height);
+					reference.fillRect(x, y, w, h, r, g, b);
+					list.fillRect(x, y, w, h, r, g, b);
+					break;
+				}
+				case 1:
+				{
+					int srcX = static_cast<int>(random() % image.width);
+					int srcY = static_cast<int>(random() % image.height);
+					int w = static_cast<int>(random() % (image.width - srcX)) + 1;
+					int h = static_cast<int>(random() % (image.height - srcY)) + 1;
+					int x = position(w, width);
+					int y = position(h, height);
+					unsigned char threshold = static_cast<unsigned char>(random() % 2 == 0 ? 0 : 200);
+					reference.blit(image, x, y, srcX, srcY, w, h, threshold);
+					list.blit(image, x, y, srcX, srcY, w, h, threshold);
+					break;
+				}
+				case 2:
+				{
+					int x = position(static_cast<int>(sprite.width), width);
+					int y = position(static_cast<int>(sprite.height), height);
+					reference.blit(sprite, x, y);
+					list.blit(sprite, x, y);
+					break;
+				}
+				case 3:
+				{
+					int x = position(static_cast<int>(indexed.width), width);
+					int y = position(static_cast<int>(indexed.height), height);
+					reference.blit(indexed, x, y);
+					list.blit(indexed, x, y);
+					break;
+				}
+				case 4:
+				{
+					const TextRun& text = texts[random() % 2];
+					int x = position(static_cast<int>(text.width), width);
+					int y = position(static_cast<int>(text.height), height);
+					text.draw(reference, x, y, r, g, b);
+					list.drawText(text, x, y, r, g, b);
+					break;
+				}
+				}
+			}
+			CHECK(list.commandCount() == 301);
+			Surface serialTarget(serial.data(), width, height, 0, format);
+			list.execute(serialTarget);
+			CHECK(serial == expected);
+			Surface pooledTarget(pooled.data(), width, height, 0, format);
+			list.execute(pooledTarget, pool);
+			CHECK(pooled == expected);
+		}
+	}
+	return report();
+}
@@ -0,0 +1,63 @@
+// Compares the cost of drawing Resources/A.png alpha tested per pixel, with Surface::blit of the Image, and as a CompiledSprite
+
+#include "TestUtils.h"
+
+using namespace GamesEngineeringBase;
+
+int main()
+{
+	Image image;
+	if (!image.load(GEB_RESOURCE_DIR "A.png"))
+	{
+		printf("Cannot load A.png\n");
+		return 1;
+	}
+	const unsigned char threshold = 210;
+	CompiledSprite sprite;
+	sprite.build(image, threshold);
+	const unsigned int width = 1024;
+	const unsigned int height = 768;
+	const unsigned int draws = 100;
+	std::vector<unsigned char> pixels(width * height * 3);
+	Surface surface(pixels.data(), width, height);
+	printf("%u draws of a %u x %u sprite, %u of %u pixels opaque, %u runs\n", draws, image.width, image.height, sprite.pixelCount(), image.width * image.height, sprite.spanCount());
+
+	// The loop from the original example: an alphaAt() test and a 3 byte store per pixel
+	double perPixel = bestMilliseconds(5, [&] {
+		for (unsigned int d = 0; d < draws; d++)
+		{
+			int x = (d * 37) % (width - image.width);
+			int y = (d * 53) % (height - image.height);
+			for (unsigned int j = 0; j < image.height; j++)
+			{
+				for (unsigned int i = 0; i < image.width; i++)
+				{
+					if (image.alphaAt(i, j) > threshold)
+					{
+						unsigned char* p = image.at(i, j);
+						unsigned char* q = surface.atUnchecked(x + i, y + j);
+						q[0] = p[0];
+						q[1] = p[1];
+						q[2] = p[2];
+					}
+				}
+			}
+		}
+	});
+	double blit = bestMilliseconds(5, [&] {
+		for (unsigned int d = 0; d < draws; d++)
+		{
+			surface.blit(image, (d * 37) % (width - image.width), (d * 53) % (height - image.height), threshold);
+		}
+	});
+	double compiled = bestMilliseconds(5, [&] {
+		for (unsigned int d = 0; d < draws; d++)
+		{
+			surface.blit(sprite, (d * 37) % (width - image.width), (d * 53) % (height - image.height));
+		}
+	});
+	printf("Per pixel alphaAt   %8.3f ms per draw\n", perPixel / draws);
+	printf("Surface::blit Image %8.3f ms per draw  %5.1fx\n", blit / draws, perPixel / blit);
+	printf("CompiledSprite      %8.3f ms per draw  %5.1fx\n", compiled / draws, perPixel / compiled);
+	return 0;
+}
@@ -0,0 +1,75 @@
+// Checks that drawing a CompiledSprite gives the same pixels as the per pixel alpha tested path it replaces
+
+#include "TestUtils.h"
+
+using namespace GamesEngineeringBase;
+
+// The per pixel path: draws every pixel whose alpha is above the threshold with one alphaAt() test each
+static void drawPerPixel(Surface& surface, const Image& image, int x, int y, unsigned char threshold)
+{
+	for (unsigned int j = 0; j < image.height; j++)
+	{
+		for (unsigned int i = 0; i < image.width; i++)
+		{
+			int px = x + static_cast<int>(i);
+			int py = y + static_cast<int>(j);
+			if (px >= 0 && py >= 0 && px < static_cast<int>(surface.width) && py < static_cast<int>(surface.height) && image.alphaAt(i, j) > threshold)
+			{
+				const unsigned char* p = image.at(i, j);
+				unsigned char pixel[4];
+				surface.encode(p[0], p[1], p[2], pixel);
+				memcpy(surface.atUnchecked(px, py), pixel, surface.bytesPerPixel());
+			}
+		}
+	}
+}
+
+int main()
+{
+	Image image;
+	CHECK(image.load(GEB_RESOURCE_DIR "A.png"));
+	if (image.data == nullptr)
+	{
+		return report();
+	}
+	const unsigned char thresholds[] = { 0, 210 };
+	const PixelFormat formats[] = { PixelRGB888, PixelRGBX8888, PixelBGRX8888 };
+	// Fully inside, and clipped against every edge
+	const int positions[][2] = { { 100, 50 }, { -120, -200 }, { 500, 300 }, { -50, 400 }, { 600, -30 } };
+	const unsigned int width = 800;
+	const unsigned int height = 600;
+	for (unsigned char threshold : thresholds)
+	{
+		CompiledSprite sprite;
+		CHECK(sprite.build(image, threshold));
+		CHECK(sprite.width == image.width && sprite.height == image.height);
+		unsigned int opaque = 0;
+		for (unsigned int j = 0; j < image.height; j++)
+		{
+			for (unsigned int i = 0; i < image.width; i++)
+			{
+				opaque += image.alphaAtUnchecked(i, j) > threshold ? 1 : 0;
+			}
+		}
+		CHECK(sprite.pixelCount() == opaque);
+		for (PixelFormat format : formats)
+		{
+			unsigned int bpp = format == PixelRGB888 ? 3 : 4;
+			for (const int* position : positions)
+			{
+				std::vector<unsigned char> expected(width * height * bpp, 17);
+				std::vector<unsigned char> compiled(expected);
+				std::vector<unsigned char> blitted(expected);
+				Surface reference(expected.data(), width, height, 0, format);
+				drawPerPixel(reference, image, position[0], position[1], threshold);
+				Surface target(compiled.data(), width, height, 0, format);
+				target.blit(sprite, position[0], position[1]);
+				CHECK(compiled == expected);
+				Surface imageTarget(blitted.data(), width, height, 0, format);
+				imageTarget.blit(image, position[0], position[1], threshold);
+				CHECK(blitted == expected);
+			}
+		}
+	}
+	return report();
+}
@@ -0,0 +1,74 @@
+// Checks the byte ranges DirtyTracker::collect() returns for a 100 x 50 RGBX buffer
+
+#include "TestUtils.h"
+
+using namespace GamesEngineeringBase;
+
+int main()
+{
+	const unsigned int width = 100;
+	const unsigned int height = 50;
+	const unsigned int bpp = 4;
+	const unsigned int rowBytes = width * bpp;
+	DirtyTracker tracker;
+	std::vector<DirtyTracker::Range> ranges;
+
+	// A new tracker is entirely dirty, so the whole buffer is returned
+	tracker.resize(width, height, bpp);
+	CHECK(tracker.isDirty());
+	CHECK(tracker.collect(ranges) == width * height * bpp);
+	CHECK(ranges.size() == 1 && ranges[0].offset == 0 && ranges[0].size == width * height * bpp);
+	tracker.reset();
+	CHECK(!tracker.isDirty());
+	CHECK(tracker.collect(ranges) == 0 && ranges.empty());
+
+	// A single rect without merging is one range per row of exactly its width
+	tracker.markRect(10, 5, 20, 3);
+	CHECK(tracker.collect(ranges, 0) == 20 * 3 * bpp);
+	CHECK(ranges.size() == 3);
+	for (unsigned int i = 0; i < ranges.size(); i++)
+	{
+		CHECK(ranges[i].offset == ((5 + i) * rowBytes) + (10 * bpp));
+		CHECK(ranges[i].size == 20 * bpp);
+	}
+
+	// With a gap at least as large as the bytes between rows they join into one range, which then counts the gaps too
+	unsigned int between = rowBytes - (20 * bpp);
+	CHECK(tracker.collect(ranges, between) == (2 * rowBytes) + (20 * bpp));
+	CHECK(ranges.size() == 1 && ranges[0].offset == (5 * rowBytes) + (10 * bpp));
+	CHECK(tracker.collect(ranges, between - 1) == 20 * 3 * bpp && ranges.size() == 3);
+
+	// Rects in separate rows far apart stay separate with the default gap, and marking twice counts once
+	tracker.reset();
+	tracker.markRect(0, 0, 10, 1);
+	tracker.markRect(0, 40, 10, 1);
+	tracker.markRect(0, 40, 10, 1);
+	CHECK(tracker.collect(ranges, 1024) == 2 * 10 * bpp);
+	CHECK(ranges.size() == 2 && ranges[1].offset == 40 * rowBytes);
+
+	// Off screen and negative rects contribute nothing, and partly visible rects are clipped
+	tracker.reset();
+	tracker.markRect(-30, -30, 20, 20);
+	tracker.markRect(width, 0, 10, 10);
+	tracker.markRect(0, height, 10, 10);
+	tracker.markRect(5, 5, -10, 4);
+	tracker.markRect(5, 5, 4, 0);
+	CHECK(!tracker.isDirty());
+	CHECK(tracker.collect(ranges) == 0 && ranges.empty());
+	tracker.markRect(-5, -5, 10, 10);
+	CHECK(tracker.collect(ranges, 0) == 5 * 5 * bpp && ranges.size() == 5 && ranges[0].offset == 0);
+
+	// Crossing the threshold returns one range covering the whole buffer
+	tracker.reset();
+	tracker.markRect(0, 0, width, height / 2);
+	CHECK(tracker.collect(ranges) == (height / 2) * rowBytes && ranges.size() == 1);
+	tracker.markRect(0, height / 2, 1, 1);
+	CHECK(tracker.collect(ranges, 0) == width * height * bpp);
+	CHECK(ranges.size() == 1 && ranges[0].offset == 0 && ranges[0].size == width * height * bpp);
+	// A lower fraction crosses earlier
+	tracker.reset();
+	tracker.markRect(0, 0, width, 6);
+	CHECK(tracker.collect(ranges, 0, 0.5f) == 6 * rowBytes);
+	CHECK(tracker.collect(ranges, 0, 0.1f) == width * height * bpp && ranges.size() == 1);
+	return report();
+}
@@ -0,0 +1,115 @@
+// Checks the caching and least recently used eviction of ImageManager under a memory budget
+
+#include "TestUtils.h"
+#include <fstream>
+
+using namespace GamesEngineeringBase;
+
+int main()
+{
+	// Three 64 x 64 RGB images with different pixels, written as PNGs
+	const unsigned int size = 64;
+	const size_t imageBytes = size * size * 3;
+	std::vector<std::string> filenames;
+	std::vector<std::vector<unsigned char>> pixels;
+	for (unsigned int i = 0; i < 3; i++)
+	{
+		pixels.emplace_back(imageBytes);
+		for (size_t p = 0; p < imageBytes; p++)
+		{
+			pixels[i][p] = static_cast<unsigned char>((p * (i + 3)) ^ (p >> 6));
+		}
+		std::vector<unsigned char> png;
+		Codecs::encodePNG(pixels[i].data(), size, size, png);
+		filenames.push_back("ImageManagerTest" + std::to_string(i) + ".png");
+		std::ofstream out(filenames[i], std::ios::binary);
+		out.write(reinterpret_cast<const char*>(png.data()), static_cast<std::streamsize>(png.size()));
+	}
+	auto matches = [&](const Image& image, unsigned int source)
+		{
+			return image.width == size && image.height == size && image.channels == 3 && image.data != nullptr &&
+				memcmp(image.data, pixels[source].data(), imageBytes) == 0;
+		};
+
+	// Room for two of the three images
+	ImageManager manager;
+	manager.setBudget(imageBytes * 2);
+	CHECK(manager.getBudget() == imageBytes * 2);
+
+	// The same path twice is one miss, then one hit on the same handle
+	int a = manager.load(filenames[0]);
+	CHECK(a >= 0);
+	CHECK(manager.missCount() == 1 && manager.hitCount() == 0);
+	CHECK(manager.load(filenames[0]) == a);
+	CHECK(manager.missCount() == 1 && manager.hitCount() == 1);
+	CHECK(matches(manager.get(a), 0));
+	CHECK(manager.count() == 1 && manager.residentBytes() == imageBytes);
+
+	// Use a, then b, then a again, so b is the least recently drawn
+	manager.newFrame();
+	int b = manager.load(filenames[1]);
+	CHECK(b >= 0 && b != a);
+	manager.newFrame();
+	manager.get(a);
+	CHECK(manager.evictionCount() == 0 && manager.residentBytes() == imageBytes * 2);
+
+	// Loading c goes past the budget, so b is freed and a is kept
+	manager.newFrame();
+	manager.resetCounters();
+	int c = manager.load(filenames[2]);
+	CHECK(c >= 0);
+	CHECK(manager.evictionCount() == 1);
+	CHECK(manager.missCount() == 1);
+	CHECK(manager.residentBytes() == imageBytes * 2);
+	CHECK(matches(manager.get(a), 0));
+	CHECK(manager.hitCount() == 1);
+
+	// Asking for b again reloads it through the same handle, which in turn frees the least recently drawn of a and c
+	manager.newFrame();
+	manager.get(c);
+	manager.newFrame();
+	manager.resetCounters();
+	CHECK(matches(manager.get(b), 1));
+	CHECK(manager.missCount() == 1 && manager.hitCount() == 0);
+	CHECK(manager.evictionCount() == 1);
+	CHECK(manager.residentBytes() == imageBytes * 2);
+	CHECK(manager.count() == 3);
+	// a was the one freed, so using it is a miss and c is not
+	CHECK(matches(manager.get(c), 2));
+	CHECK(manager.hitCount() == 1 && manager.missCount() == 1);
+
+	// Images used this frame are kept even when reloading a goes past the budget
+	manager.newFrame();
+	manager.resetCounters();
+	CHECK(matches(manager.get(b), 1) && matches(manager.get(c), 2) && matches(manager.get(a), 0));
+	CHECK(manager.hitCount() == 2 && manager.missCount() == 1);
+	CHECK(manager.residentBytes() == imageBytes * 3);
+	CHECK(manager.evictionCount() == 0);
+	// Until the next frame, when only the least recently drawn is freed
+	manager.newFrame();
+	CHECK(manager.evictionCount() == 1 && manager.residentBytes() == imageBytes * 2);
+
+	// Without a budget nothing is evicted
+	manager.setBudget(0);
+	manager.resetCounters();
+	for (unsigned int frame = 0; frame < 3; frame++)
+	{
+		manager.newFrame();
+		for (int handle : { a, b, c })
+		{
+			manager.get(static_cast<unsigned int>(handle));
+		}
+	}
+	CHECK(manager.evictionCount() == 0 && manager.residentBytes() == imageBytes * 3);
+
+	// A missing file gets no handle
+	CHECK(manager.load("missing.png") == -1);
+	CHECK(manager.count() == 3);
+	manager.clear();
+	CHECK(manager.count() == 0 && manager.residentBytes() == 0);
+	for (const std::string& filename : filenames)
+	{
+		std::remove(filename.c_str());
+	}
+	return report();
+}
@@ -0,0 +1,57 @@
+// Compares the cost of drawing a large image zoomed out with and without its mip chain, and reports the memory the chain takes
+
+#include "TestUtils.h"
+
+using namespace GamesEngineeringBase;
+
+int main()
+{
+	// A 2048 x 2048 RGBA image with fine detail, like a world map drawn on a minimap
+	const unsigned int size = 2048;
+	Image plain;
+	plain.allocate(size, size, 4);
+	for (unsigned int y = 0; y < size; y++)
+	{
+		for (unsigned int x = 0; x < size; x++)
+		{
+			unsigned char* p = plain.atUnchecked(x, y);
+			p[0] = static_cast<unsigned char>(((x / 4) + (y / 4)) % 2 == 0 ? 220 : 30);
+			p[1] = static_cast<unsigned char>(x / 8);
+			p[2] = static_cast<unsigned char>(y / 8);
+			p[3] = 255;
+		}
+	}
+	Image mipped;
+	mipped.allocate(size, size, 4);
+	memcpy(mipped.data, plain.data, static_cast<size_t>(size) * size * 4);
+	double build = bestMilliseconds(3, [&] { mipped.buildMips(); });
+	size_t imageBytes = static_cast<size_t>(size) * size * 4;
+	printf("%u x %u RGBA image: %.1f MB, mip chain %.1f MB (+%.1f%%), built in %.1f ms\n", size, size, imageBytes / 1e6, mipped.mipBytes() / 1e6, 100.0 * mipped.mipBytes() / imageBytes, build);
+
+	const unsigned int width = 1024;
+	const unsigned int height = 1024;
+	std::vector<unsigned char> pixels(width * height * 4);
+	Surface surface(pixels.data(), width, height, 0, PixelRGBX8888);
+	const float scales[] = { 0.5f, 0.25f, 0.125f, 0.0625f };
+	const SampleMode modes[] = { SampleNearest, SampleBilinear };
+	const char* modeNames[] = { "nearest", "bilinear" };
+	printf("%-10s %-8s %14s %14s %8s\n", "Sampling", "Scale", "No mips (ms)", "Mips (ms)", "Speedup");
+	for (unsigned int m = 0; m < 2; m++)
+	{
+		for (float scale : scales)
+		{
+			// Draws rotated slightly so every pixel is resampled, and repeated so small draws are measurable
+			unsigned int draws = static_cast<unsigned int>(1.0f / scale);
+			auto draw = [&](const Image& image) {
+				for (unsigned int i = 0; i < draws; i++)
+				{
+					surface.blitRotated(image, width / 2.0f, height / 2.0f, 0.1f, scale, modes[m], BlendAlphaTest);
+				}
+			};
+			double without = bestMilliseconds(5, [&] { draw(plain); }) / draws;
+			double with = bestMilliseconds(5, [&] { draw(mipped); }) / draws;
+			printf("%-10s %-8.4g %14.3f %14.3f %7.1fx\n", modeNames[m], scale, without, with, without / with);
+		}
+	}
+	return 0;
+}
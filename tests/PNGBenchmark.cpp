@@ -0,0 +1,58 @@
+// Measures PNG decode time per megapixel for Resources/A.png and a large generated image
+// On Windows the WIC path that Image::load used before the built in decoder is measured too
+
+#include "TestUtils.h"
+
+using namespace GamesEngineeringBase;
+
+// Prints the decode cost of a PNG file held in memory
+static void benchmark(const char* name, const std::vector<unsigned char>& file, const std::string& path)
+{
+	Image image;
+	double ms = bestMilliseconds(20, [&] { image.loadFromMemory(file.data(), file.size()); });
+	double megapixels = image.width * image.height / 1e6;
+	printf("%-24s %4u x %-4u %u channels  decodePNG %7.2f ms  %6.2f ms/MP\n", name, image.width, image.height, image.channels, ms, ms / megapixels);
+#if defined(_WIN32)
+	Image wic;
+	double wicMs = bestMilliseconds(20, [&] { wic.loadWIC(path); });
+	printf("%-24s %4u x %-4u %u channels  WIC       %7.2f ms  %6.2f ms/MP\n", name, image.width, image.height, image.channels, wicMs, wicMs / megapixels);
+#else
+	(void)path;
+#endif
+}
+
+int main()
+{
+#if defined(_WIN32)
+	CoInitializeEx(NULL, COINIT_MULTITHREADED);
+#endif
+	std::vector<unsigned char> file;
+	if (!Codecs::readFile(GEB_RESOURCE_DIR "A.png", file))
+	{
+		printf("Cannot read A.png\n");
+		return 1;
+	}
+	benchmark("A.png", file, GEB_RESOURCE_DIR "A.png");
+
+	// A 2048 x 2048 RGB image with gradients and noise, written by the library's own encoder
+	const unsigned int size = 2048;
+	std::vector<unsigned char> rgb(static_cast<size_t>(size) * size * 3);
+	for (unsigned int y = 0; y < size; y++)
+	{
+		for (unsigned int x = 0; x < size; x++)
+		{
+			unsigned char* p = &rgb[((static_cast<size_t>(y) * size) + x) * 3];
+			p[0] = static_cast<unsigned char>(x / 8);
+			p[1] = static_cast<unsigned char>(y / 8);
+			p[2] = static_cast<unsigned char>(((x * 2654435761u) ^ (y * 40503u)) >> 24);
+		}
+	}
+	std::vector<unsigned char> generated;
+	Codecs::encodePNG(rgb.data(), size, size, generated);
+	std::string path = "PNGBenchmark.png";
+	std::ofstream out(path, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(generated.data()), generated.size());
+	out.close();
+	benchmark("generated 2048 x 2048", generated, path);
+	return 0;
+}
@@ -0,0 +1,92 @@
+// Checks the built in PNG decoder against Resources/A.png and against images written by Codecs::encodePNG
+
+#include "TestUtils.h"
+
+using namespace GamesEngineeringBase;
+
+// 64 bit FNV-1a hash of a block of bytes
+static uint64_t hashBytes(const unsigned char* data, size_t size)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ data[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Decodes A.png and compares it with values from libpng
+static void testResource()
+{
+	Image image;
+	CHECK(image.load(GEB_RESOURCE_DIR "A.png"));
+	CHECK(image.width == 330);
+	CHECK(image.height == 460);
+	CHECK(image.channels == 4);
+	if (image.data == nullptr || image.width != 330 || image.height != 460 || image.channels != 4)
+	{
+		return;
+	}
+	// x, y, r, g, b, a
+	const unsigned int pixels[][6] = {
+		{ 0, 0, 0, 0, 0, 0 },
+		{ 165, 230, 109, 118, 131, 255 },
+		{ 120, 300, 185, 186, 184, 255 },
+		{ 157, 37, 135, 143, 154, 255 },
+		{ 128, 143, 200, 199, 197, 255 },
+		{ 215, 196, 72, 82, 96, 224 },
+		{ 273, 355, 48, 54, 64, 127 },
+		{ 329, 459, 0, 0, 0, 0 }
+	};
+	for (const unsigned int* p : pixels)
+	{
+		const unsigned char* q = image.atUnchecked(p[0], p[1]);
+		CHECK(q[0] == p[2] && q[1] == p[3] && q[2] == p[4] && q[3] == p[5]);
+	}
+	CHECK(hashBytes(image.data, 330 * 460 * 4) == 16686046317445941545ULL);
+}
+
+// Encodes images of assorted sizes, which exercises every row filter, and checks they decode unchanged
+static void testRoundTrip()
+{
+	const unsigned int sizes[][2] = { { 1, 1 }, { 3, 7 }, { 64, 64 }, { 257, 31 } };
+	for (const unsigned int* size : sizes)
+	{
+		std::vector<unsigned char> rgb(static_cast<size_t>(size[0]) * size[1] * 3);
+		for (size_t i = 0; i < rgb.size(); i++)
+		{
+			// A mix of smooth and noisy areas so the encoder picks different filters
+			rgb[i] = static_cast<unsigned char>((i % 3 == 0) ? (i / 3) % 251 : ((i * 2654435761u) >> 13));
+		}
+		std::vector<unsigned char> file;
+		Codecs::encodePNG(rgb.data(), size[0], size[1], file);
+		Image image;
+		CHECK(image.loadFromMemory(file.data(), file.size()));
+		CHECK(image.width == size[0] && image.height == size[1] && image.channels == 3);
+		CHECK(image.data != nullptr && memcmp(image.data, rgb.data(), rgb.size()) == 0);
+		// Every truncation before the closing 12 byte IEND chunk must fail cleanly. Without IEND the pixels are complete, so that is accepted
+		bool truncatedFailed = true;
+		for (size_t length = 0; length < file.size() - 12; length += 1 + (file.size() / 64))
+		{
+			truncatedFailed = truncatedFailed && !image.loadFromMemory(file.data(), length);
+		}
+		CHECK(truncatedFailed);
+	}
+}
+
+// Paths that cannot be read fail instead of throwing
+static void testBadPaths()
+{
+	Image image;
+	CHECK(!image.load(GEB_RESOURCE_DIR "missing.png"));
+	CHECK(!image.load(GEB_RESOURCE_DIR));
+	CHECK(image.data == nullptr);
+}
+
+int main()
+{
+	testResource();
+	testRoundTrip();
+	testBadPaths();
+	return report();
+}
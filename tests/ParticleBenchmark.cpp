@@ -0,0 +1,52 @@
+// Measures ParticleSystem update and draw cost headless, for growing particle counts, into a 1280 x 720 HeadlessWindow back buffer
+
+#include "TestUtils.h"
+
+using namespace GamesEngineeringBase;
+
+int main()
+{
+	const unsigned int width = 1280;
+	const unsigned int height = 720;
+	HeadlessWindow window;
+	window.create(width, height, "ParticleBenchmark", false, 0, 0, PixelRGBX8888);
+	Surface surface(window.backBuffer(), width, height, 0, PixelRGBX8888);
+	// A soft 5 x 5 sprite
+	Image sprite;
+	sprite.allocate(5, 5, 4);
+	for (unsigned int y = 0; y < 5; y++)
+	{
+		for (unsigned int x = 0; x < 5; x++)
+		{
+			unsigned char* p = sprite.atUnchecked(x, y);
+			int d = std::abs(static_cast<int>(x) - 2) + std::abs(static_cast<int>(y) - 2);
+			p[0] = p[1] = p[2] = 255;
+			p[3] = static_cast<unsigned char>(std::max(0, 255 - (d * 80)));
+		}
+	}
+	const unsigned int counts[] = { 10000, 50000, 100000, 250000 };
+	const float dt = 1.0f / 60.0f;
+	printf("%10s %12s %16s %14s %14s %14s\n", "Particles", "update (ms)", "updates per ms", "points add", "points alpha", "5x5 sprites");
+	for (unsigned int count : counts)
+	{
+		ParticleSystem particles(count);
+		particles.gravityY = 50.0f;
+		// Lifetimes long enough that none die while measuring, so the count stays fixed
+		uint32_t seed = 12345;
+		auto random = [&seed](float range) {
+			seed = (seed * 1664525u) + 1013904223u;
+			return (static_cast<float>(seed >> 8) / 16777216.0f) * range;
+		};
+		for (unsigned int i = 0; i < count; i++)
+		{
+			particles.emit(random(static_cast<float>(width)), random(static_cast<float>(height)), random(40.0f) - 20.0f, random(40.0f) - 20.0f, 1000.0f,
+				static_cast<unsigned char>(random(255.0f)), 128, 64, 200);
+		}
+		double update = bestMilliseconds(20, [&] { particles.update(dt); });
+		double add = bestMilliseconds(10, [&] { particles.draw(surface, ParticleAdd); });
+		double alpha = bestMilliseconds(10, [&] { particles.draw(surface, ParticleAlpha); });
+		double sprites = bestMilliseconds(5, [&] { particles.draw(surface, sprite, ParticleAdd); });
+		printf("%10u %12.3f %16.0f %11.3f ms %11.3f ms %11.3f ms\n", particles.count(), update, particles.count() / update, add, alpha, sprites);
+	}
+	return 0;
+}
@@ -0,0 +1,72 @@
+// Compares fill and blit throughput of a 1920 x 1080 back buffer in the packed RGB888 layout and the 32 bit RGBX8888 and BGRX8888 layouts
+// Runs headless: a HeadlessWindow provides the back buffer and a Surface draws into it
+
+#include "TestUtils.h"
+
+using namespace GamesEngineeringBase;
+
+int main()
+{
+	Image sprite;
+	if (!sprite.load(GEB_RESOURCE_DIR "A.png"))
+	{
+		printf("Cannot load A.png\n");
+		return 1;
+	}
+	Image opaque;
+	opaque.allocate(sprite.width, sprite.height, 4);
+	memcpy(opaque.data, sprite.data, static_cast<size_t>(sprite.width) * sprite.height * 4);
+	opaque.setChannels(3);
+
+	const unsigned int width = 1920;
+	const unsigned int height = 1080;
+	const unsigned int blits = 200;
+	const double screenPixels = width * height;
+	const double spritePixels = static_cast<double>(blits) * sprite.width * sprite.height;
+	const PixelFormat formats[] = { PixelRGB888, PixelRGBX8888, PixelBGRX8888 };
+	const char* names[] = { "RGB888", "RGBX8888", "BGRX8888" };
+	printf("Millions of pixels per second, %u x %u back buffer, %u x %u sprite\n", width, height, sprite.width, sprite.height);
+	printf("%-10s %12s %12s %12s %12s %12s\n", "Format", "draw()", "clear()", "fillRect()", "blit RGB", "blit RGBA");
+	for (unsigned int f = 0; f < 3; f++)
+	{
+		HeadlessWindow window;
+		window.create(width, height, "PixelFormatBenchmark", false, 0, 0, formats[f]);
+		Surface surface(window.backBuffer(), width, height, 0, formats[f]);
+
+		// One WindowBase::draw() call per pixel, as the original API is used
+		double draw = bestMilliseconds(5, [&] {
+			for (unsigned int y = 0; y < height; y++)
+			{
+				for (unsigned int x = 0; x < width; x++)
+				{
+					window.draw(x, y, static_cast<unsigned char>(x), static_cast<unsigned char>(y), 128);
+				}
+			}
+		});
+		double clear = bestMilliseconds(20, [&] { surface.clear(10, 20, 30); });
+		// 64 x 64 rectangles covering the screen
+		double fill = bestMilliseconds(20, [&] {
+			for (unsigned int y = 0; y < height; y += 64)
+			{
+				for (unsigned int x = 0; x < width; x += 64)
+				{
+					surface.fillRect(x, y, 64, 64, static_cast<unsigned char>(x), static_cast<unsigned char>(y), 200);
+				}
+			}
+		});
+		double blitRGB = bestMilliseconds(5, [&] {
+			for (unsigned int i = 0; i < blits; i++)
+			{
+				surface.blit(opaque, (i * 97) % (width - sprite.width), (i * 61) % (height - sprite.height));
+			}
+		});
+		double blitRGBA = bestMilliseconds(5, [&] {
+			for (unsigned int i = 0; i < blits; i++)
+			{
+				surface.blit(sprite, (i * 97) % (width - sprite.width), (i * 61) % (height - sprite.height), 210);
+			}
+		});
+		printf("%-10s %12.1f %12.1f %12.1f %12.1f %12.1f\n", names[f], screenPixels / draw / 1000.0, screenPixels / clear / 1000.0, screenPixels / fill / 1000.0, spritePixels / blitRGB / 1000.0, spritePixels / blitRGBA / 1000.0);
+	}
+	return 0;
+}
@@ -0,0 +1,229 @@
+// Checks every SIMD version of the pixel conversion kernels, and the versions the dispatchers pick, against the scalar versions
+// Rows of every length up to 100 pixels start at unaligned addresses and are followed by guard bytes that must not change
+
+#include "TestUtils.h"
+#include <cmath>
+#include <random>
+
+using namespace GamesEngineeringBase;
+using namespace GamesEngineeringBase::Kernels;
+
+// A kernel version with the name printed on failure and whether this CPU can run it
+template <typename Func>
+struct Variant
+{
+	const char* name;
+	Func func;
+	bool supported;
+};
+
+static std::mt19937 generator(24);
+
+// Returns size random bytes
+static std::vector<unsigned char> randomBytes(size_t size)
+{
+	std::vector<unsigned char> bytes(size);
+	for (unsigned char& b : bytes)
+	{
+		b = static_cast<unsigned char>(generator());
+	}
+	return bytes;
+}
+
+int main()
+{
+	const unsigned int guard = 64;   // Bytes after each row checked for stray writes
+	bool ssse3 = false;
+	bool avx2 = false;
+	bool sse2 = false;
+#if defined(GEB_X86)
+	sse2 = CPU::hasSSE2();
+	ssse3 = CPU::hasSSSE3();
+	avx2 = CPU::hasAVX2();
+#endif
+	std::vector<Variant<ConvertRowFunc>> expands = { { "expandRow32", expandRow32(), true } };
+	std::vector<Variant<ConvertRowFunc>> packs = { { "packRow24", packRow24(), true } };
+	std::vector<Variant<SwapRedBlueRowFunc>> swaps = { { "swapRedBlueRow", swapRedBlueRow(), true } };
+	std::vector<Variant<AlphaRowFunc>> premultiplies = { { "premultiplyRow", premultiplyRow(), true } };
+	std::vector<Variant<AlphaRowFunc>> unpremultiplies = { { "unpremultiplyRow", unpremultiplyRow(), true } };
+	std::vector<Variant<LuminanceRowFunc>> luminances = { { "luminanceRow", luminanceRow(), true } };
+#if defined(GEB_X86)
+	expands.push_back({ "expandRow32SSSE3", expandRow32SSSE3, ssse3 });
+	expands.push_back({ "expandRow32AVX2", expandRow32AVX2, avx2 });
+	packs.push_back({ "packRow24SSSE3", packRow24SSSE3, ssse3 });
+	packs.push_back({ "packRow24AVX2", packRow24AVX2, avx2 });
+	swaps.push_back({ "swapRedBlueRowSSSE3", swapRedBlueRowSSSE3, ssse3 });
+	swaps.push_back({ "swapRedBlueRowAVX2", swapRedBlueRowAVX2, avx2 });
+	premultiplies.push_back({ "premultiplyRowSSSE3", premultiplyRowSSSE3, ssse3 });
+	premultiplies.push_back({ "premultiplyRowAVX2", premultiplyRowAVX2, avx2 });
+	unpremultiplies.push_back({ "unpremultiplyRowSSE2", unpremultiplyRowSSE2, sse2 });
+	unpremultiplies.push_back({ "unpremultiplyRowAVX2", unpremultiplyRowAVX2, avx2 });
+	luminances.push_back({ "luminanceRowSSSE3", luminanceRowSSSE3, ssse3 });
+	luminances.push_back({ "luminanceRowAVX2", luminanceRowAVX2, avx2 });
+#endif
+	printf("SSE2 %s, SSSE3 %s, AVX2 %s\n", sse2 ? "yes" : "no", ssse3 ? "yes" : "no", avx2 ? "yes" : "no");
+
+	// Reports a variant whose output differs from the scalar one
+	auto compare = [](const char* name, const std::vector<unsigned char>& got, const std::vector<unsigned char>& expected, unsigned int count, unsigned int offset, int option)
+		{
+			if (got != expected)
+			{
+				printf("%s differs from scalar: count %u, offset %u, option %d\n", name, count, offset, option);
+				failures()++;
+			}
+		};
+
+	for (unsigned int count = 0; count < 100; count++)
+	{
+		for (unsigned int offset = 0; offset < 4; offset++)
+		{
+			// RGB to RGBX and back, with and without swapping red and blue
+			for (int swap = 0; swap < 2; swap++)
+			{
+				std::vector<unsigned char> src3 = randomBytes(offset + (count * 3));
+				std::vector<unsigned char> src4 = randomBytes(offset + (count * 4));
+				std::vector<unsigned char> base4 = randomBytes(offset + (count * 4) + guard);
+				std::vector<unsigned char> base3 = randomBytes(offset + (count * 3) + guard);
+				std::vector<unsigned char> expected4 = base4;
+				std::vector<unsigned char> expected3 = base3;
+				expandRow32Scalar(&expected4[offset], &src3[offset], count, swap != 0);
+				packRow24Scalar(&expected3[offset], &src4[offset], count, swap != 0);
+				for (const auto& v : expands)
+				{
+					if (v.supported)
+					{
+						std::vector<unsigned char> out = base4;
+						v.func(&out[offset], &src3[offset], count, swap != 0);
+						compare(v.name, out, expected4, count, offset, swap);
+					}
+				}
+				for (const auto& v : packs)
+				{
+					if (v.supported)
+					{
+						std::vector<unsigned char> out = base3;
+						v.func(&out[offset], &src4[offset], count, swap != 0);
+						compare(v.name, out, expected3, count, offset, swap);
+					}
+				}
+			}
+			// In place red and blue swap and luminance, for 3 and 4 channels
+			for (unsigned int channels = 3; channels <= 4; channels++)
+			{
+				std::vector<unsigned char> row = randomBytes(offset + (count * channels) + guard);
+				std::vector<unsigned char> expected = row;
+				swapRedBlueRowScalar(&expected[offset], count, channels);
+				for (const auto& v : swaps)
+				{
+					if (v.supported)
+					{
+						std::vector<unsigned char> out = row;
+						v.func(&out[offset], count, channels);
+						compare(v.name, out, expected, count, offset, static_cast<int>(channels));
+					}
+				}
+				std::vector<unsigned char> base = randomBytes(offset + count + guard);
+				std::vector<unsigned char> expectedLuminance = base;
+				luminanceRowScalar(&expectedLuminance[offset], &row[offset], count, channels);
+				for (const auto& v : luminances)
+				{
+					if (v.supported)
+					{
+						std::vector<unsigned char> out = base;
+						v.func(&out[offset], &row[offset], count, channels);
+						compare(v.name, out, expectedLuminance, count, offset, static_cast<int>(channels));
+					}
+				}
+			}
+			// In place premultiply and unpremultiply of RGBA
+			std::vector<unsigned char> row = randomBytes(offset + (count * 4) + guard);
+			std::vector<unsigned char> expected = row;
+			premultiplyRowScalar(&expected[offset], count);
+			for (const auto& v : premultiplies)
+			{
+				if (v.supported)
+				{
+					std::vector<unsigned char> out = row;
+					v.func(&out[offset], count);
+					compare(v.name, out, expected, count, offset, 0);
+				}
+			}
+			expected = row;
+			unpremultiplyRowScalar(&expected[offset], count);
+			for (const auto& v : unpremultiplies)
+			{
+				if (v.supported)
+				{
+					std::vector<unsigned char> out = row;
+					v.func(&out[offset], count);
+					compare(v.name, out, expected, count, offset, 0);
+				}
+			}
+		}
+	}
+
+	// Every colour value with every alpha, checked against exact rounding rather than the scalar version
+	std::vector<unsigned char> pixels(256 * 256 * 4);
+	for (unsigned int a = 0; a < 256; a++)
+	{
+		for (unsigned int c = 0; c < 256; c++)
+		{
+			unsigned char* p = &pixels[((a * 256) + c) * 4];
+			p[0] = static_cast<unsigned char>(c);
+			p[1] = static_cast<unsigned char>(255 - c);
+			p[2] = static_cast<unsigned char>(c / 2);
+			p[3] = static_cast<unsigned char>(a);
+		}
+	}
+	std::vector<Variant<AlphaRowFunc>> exact = premultiplies;
+	exact.push_back({ "premultiplyRowScalar", premultiplyRowScalar, true });
+	for (const auto& v : exact)
+	{
+		if (!v.supported)
+		{
+			continue;
+		}
+		std::vector<unsigned char> out = pixels;
+		v.func(out.data(), 256 * 256);
+		bool rounded = true;
+		for (size_t i = 0; i < out.size(); i++)
+		{
+			unsigned int alpha = pixels[(i & ~static_cast<size_t>(3)) + 3];
+			unsigned int want = (i % 4) == 3 ? alpha : static_cast<unsigned int>(std::floor((pixels[i] * alpha / 255.0) + 0.5));
+			rounded = rounded && out[i] == want;
+		}
+		if (!rounded)
+		{
+			printf("%s does not round to nearest\n", v.name);
+			failures()++;
+		}
+	}
+	std::vector<Variant<AlphaRowFunc>> exactUn = unpremultiplies;
+	exactUn.push_back({ "unpremultiplyRowScalar", unpremultiplyRowScalar, true });
+	for (const auto& v : exactUn)
+	{
+		if (!v.supported)
+		{
+			continue;
+		}
+		std::vector<unsigned char> out = pixels;
+		v.func(out.data(), 256 * 256);
+		bool rounded = true;
+		for (size_t i = 0; i < out.size(); i++)
+		{
+			unsigned int alpha = pixels[(i & ~static_cast<size_t>(3)) + 3];
+			unsigned int want = alpha;
+			if ((i % 4) != 3)
+			{
+				want = alpha == 0 ? 0 : std::min(255u, static_cast<unsigned int>(std::floor((pixels[i] * 255.0 / alpha) + 0.5)));
+			}
+			rounded = rounded && out[i] == want;
+		}
+		if (!rounded)
+		{
+			printf("%s does not round to nearest\n", v.name);
+			failures()++;
+		}
+	}
+	return report();
+}
@@ -0,0 +1,93 @@
+// Checks the buffer rotation of PresentQueue with a presenter that only records what it is given
+
+#include "TestUtils.h"
+#include <chrono>
+
+using namespace GamesEngineeringBase;
+
+// Writes the frame number into the first bytes of a buffer
+static void stamp(unsigned char* buffer, unsigned int frame)
+{
+	memcpy(buffer, &frame, sizeof(frame));
+}
+
+// Reads the frame number written by stamp()
+static unsigned int readStamp(const unsigned char* buffer)
+{
+	unsigned int frame;
+	memcpy(&frame, buffer, sizeof(frame));
+	return frame;
+}
+
+int main()
+{
+	PresentQueue queue;
+	// Without buffers there is nothing to draw into or submit
+	CHECK(!queue.active() && queue.current() == nullptr);
+	CHECK(queue.submit() == nullptr);
+	CHECK(queue.queueDepth() == 0);
+
+	for (unsigned int bufferCount : { 1u, 2u, 3u, 4u })
+	{
+		const unsigned int frames = 200;
+		std::vector<unsigned int> stamps;         // Frame drawn into each presented buffer, in present order
+		std::vector<unsigned int> numbers;        // Frame number passed with each presented buffer
+		unsigned int deepest = 0;                 // Largest queue depth seen by the presenter
+		// The presenter is slow for the first frames so the game thread runs ahead and fills the queue
+		queue.start(bufferCount, 64, [&](const unsigned char* buffer, unsigned int frame)
+			{
+				stamps.push_back(readStamp(buffer));
+				numbers.push_back(frame);
+				deepest = std::max(deepest, queue.queueDepth());
+				if (frame < 20)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			});
+		unsigned int used = std::max(2u, bufferCount);
+		CHECK(queue.active() && queue.bufferCount() == used);
+		unsigned int maxDepth = 0;
+		bool reused = true;
+		for (unsigned int frame = 0; frame < frames; frame++)
+		{
+			stamp(queue.current(), frame);
+			unsigned char* next = queue.submit();
+			CHECK(next == queue.current());
+			// The next buffer holds the frame drawn bufferCount frames ago, or zeros if it has not been used yet
+			unsigned int old = readStamp(next);
+			reused = reused && (frame + 1 < used ? old == 0 : old == frame + 1 - used);
+			maxDepth = std::max(maxDepth, queue.queueDepth());
+		}
+		CHECK(reused);
+		CHECK(maxDepth <= used - 1);
+		queue.flush();
+		CHECK(queue.queueDepth() == 0);
+		CHECK(queue.presentedCount() == frames);
+		// While submit() waits the game thread holds no buffer, so the presenter can see every buffer queued, but never more
+		CHECK(deepest <= used);
+		// Frames are presented oldest first with consecutive frame numbers
+		bool ordered = stamps.size() == frames;
+		for (unsigned int i = 0; ordered && i < frames; i++)
+		{
+			ordered = stamps[i] == i && numbers[i] == i;
+		}
+		CHECK(ordered);
+
+		// stop() presents frames still queued before returning
+		stamps.clear();
+		queue.start(bufferCount, 64, [&](const unsigned char* buffer, unsigned int)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(2));
+				stamps.push_back(readStamp(buffer));
+			});
+		for (unsigned int frame = 0; frame < 10; frame++)
+		{
+			stamp(queue.current(), frame);
+			queue.submit();
+		}
+		queue.stop();
+		CHECK(stamps.size() == 10);
+		CHECK(!queue.active() && queue.current() == nullptr && queue.submit() == nullptr);
+	}
+	return report();
+}
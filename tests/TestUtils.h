@@ -0,0 +1,37 @@
+#pragma once
+
+#include "GamesEngineeringBase.h"
+#include <stdio.h>
+
+// Reports a failed check with its location and counts it. Tests return failures() != 0 from main
+#define CHECK(condition) do { if (!(condition)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); failures()++; } } while (0)
+
+// Returns the number of failed checks
+inline int& failures()
+{
+	static int count = 0;
+	return count;
+}
+
+// Prints the result of a test program and returns its exit code
+inline int report()
+{
+	printf(failures() == 0 ? "All checks passed\n" : "%d checks failed\n", failures());
+	return failures() == 0 ? 0 : 1;
+}
+
+// Returns the fastest of repeats runs of f in milliseconds, after one warm up run
+template <typename F>
+double bestMilliseconds(unsigned int repeats, F f)
+{
+	GamesEngineeringBase::Timer timer;
+	f();
+	double best = 1e30;
+	for (unsigned int i = 0; i < repeats; i++)
+	{
+		timer.reset();
+		f();
+		best = std::min(best, static_cast<double>(timer.dt()) * 1000.0);
+	}
+	return best;
+}